@@ -31,8 +31,14 @@
 #include "util/TmpDir.h"
 #include "util/XDRStream.h"
 #include "util/make_unique.h"
+#include "xdrpp/marshal.h"
 #include "xdrpp/message.h"
 #include <cassert>
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <fstream>
 #include <future>
 
 namespace stellar
@@ -108,10 +114,12 @@ class Bucket::InputIterator
     BucketEntry const* mEntryPtr;
     XDRInputFileStream mIn;
     BucketEntry mEntry;
+    uint64_t mEntryPos{0};
 
     void
     loadEntry()
     {
+        mEntryPos = mIn.pos();
         if (mIn.readOne(mEntry))
         {
             mEntryPtr = &mEntry;
@@ -151,6 +159,24 @@ class Bucket::InputIterator
         mIn.close();
     }
 
+    // Offset of the current entry in the file (its size once exhausted).
+    uint64_t
+    getPos() const
+    {
+        return mEntryPos;
+    }
+
+    // Moves to the entry at offset `pos`, as returned by getPos.
+    void
+    seek(uint64_t pos)
+    {
+        if (!mBucket->mFilename.empty())
+        {
+            mIn.seek(pos);
+            loadEntry();
+        }
+    }
+
     InputIterator& operator++()
     {
         if (mIn)
@@ -165,6 +191,125 @@ class Bucket::InputIterator
     }
 };
 
+namespace
+{
+/**
+ * Progress of a merge, saved every Bucket::MergeCheckpointing::interval bytes
+ * of output. The output written so far is described as a list of segments
+ * (one per checkpoint) with their hashes, so that it can be checked before
+ * being resumed: writes since the last checkpoint may have been lost, or only
+ * partially made it to disk.
+ */
+struct MergeCheckpoint
+{
+    // Offsets of the current entry of each input.
+    uint64_t mOldPos{0};
+    uint64_t mNewPos{0};
+    std::vector<uint64_t> mShadowPos;
+
+    uint64_t mObjectsPut{0};
+    std::vector<uint64_t> mSegmentEnds;
+    std::vector<std::string> mSegmentHashes;
+    // The entry held back by the output, XDR-encoded; empty if none.
+    std::vector<uint8_t> mBuffered;
+
+    // BucketStats of the output so far.
+    std::map<int32_t, uint64_t> mLiveEntries;
+    std::map<int32_t, uint64_t> mDeadEntries;
+    uint64_t mShadowed{0};
+    uint64_t mDeadElided{0};
+    uint64_t mBytesReclaimed{0};
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(mOldPos, mNewPos, mShadowPos, mObjectsPut, mSegmentEnds,
+           mSegmentHashes, mBuffered, mLiveEntries, mDeadEntries, mShadowed,
+           mDeadElided, mBytesReclaimed);
+    }
+};
+
+std::map<int32_t, uint64_t>
+toCheckpointCounts(std::map<LedgerEntryType, uint64_t> const& counts)
+{
+    std::map<int32_t, uint64_t> res;
+    for (auto const& c : counts)
+    {
+        res[static_cast<int32_t>(c.first)] = c.second;
+    }
+    return res;
+}
+
+std::map<LedgerEntryType, uint64_t>
+fromCheckpointCounts(std::map<int32_t, uint64_t> const& counts)
+{
+    std::map<LedgerEntryType, uint64_t> res;
+    for (auto const& c : counts)
+    {
+        res[static_cast<LedgerEntryType>(c.first)] = c.second;
+    }
+    return res;
+}
+
+std::unique_ptr<MergeCheckpoint>
+loadMergeCheckpoint(std::string const& path, size_t nShadows)
+{
+    auto filename = path + ".state";
+    if (!fs::exists(filename))
+    {
+        return nullptr;
+    }
+    auto c = make_unique<MergeCheckpoint>();
+    try
+    {
+        std::ifstream in(filename, std::ifstream::binary);
+        cereal::PortableBinaryInputArchive ar(in);
+        ar(*c);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable merge checkpoint "
+                                << filename << ": " << e.what();
+        return nullptr;
+    }
+    if (c->mShadowPos.size() != nShadows || c->mSegmentEnds.empty() ||
+        c->mSegmentEnds.size() != c->mSegmentHashes.size())
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring invalid merge checkpoint "
+                                << filename;
+        return nullptr;
+    }
+    return c;
+}
+
+void
+saveMergeCheckpoint(std::string const& path, MergeCheckpoint const& c)
+{
+    auto filename = path + ".state";
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ofstream::binary | std::ofstream::trunc);
+        {
+            cereal::PortableBinaryOutputArchive ar(out);
+            ar(c);
+        }
+        if (!out)
+        {
+            throw std::runtime_error("failed to write merge checkpoint " +
+                                     tmp);
+        }
+    }
+#ifdef _WIN32
+    std::remove(filename.c_str());
+#endif
+    if (rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        throw std::runtime_error("failed to rename merge checkpoint " + tmp);
+    }
+}
+}
+
 /**
  * Helper class that points to an output tempfile. Absorbs BucketEntries and
  * hashes them while writing to either destination. Produces a Bucket when done.
@@ -179,6 +324,68 @@ class Bucket::OutputIterator
     size_t mBytesPut{0};
     size_t mObjectsPut{0};
     bool mKeepDeadEntries{true};
+    BucketStats mStats;
+
+    // Output of checkpointed merges only: hash of the output since the last
+    // checkpoint, and the segments checkpointed so far.
+    std::unique_ptr<SHA256> mSegmentHasher;
+    std::vector<uint64_t> mSegmentEnds;
+    std::vector<std::string> mSegmentHashes;
+    bool mResumed{false};
+
+    bool
+    resumeFrom(MergeCheckpoint const& c)
+    {
+        std::ifstream in(mFilename, std::ifstream::binary);
+        if (!in)
+        {
+            return false;
+        }
+        std::vector<char> buf(1024 * 1024);
+        uint64_t pos = 0;
+        for (size_t i = 0; i < c.mSegmentEnds.size(); ++i)
+        {
+            while (pos < c.mSegmentEnds[i])
+            {
+                auto n = static_cast<size_t>(std::min<uint64_t>(
+                    buf.size(), c.mSegmentEnds[i] - pos));
+                if (!in.read(buf.data(), n))
+                {
+                    return false;
+                }
+                mHasher->add(ByteSlice(buf.data(), n));
+                mSegmentHasher->add(ByteSlice(buf.data(), n));
+                pos += n;
+            }
+            auto h = mSegmentHasher->finish();
+            mSegmentHasher->reset();
+            if (std::string(h.begin(), h.end()) != c.mSegmentHashes[i])
+            {
+                return false;
+            }
+        }
+        in.close();
+        if (!fs::truncateFile(mFilename, pos))
+        {
+            return false;
+        }
+
+        mBytesPut = static_cast<size_t>(pos);
+        mObjectsPut = static_cast<size_t>(c.mObjectsPut);
+        mSegmentEnds = c.mSegmentEnds;
+        mSegmentHashes = c.mSegmentHashes;
+        mStats.mLiveEntries = fromCheckpointCounts(c.mLiveEntries);
+        mStats.mDeadEntries = fromCheckpointCounts(c.mDeadEntries);
+        mStats.mShadowed = c.mShadowed;
+        mStats.mDeadElided = c.mDeadElided;
+        mStats.mBytesReclaimed = c.mBytesReclaimed;
+        if (!c.mBuffered.empty())
+        {
+            mBuf = make_unique<BucketEntry>();
+            xdr::xdr_from_opaque(c.mBuffered, *mBuf);
+        }
+        return true;
+    }
 
   public:
     OutputIterator(std::string const& tmpDir, bool keepDeadEntries)
@@ -192,11 +399,80 @@ class Bucket::OutputIterator
         mOut.open(mFilename);
     }
 
+    // Output of a checkpointed merge, to `filename`; continues the output
+    // recorded by `resume` if it's still there and intact.
+    OutputIterator(std::string const& filename, bool keepDeadEntries,
+                   MergeCheckpoint const* resume)
+        : mFilename(filename)
+        , mBuf(nullptr)
+        , mHasher(SHA256::create())
+        , mKeepDeadEntries(keepDeadEntries)
+        , mSegmentHasher(SHA256::create())
+    {
+        mResumed = resume && resumeFrom(*resume);
+        if (!mResumed)
+        {
+            mHasher->reset();
+            mSegmentHasher->reset();
+            mBuf.reset();
+        }
+        CLOG(TRACE, "Bucket")
+            << "Bucket::OutputIterator opening file to write: " << mFilename;
+        mOut.open(mFilename, mResumed);
+    }
+
+    bool
+    isResumed() const
+    {
+        return mResumed;
+    }
+
+    uint64_t
+    getBytesPut() const
+    {
+        return mBytesPut;
+    }
+
+    // Makes sure what was written so far is in the file, and records it in
+    // `c` (as a new segment).
+    void
+    checkpoint(MergeCheckpoint& c)
+    {
+        assert(mSegmentHasher);
+        mOut.flush();
+        if (!mOut)
+        {
+            throw std::runtime_error("failed to write " + mFilename);
+        }
+        auto h = mSegmentHasher->finish();
+        mSegmentHasher->reset();
+        mSegmentEnds.push_back(mBytesPut);
+        mSegmentHashes.emplace_back(h.begin(), h.end());
+
+        c.mObjectsPut = mObjectsPut;
+        c.mSegmentEnds = mSegmentEnds;
+        c.mSegmentHashes = mSegmentHashes;
+        c.mLiveEntries = toCheckpointCounts(mStats.mLiveEntries);
+        c.mDeadEntries = toCheckpointCounts(mStats.mDeadEntries);
+        c.mShadowed = mStats.mShadowed;
+        c.mDeadElided = mStats.mDeadElided;
+        c.mBytesReclaimed = mStats.mBytesReclaimed;
+        c.mBuffered.clear();
+        if (mBuf)
+        {
+            auto buffered = xdr::xdr_to_opaque(*mBuf);
+            c.mBuffered.assign(buffered.begin(), buffered.end());
+        }
+    }
+
     void
     put(BucketEntry const& e)
     {
         if (!mKeepDeadEntries && e.type() == DEADENTRY)
         {
+            ++mStats.mDeadElided;
+            // as it would have been written, after its record mark
+            mStats.mBytesReclaimed += xdr::xdr_size(e) + 4;
             return;
         }
 
@@ -211,7 +487,9 @@ class Bucket::OutputIterator
             // merely replace (same identity), the buffered entry.
             if (mCmp(*mBuf, e))
             {
-                mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+                mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut,
+                              mSegmentHasher.get());
+                mStats.add(*mBuf);
                 mObjectsPut++;
             }
         }
@@ -224,13 +502,31 @@ class Bucket::OutputIterator
         *mBuf = e;
     }
 
+    // Notes an input entry not put because it is shadowed.
+    void
+    skipShadowed()
+    {
+        ++mStats.mShadowed;
+    }
+
+    // What has been written so far, complete once getBucket was called.
+    BucketStats
+    getStats() const
+    {
+        auto stats = mStats;
+        stats.mBytes = mBytesPut;
+        return stats;
+    }
+
     std::shared_ptr<Bucket>
     getBucket(BucketManager& bucketManager)
     {
         assert(mOut);
         if (mBuf)
         {
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut,
+                          mSegmentHasher.get());
+            mStats.add(*mBuf);
             mObjectsPut++;
             mBuf.reset();
         }
@@ -249,6 +545,42 @@ class Bucket::OutputIterator
     }
 };
 
+void
+BucketStats::add(BucketEntry const& e)
+{
+    if (e.type() == LIVEENTRY)
+    {
+        ++mLiveEntries[e.liveEntry().data.type()];
+    }
+    else
+    {
+        ++mDeadEntries[e.deadEntry().type()];
+    }
+}
+
+static uint64_t
+sumCounts(std::map<LedgerEntryType, uint64_t> const& counts)
+{
+    uint64_t n = 0;
+    for (auto const& c : counts)
+    {
+        n += c.second;
+    }
+    return n;
+}
+
+uint64_t
+BucketStats::countLive() const
+{
+    return sumCounts(mLiveEntries);
+}
+
+uint64_t
+BucketStats::countDead() const
+{
+    return sumCounts(mDeadEntries);
+}
+
 bool
 Bucket::containsBucketIdentity(BucketEntry const& id) const
 {
@@ -363,6 +695,7 @@ maybe_put(BucketEntryIdCmp const& cmp, Bucket::OutputIterator& out,
             // the other iterators, they will advance as and if necessary in
             // future
             // calls to maybe_put.
+            out.skipShadowed();
             return;
         }
     }
@@ -370,12 +703,29 @@ maybe_put(BucketEntryIdCmp const& cmp, Bucket::OutputIterator& out,
     out.put(*in);
 }
 
+Hash
+Bucket::getMergeKey(std::shared_ptr<Bucket> const& oldBucket,
+                    std::shared_ptr<Bucket> const& newBucket,
+                    std::vector<std::shared_ptr<Bucket>> const& shadows,
+                    bool keepDeadEntries)
+{
+    auto hasher = SHA256::create();
+    hasher->add(oldBucket->getHash());
+    hasher->add(newBucket->getHash());
+    for (auto const& b : shadows)
+    {
+        hasher->add(b->getHash());
+    }
+    hasher->add(keepDeadEntries ? "keep" : "drop");
+    return hasher->finish();
+}
+
 std::shared_ptr<Bucket>
 Bucket::merge(BucketManager& bucketManager,
               std::shared_ptr<Bucket> const& oldBucket,
               std::shared_ptr<Bucket> const& newBucket,
               std::vector<std::shared_ptr<Bucket>> const& shadows,
-              bool keepDeadEntries)
+              bool keepDeadEntries, MergeCheckpointing const* checkpointing)
 {
     // This is the key operation in the scheme: merging two (read-only)
     // buckets together into a new 3rd bucket, while calculating its hash,
@@ -384,6 +734,19 @@ Bucket::merge(BucketManager& bucketManager,
     assert(oldBucket);
     assert(newBucket);
 
+    auto mergeKey =
+        getMergeKey(oldBucket, newBucket, shadows, keepDeadEntries);
+    auto done = bucketManager.getMergeOutput(mergeKey);
+    if (done)
+    {
+        if (checkpointing)
+        {
+            std::remove((checkpointing->path + ".state").c_str());
+            std::remove((checkpointing->path + ".xdr").c_str());
+        }
+        return done;
+    }
+
     Bucket::InputIterator oi(oldBucket);
     Bucket::InputIterator ni(newBucket);
 
@@ -391,11 +754,65 @@ Bucket::merge(BucketManager& bucketManager,
                                                        shadows.end());
 
     auto timer = bucketManager.getMergeTimer().TimeScope();
-    Bucket::OutputIterator out(bucketManager.getTmpDir(), keepDeadEntries);
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Bucket::OutputIterator> output;
+    if (checkpointing)
+    {
+        auto resume = loadMergeCheckpoint(checkpointing->path, shadows.size());
+        output = make_unique<Bucket::OutputIterator>(
+            checkpointing->path + ".xdr", keepDeadEntries, resume.get());
+        if (output->isResumed())
+        {
+            CLOG(INFO, "Bucket")
+                << "Resuming merge of " << hexAbbrev(oldBucket->getHash())
+                << " with " << hexAbbrev(newBucket->getHash()) << " at byte "
+                << output->getBytesPut();
+            bucketManager.getMergeResumedMeter().Mark();
+            oi.seek(resume->mOldPos);
+            ni.seek(resume->mNewPos);
+            for (size_t i = 0; i < shadowIterators.size(); ++i)
+            {
+                shadowIterators[i].seek(resume->mShadowPos[i]);
+            }
+        }
+        else if (resume)
+        {
+            CLOG(WARNING, "Bucket")
+                << "Restarting merge " << checkpointing->path
+                << ", its output does not match its checkpoint";
+        }
+    }
+    else
+    {
+        output = make_unique<Bucket::OutputIterator>(bucketManager.getTmpDir(),
+                                                     keepDeadEntries);
+    }
+    auto& out = *output;
+    uint64_t nextCheckpoint =
+        out.getBytesPut() + (checkpointing ? checkpointing->interval : 0);
 
     BucketEntryIdCmp cmp;
     while (oi || ni)
     {
+        if (checkpointing && checkpointing->interval != 0 &&
+            out.getBytesPut() >= nextCheckpoint)
+        {
+            MergeCheckpoint c;
+            out.checkpoint(c);
+            c.mOldPos = oi.getPos();
+            c.mNewPos = ni.getPos();
+            for (auto const& si : shadowIterators)
+            {
+                c.mShadowPos.push_back(si.getPos());
+            }
+            saveMergeCheckpoint(checkpointing->path, c);
+            nextCheckpoint = out.getBytesPut() + checkpointing->interval;
+            if (checkpointing->onCheckpoint)
+            {
+                checkpointing->onCheckpoint();
+            }
+        }
+
         if (!ni)
         {
             // Out of new entries, take old entries.
@@ -428,7 +845,17 @@ Bucket::merge(BucketManager& bucketManager,
             ++ni;
         }
     }
-    return out.getBucket(bucketManager);
+    auto bucket = out.getBucket(bucketManager);
+    bucketManager.recordMergeOutput(mergeKey, bucket->getHash());
+    auto stats = out.getStats();
+    stats.mMergeDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    bucketManager.recordBucketStats(bucket->getHash(), stats);
+    if (checkpointing)
+    {
+        std::remove((checkpointing->path + ".state").c_str());
+    }
+    return bucket;
 }
 
 static void
@@ -6,6 +6,9 @@
 
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
+#include <chrono>
+#include <functional>
+#include <map>
 #include <string>
 
 namespace medida
@@ -31,6 +34,29 @@ class BucketManager;
 class BucketList;
 class Database;
 
+/**
+ * What a bucket holds, accounted by the merge that wrote it (rather than by
+ * reading the bucket back), along with what that merge did.
+ */
+struct BucketStats
+{
+    std::map<LedgerEntryType, uint64_t> mLiveEntries;
+    std::map<LedgerEntryType, uint64_t> mDeadEntries;
+    uint64_t mBytes{0};
+    // Input entries dropped because a shadow had a newer version of them.
+    uint64_t mShadowed{0};
+    // Tombstones dropped by a merge not keeping dead entries (into the
+    // bottom level, where there is nothing older for them to delete), and
+    // the bytes they would have taken.
+    uint64_t mDeadElided{0};
+    uint64_t mBytesReclaimed{0};
+    std::chrono::nanoseconds mMergeDuration{0};
+
+    void add(BucketEntry const& e);
+    uint64_t countLive() const;
+    uint64_t countDead() const;
+};
+
 class Bucket : public std::enable_shared_from_this<Bucket>,
                public NonMovableOrCopyable
 {
@@ -48,6 +74,19 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // when finished, used internally during merging.
     class OutputIterator;
 
+    // Where and how often a merge records its progress, so that it can be
+    // resumed if interrupted (by a restart): merging the same inputs again
+    // with the same `path` continues from the last checkpoint.
+    struct MergeCheckpointing
+    {
+        // The partial output is `path`.xdr, the checkpoint `path`.state.
+        std::string path;
+        // Bytes of output between checkpoints.
+        uint64_t interval;
+        // Called after each checkpoint, for testing.
+        std::function<void()> onCheckpoint;
+    };
+
     // Create an empty bucket. The empty bucket has hash '000000...' and its
     // filename is the empty string.
     Bucket();
@@ -94,17 +133,32 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
           std::vector<LedgerEntry> const& liveEntries,
           std::vector<LedgerKey> const& deadEntries);
 
+    // Identifies the merge of the given buckets: merges with the same key
+    // produce the same output.
+    static Hash getMergeKey(std::shared_ptr<Bucket> const& oldBucket,
+                            std::shared_ptr<Bucket> const& newBucket,
+                            std::vector<std::shared_ptr<Bucket>> const& shadows,
+                            bool keepDeadEntries);
+
     // Merge two buckets together, producing a fresh one. Entries in `oldBucket`
     // are overridden in the fresh bucket by keywise-equal entries in
     // `newBucket`. Entries are inhibited from the fresh bucket by keywise-equal
     // entries in any of the buckets in the provided `shadows` vector.
+    //
+    // With `checkpointing`, progress is saved as the merge goes and a saved
+    // checkpoint is resumed from, once the output written so far has been
+    // checked against it.
+    //
+    // A merge that was done before (see BucketManager::getMergeOutput) is not
+    // redone, its output is returned.
     static std::shared_ptr<Bucket>
     merge(BucketManager& bucketManager,
           std::shared_ptr<Bucket> const& oldBucket,
           std::shared_ptr<Bucket> const& newBucket,
           std::vector<std::shared_ptr<Bucket>> const& shadows =
               std::vector<std::shared_ptr<Bucket>>(),
-          bool keepDeadEntries = true);
+          bool keepDeadEntries = true,
+          MergeCheckpointing const* checkpointing = nullptr);
 };
 
 void checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
@@ -135,6 +135,9 @@ BucketLevel::prepare(Application& app, uint32_t currLedger,
         }
     }
 
+    // There is nothing older than the bottom level for a tombstone to delete,
+    // so merges into it drop them (as they always did: the BucketList hash
+    // depends on it).
     bool keepDeadEntries = mLevel < BucketList::kNumLevels - 1;
     mNextCurr = FutureBucket(app, curr, snap, shadows, keepDeadEntries);
     assert(mNextCurr.isMerging());
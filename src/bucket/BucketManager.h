@@ -5,12 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/Bucket.h"
+#include "lib/json/json-forwards.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include <memory>
 
 #include "medida/timer_context.h"
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
@@ -55,6 +61,8 @@ class BucketManager : NonMovableOrCopyable
     virtual BucketList& getBucketList() = 0;
 
     virtual medida::Timer& getMergeTimer() = 0;
+    // Marked by each merge resumed from a checkpoint.
+    virtual medida::Meter& getMergeResumedMeter() = 0;
 
     // Get a reference to a persistent bucket (in the BucketManager's bucket
     // directory), from the BucketManager's shared bucket-set.
@@ -74,12 +82,57 @@ class BucketManager : NonMovableOrCopyable
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
-    // Forget any buckets not referenced by the current BucketList. This will
-    // not immediately cause the buckets to delete themselves, if someone else
-    // is using them via a shared_ptr<>, but the BucketManager will no longer
-    // independently keep them alive.
+    // Output of a merge done before with the same inputs (as identified by
+    // Bucket::getMergeKey), if it is still around; else nullptr. Merge
+    // outputs are remembered across restarts, as long as the buckets last.
+    virtual std::shared_ptr<Bucket> getMergeOutput(Hash const& mergeKey) = 0;
+    virtual void recordMergeOutput(Hash const& mergeKey,
+                                   Hash const& output) = 0;
+
+    // Stats of a bucket, recorded by the merge that produced it; so only
+    // known for the buckets merged by this node. Like merge outputs, they are
+    // remembered across restarts as long as the buckets last. Threadsafe.
+    virtual void recordBucketStats(Hash const& hash,
+                                   BucketStats const& stats) = 0;
+    virtual bool getBucketStats(Hash const& hash, BucketStats& stats) = 0;
+
+    // Describes the shape of the BucketList: the contents and file size of
+    // the curr and snap buckets of each level, and the state of its merge.
+    virtual void dumpStats(Json::Value& ret) = 0;
+
+    // Save the merge memo and the bucket stats to the bucket directory, if
+    // they changed. Done at checkpoints and on shutdown, so a crash only
+    // loses what was merged since the last checkpoint.
+    virtual void saveMergeState() = 0;
+
+    // Path (see Bucket::MergeCheckpointing) under which the merge identified
+    // by `mergeKey` saves its progress, taking over the checkpoint it left in
+    // the previous run if any; or an empty string if that merge is already
+    // running. Threadsafe, as releaseMergeCheckpointPath, which has to be
+    // called once the merge is done.
+    virtual std::string acquireMergeCheckpointPath(Hash const& mergeKey) = 0;
+    virtual void releaseMergeCheckpointPath(std::string const& path) = 0;
+
+    // Forget any buckets not referenced by the current BucketList or the
+    // publish queue. This will not immediately cause the buckets to delete
+    // themselves, if someone else is using them via a shared_ptr<>, but the
+    // BucketManager will no longer independently keep them alive.
+    //
+    // Only the buckets that may have lost a reference since the last call
+    // (dropped from the BucketList, released by the publish queue, or never
+    // referenced since they were adopted) are examined, and their files are
+    // deleted on a worker thread.
     virtual void forgetUnreferencedBuckets() = 0;
 
+    // Note that the buckets of `has`, a state being queued for publication,
+    // have to be kept until the matching call to removePublishQueueReferences,
+    // even once the BucketList no longer references them.
+    virtual void addPublishQueueReferences(HistoryArchiveState const& has) = 0;
+
+    // Note that `has` is no longer queued for publication.
+    virtual void
+    removePublishQueueReferences(HistoryArchiveState const& has) = 0;
+
     // Feed a new batch of entries to the bucket list.
     virtual void addBatch(Application& app, uint32_t currLedger,
                           std::vector<LedgerEntry> const& liveEntries,
@@ -2,10 +2,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/BucketList.h"
 #include "crypto/Hex.h"
+#include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/StellarXDR.h"
@@ -14,6 +17,10 @@
 #include "util/TmpDir.h"
 #include "util/make_unique.h"
 #include "util/types.h"
+#include <cereal/archives/json.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cstdio>
 #include <fstream>
 #include <map>
 #include <set>
@@ -62,9 +69,29 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
           app.getMetrics().NewMeter({"bucket", "byte", "insert"}, "byte"))
     , mBucketAddBatch(app.getMetrics().NewTimer({"bucket", "batch", "add"}))
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
+    , mBucketMergeResumed(
+          app.getMetrics().NewMeter({"bucket", "merge", "resumed"}, "merge"))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
-
+    , mPublishQueueReferencesLoaded(false)
+    , mGCCandidatesSize(
+          app.getMetrics().NewCounter({"bucket", "gc", "candidates"}))
+    , mGCDropped(
+          app.getMetrics().NewMeter({"bucket", "gc", "dropped"}, "bucket"))
+    , mMergeMemoLoaded(false)
+    , mMergeMemoDirty(false)
+    , mMergeMemoHit(
+          app.getMetrics().NewMeter({"bucket", "merge-memo", "hit"}, "merge"))
+    , mMergeMemoMiss(
+          app.getMetrics().NewMeter({"bucket", "merge-memo", "miss"}, "merge"))
+    , mBucketStatsLoaded(false)
+    , mBucketStatsDirty(false)
+    , mMergeShadowed(
+          app.getMetrics().NewMeter({"bucket", "merge", "shadowed"}, "entry"))
+    , mMergeDeadElided(app.getMetrics().NewMeter(
+          {"bucket", "merge", "tombstones-elided"}, "entry"))
+    , mMergeBytesReclaimed(app.getMetrics().NewMeter(
+          {"bucket", "merge", "bytes-reclaimed"}, "byte"))
 {
 }
 
@@ -125,6 +152,7 @@ BucketManagerImpl::~BucketManagerImpl()
 {
     if (mLockedBucketDir)
     {
+        saveMergeState();
         std::string d = mApp.getConfig().BUCKET_DIR_PATH;
         std::string lock = d + "/" + kLockFilename;
         assert(fs::exists(lock));
@@ -144,6 +172,12 @@ BucketManagerImpl::getMergeTimer()
     return mBucketSnapMerge;
 }
 
+medida::Meter&
+BucketManagerImpl::getMergeResumedMeter()
+{
+    return mBucketMergeResumed;
+}
+
 std::shared_ptr<Bucket>
 BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                                      uint256 const& hash, size_t nObjects,
@@ -174,8 +208,13 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
 
         b = std::make_shared<Bucket>(canonicalName, hash);
         {
+            b->setRetain(true);
             mSharedBuckets.insert(std::make_pair(hash, b));
             mSharedBucketsSize.set_count(mSharedBuckets.size());
+            // If nothing ever references the new bucket, the next
+            // forgetUnreferencedBuckets drops it.
+            mGCCandidates.insert(hash);
+            mGCCandidatesSize.set_count(mGCCandidates.size());
         }
     }
     assert(b);
@@ -205,75 +244,630 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
                               << binToHex(hash)
                               << ") found no bucket, making new one";
         auto p = std::make_shared<Bucket>(canonicalName, hash);
+        p->setRetain(true);
         mSharedBuckets.insert(std::make_pair(hash, p));
         mSharedBucketsSize.set_count(mSharedBuckets.size());
+        mGCCandidates.insert(hash);
+        mGCCandidatesSize.set_count(mGCCandidates.size());
         return p;
     }
     return std::shared_ptr<Bucket>();
 }
 
+std::string const&
+BucketManagerImpl::getMergeDir()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (mMergeDir.empty())
+    {
+        auto dir = getBucketDir() + "/merges";
+        auto previous = getBucketDir() + "/merges-previous";
+        if (fs::exists(previous))
+        {
+            fs::deltree(previous);
+        }
+        if (fs::exists(dir))
+        {
+            if (rename(dir.c_str(), previous.c_str()) != 0)
+            {
+                throw std::runtime_error("Unable to move aside " + dir);
+            }
+            mPreviousMergeDir = previous;
+        }
+        if (!fs::mkpath(dir))
+        {
+            throw std::runtime_error("Unable to create merge directory: " +
+                                     dir);
+        }
+        mMergeDir = dir;
+    }
+    return mMergeDir;
+}
+
 void
-BucketManagerImpl::forgetUnreferencedBuckets()
+BucketManagerImpl::dropPreviousMergeCheckpoints()
 {
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (!mPreviousMergeDir.empty())
+    {
+        CLOG(DEBUG, "Bucket") << "Deleting merge checkpoints not resumed in "
+                              << mPreviousMergeDir;
+        fs::deltree(mPreviousMergeDir);
+        mPreviousMergeDir.clear();
+    }
+}
 
+std::string
+BucketManagerImpl::acquireMergeCheckpointPath(Hash const& mergeKey)
+{
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
-    std::set<Hash> referenced;
-    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+    auto name = "merge-" + binToHex(mergeKey);
+    auto path = getMergeDir() + "/" + name;
+    if (!mActiveMergeCheckpoints.insert(path).second)
     {
-        auto const& level = mBucketList.getLevel(i);
-        referenced.insert(level.getCurr()->getHash());
-        referenced.insert(level.getSnap()->getHash());
-        for (auto const& h : level.getNext().getHashes())
+        return std::string();
+    }
+    if (!mPreviousMergeDir.empty())
+    {
+        for (auto const& ext : {".xdr", ".state"})
         {
-            referenced.insert(hexToBin256(h));
+            auto previous = mPreviousMergeDir + "/" + name + ext;
+            if (fs::exists(previous))
+            {
+                rename(previous.c_str(), (path + ext).c_str());
+            }
         }
     }
+    return path;
+}
+
+void
+BucketManagerImpl::releaseMergeCheckpointPath(std::string const& path)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    mActiveMergeCheckpoints.erase(path);
+}
 
-    // Implicitly retain any buckets that are referenced by a state in
-    // the publish queue.
-    auto pub = mApp.getHistoryManager().getBucketsReferencedByPublishQueue();
+std::string
+BucketManagerImpl::getMergeMemoFilename()
+{
+    return getBucketDir() + "/merge-memo.json";
+}
+
+void
+BucketManagerImpl::loadMergeMemo()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (mMergeMemoLoaded)
     {
-        for (auto const& h : pub)
+        return;
+    }
+    mMergeMemoLoaded = true;
+    auto filename = getMergeMemoFilename();
+    if (!fs::exists(filename))
+    {
+        return;
+    }
+    try
+    {
+        std::map<std::string, std::string> memo;
         {
-            CLOG(DEBUG, "Bucket")
-                << "BucketManager::forgetUnreferencedBuckets: " << h
-                << " referenced by publish queue";
-            referenced.insert(hexToBin256(h));
+            std::ifstream in(filename);
+            cereal::JSONInputArchive ar(in);
+            ar(cereal::make_nvp("merges", memo));
         }
+        for (auto const& m : memo)
+        {
+            auto key = hexToBin256(m.first);
+            auto output = hexToBin256(m.second);
+            mMergeMemo[key] = output;
+            mMergeMemoByOutput[output].insert(key);
+        }
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable merge memo "
+                                << filename << ": " << e.what();
+        mMergeMemo.clear();
+        mMergeMemoByOutput.clear();
     }
+}
 
-    for (auto i = mSharedBuckets.begin(); i != mSharedBuckets.end();)
+void
+BucketManagerImpl::saveMergeMemo()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (!mMergeMemoDirty)
     {
-        // Standard says map iterators other than the one you're erasing remain
-        // valid.
-        auto j = i;
+        return;
+    }
+
+    std::map<std::string, std::string> memo;
+    for (auto i = mMergeMemo.begin(); i != mMergeMemo.end();)
+    {
+        // only remember outputs that are still around
+        if (!isZero(i->second) && !isBucketAround(i->second))
+        {
+            i = eraseMergeMemo(i);
+            continue;
+        }
+        memo[binToHex(i->first)] = binToHex(i->second);
         ++i;
+    }
+
+    auto filename = getMergeMemoFilename();
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp);
+        cereal::JSONOutputArchive ar(out);
+        ar(cereal::make_nvp("merges", memo));
+    }
+#ifdef _WIN32
+    std::remove(filename.c_str());
+#endif
+    if (rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to save merge memo " << filename;
+        return;
+    }
+    mMergeMemoDirty = false;
+}
+
+std::map<Hash, Hash>::iterator
+BucketManagerImpl::eraseMergeMemo(std::map<Hash, Hash>::iterator i)
+{
+    auto o = mMergeMemoByOutput.find(i->second);
+    if (o != mMergeMemoByOutput.end())
+    {
+        o->second.erase(i->first);
+        if (o->second.empty())
+        {
+            mMergeMemoByOutput.erase(o);
+        }
+    }
+    mMergeMemoDirty = true;
+    return mMergeMemo.erase(i);
+}
+
+bool
+BucketManagerImpl::isBucketAround(Hash const& hash)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    return mSharedBuckets.find(hash) != mSharedBuckets.end() ||
+           fs::exists(bucketFilename(hash));
+}
+
+namespace
+{
+// BucketStats as saved in the bucket directory
+struct SavedBucketStats
+{
+    std::map<int32_t, uint64_t> mLiveEntries;
+    std::map<int32_t, uint64_t> mDeadEntries;
+    uint64_t mBytes{0};
+    uint64_t mShadowed{0};
+    uint64_t mDeadElided{0};
+    uint64_t mBytesReclaimed{0};
+    uint64_t mMergeNanoseconds{0};
+
+    template <class Archive>
+    void
+    serialize(Archive& ar)
+    {
+        ar(cereal::make_nvp("live", mLiveEntries),
+           cereal::make_nvp("dead", mDeadEntries),
+           cereal::make_nvp("bytes", mBytes),
+           cereal::make_nvp("shadowed", mShadowed),
+           cereal::make_nvp("deadElided", mDeadElided),
+           cereal::make_nvp("bytesReclaimed", mBytesReclaimed),
+           cereal::make_nvp("mergeNanoseconds", mMergeNanoseconds));
+    }
+};
+
+std::map<int32_t, uint64_t>
+toSavedCounts(std::map<LedgerEntryType, uint64_t> const& counts)
+{
+    std::map<int32_t, uint64_t> res;
+    for (auto const& c : counts)
+    {
+        res[static_cast<int32_t>(c.first)] = c.second;
+    }
+    return res;
+}
+
+std::map<LedgerEntryType, uint64_t>
+fromSavedCounts(std::map<int32_t, uint64_t> const& counts)
+{
+    std::map<LedgerEntryType, uint64_t> res;
+    for (auto const& c : counts)
+    {
+        res[static_cast<LedgerEntryType>(c.first)] = c.second;
+    }
+    return res;
+}
+}
+
+std::string
+BucketManagerImpl::getBucketStatsFilename()
+{
+    return getBucketDir() + "/bucket-stats.json";
+}
+
+void
+BucketManagerImpl::loadBucketStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (mBucketStatsLoaded)
+    {
+        return;
+    }
+    mBucketStatsLoaded = true;
+    auto filename = getBucketStatsFilename();
+    if (!fs::exists(filename))
+    {
+        return;
+    }
+    try
+    {
+        std::map<std::string, SavedBucketStats> saved;
+        {
+            std::ifstream in(filename);
+            cereal::JSONInputArchive ar(in);
+            ar(cereal::make_nvp("buckets", saved));
+        }
+        for (auto const& s : saved)
+        {
+            BucketStats stats;
+            stats.mLiveEntries = fromSavedCounts(s.second.mLiveEntries);
+            stats.mDeadEntries = fromSavedCounts(s.second.mDeadEntries);
+            stats.mBytes = s.second.mBytes;
+            stats.mShadowed = s.second.mShadowed;
+            stats.mDeadElided = s.second.mDeadElided;
+            stats.mBytesReclaimed = s.second.mBytesReclaimed;
+            stats.mMergeDuration =
+                std::chrono::nanoseconds(s.second.mMergeNanoseconds);
+            // stats recorded since startup describe the same buckets
+            mBucketStats.insert(std::make_pair(hexToBin256(s.first), stats));
+        }
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring unreadable bucket stats "
+                                << filename << ": " << e.what();
+    }
+}
+
+void
+BucketManagerImpl::saveBucketStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    if (!mBucketStatsDirty)
+    {
+        return;
+    }
+
+    std::map<std::string, SavedBucketStats> saved;
+    for (auto i = mBucketStats.begin(); i != mBucketStats.end();)
+    {
+        // only remember buckets that are still around
+        if (!isBucketAround(i->first))
+        {
+            i = mBucketStats.erase(i);
+            continue;
+        }
+        auto& s = saved[binToHex(i->first)];
+        s.mLiveEntries = toSavedCounts(i->second.mLiveEntries);
+        s.mDeadEntries = toSavedCounts(i->second.mDeadEntries);
+        s.mBytes = i->second.mBytes;
+        s.mShadowed = i->second.mShadowed;
+        s.mDeadElided = i->second.mDeadElided;
+        s.mBytesReclaimed = i->second.mBytesReclaimed;
+        s.mMergeNanoseconds = i->second.mMergeDuration.count();
+        ++i;
+    }
+
+    auto filename = getBucketStatsFilename();
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp);
+        cereal::JSONOutputArchive ar(out);
+        ar(cereal::make_nvp("buckets", saved));
+    }
+#ifdef _WIN32
+    std::remove(filename.c_str());
+#endif
+    if (rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to save bucket stats " << filename;
+        return;
+    }
+    mBucketStatsDirty = false;
+}
+
+void
+BucketManagerImpl::saveMergeState()
+{
+    saveMergeMemo();
+    saveBucketStats();
+}
+
+std::shared_ptr<Bucket>
+BucketManagerImpl::getMergeOutput(Hash const& mergeKey)
+{
+    loadMergeMemo();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto i = mMergeMemo.find(mergeKey);
+    if (i != mMergeMemo.end())
+    {
+        auto b = getBucketByHash(i->second);
+        if (b)
+        {
+            CLOG(DEBUG, "Bucket") << "Reusing output "
+                                  << hexAbbrev(i->second) << " of merge "
+                                  << hexAbbrev(mergeKey);
+            mMergeMemoHit.Mark();
+            return b;
+        }
+        eraseMergeMemo(i);
+    }
+    mMergeMemoMiss.Mark();
+    return nullptr;
+}
+
+void
+BucketManagerImpl::recordMergeOutput(Hash const& mergeKey, Hash const& output)
+{
+    loadMergeMemo();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto i = mMergeMemo.find(mergeKey);
+    if (i != mMergeMemo.end())
+    {
+        eraseMergeMemo(i);
+    }
+    mMergeMemo[mergeKey] = output;
+    mMergeMemoByOutput[output].insert(mergeKey);
+    mMergeMemoDirty = true;
+}
+
+void
+BucketManagerImpl::recordBucketStats(Hash const& hash,
+                                     BucketStats const& stats)
+{
+    mMergeShadowed.Mark(stats.mShadowed);
+    mMergeDeadElided.Mark(stats.mDeadElided);
+    mMergeBytesReclaimed.Mark(stats.mBytesReclaimed);
+    if (isZero(hash))
+    {
+        return;
+    }
+    loadBucketStats();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    // the first merge producing a bucket describes it, a bucket dropped
+    // meanwhile has no stats
+    if (mSharedBuckets.find(hash) != mSharedBuckets.end() &&
+        mBucketStats.insert(std::make_pair(hash, stats)).second)
+    {
+        mBucketStatsDirty = true;
+    }
+}
+
+bool
+BucketManagerImpl::getBucketStats(Hash const& hash, BucketStats& stats)
+{
+    loadBucketStats();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    auto i = mBucketStats.find(hash);
+    if (i == mBucketStats.end())
+    {
+        return false;
+    }
+    stats = i->second;
+    return true;
+}
+
+static Json::Value
+countsByType(std::map<LedgerEntryType, uint64_t> const& counts)
+{
+    Json::Value ret(Json::objectValue);
+    for (auto const& c : counts)
+    {
+        auto name = xdr::xdr_traits<LedgerEntryType>::enum_name(c.first);
+        ret[name ? name : std::to_string(c.first)] =
+            static_cast<Json::UInt64>(c.second);
+    }
+    return ret;
+}
+
+void
+BucketManagerImpl::dumpBucketStats(std::shared_ptr<Bucket> const& b,
+                                   Json::Value& ret)
+{
+    ret["hash"] = binToHex(b->getHash());
+    if (b->getFilename().empty())
+    {
+        ret["bytes"] = 0;
+        return;
+    }
+    {
+        std::ifstream in(b->getFilename(),
+                         std::ifstream::ate | std::ifstream::binary);
+        ret["bytes"] = static_cast<Json::UInt64>(in.tellg());
+    }
+
+    BucketStats stats;
+    if (!getBucketStats(b->getHash(), stats))
+    {
+        return;
+    }
+    auto live = stats.countLive();
+    auto dead = stats.countDead();
+    ret["live"] = countsByType(stats.mLiveEntries);
+    ret["dead"] = countsByType(stats.mDeadEntries);
+    ret["dead_ratio"] =
+        live + dead == 0 ? 0.0 : static_cast<double>(dead) / (live + dead);
+    ret["shadowed"] = static_cast<Json::UInt64>(stats.mShadowed);
+    ret["tombstones_elided"] = static_cast<Json::UInt64>(stats.mDeadElided);
+    ret["bytes_reclaimed"] = static_cast<Json::UInt64>(stats.mBytesReclaimed);
+    ret["merge_ms"] = static_cast<Json::UInt64>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            stats.mMergeDuration)
+            .count());
+}
+
+void
+BucketManagerImpl::dumpStats(Json::Value& ret)
+{
+    auto& levels = ret["levels"];
+    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto& level = mBucketList.getLevel(i);
+        auto& l = levels[static_cast<Json::UInt>(i)];
+        dumpBucketStats(level.getCurr(), l["curr"]);
+        dumpBucketStats(level.getSnap(), l["snap"]);
+        auto const& next = level.getNext();
+        l["next"] = !next.isLive()
+                        ? "none"
+                        : (next.mergeComplete() ? "merged" : "merging");
+    }
+}
+
+void
+BucketManagerImpl::loadPublishQueueReferences()
+{
+    if (mPublishQueueReferencesLoaded)
+    {
+        return;
+    }
+    auto states = mApp.getHistoryManager().getPublishQueueStates();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& has : states)
+    {
+        for (auto const& h : has.allBuckets())
+        {
+            ++mPublishQueueReferences[hexToBin256(h)];
+        }
+    }
+    mPublishQueueReferencesLoaded = true;
+}
+
+void
+BucketManagerImpl::addPublishQueueReferences(HistoryArchiveState const& has)
+{
+    loadPublishQueueReferences();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& h : has.allBuckets())
+    {
+        ++mPublishQueueReferences[hexToBin256(h)];
+    }
+}
+
+void
+BucketManagerImpl::removePublishQueueReferences(HistoryArchiveState const& has)
+{
+    loadPublishQueueReferences();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& h : has.allBuckets())
+    {
+        auto hash = hexToBin256(h);
+        auto i = mPublishQueueReferences.find(hash);
+        if (i != mPublishQueueReferences.end() && --i->second == 0)
+        {
+            mPublishQueueReferences.erase(i);
+            mGCCandidates.insert(hash);
+        }
+    }
+    mGCCandidatesSize.set_count(mGCCandidates.size());
+}
+
+void
+BucketManagerImpl::forgetUnreferencedBuckets()
+{
+    loadPublishQueueReferences();
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+
+    std::vector<std::string> toDelete;
+    for (auto i = mGCCandidates.begin(); i != mGCCandidates.end();)
+    {
+        auto j = mSharedBuckets.find(*i);
+        if (j == mSharedBuckets.end())
+        {
+            i = mGCCandidates.erase(i);
+            continue;
+        }
+
+        // Implicitly retain any buckets that are referenced by a state in
+        // the publish queue; they become candidates again once it's
+        // published.
+        if (mPublishQueueReferences.find(*i) != mPublishQueueReferences.end())
+        {
+            CLOG(DEBUG, "Bucket")
+                << "BucketManager::forgetUnreferencedBuckets: "
+                << binToHex(*i) << " referenced by publish queue";
+            i = mGCCandidates.erase(i);
+            continue;
+        }
 
         // Only drop buckets if the bucketlist has forgotten them _and_
         // no other in-progress structures (worker threads, shadow lists)
         // have references to them, just us. It's ok to retain a few too
-        // many buckets, a little longer than necessary.
+        // many buckets, a little longer than necessary: the ones still in
+        // use stay candidates until a later call.
         //
         // This conservatism is important because we want to enforce that only
         // one bucket ever exists in memory with a given filename, and that
         // we're the first and last to know about it. Otherwise buckets might
         // race on deleting the underlying file from one another.
+        if (j->second.use_count() != 1)
+        {
+            ++i;
+            continue;
+        }
 
-        if (referenced.find(j->first) == referenced.end() &&
-            j->second.use_count() == 1)
+        auto const& filename = j->second->getFilename();
+        CLOG(TRACE, "Bucket")
+            << "BucketManager::forgetUnreferencedBuckets dropping "
+            << filename;
+        // Move the file out of the bucket directory right away, so that
+        // a bucket with the same hash can be adopted again, and leave the
+        // (potentially slow) deletion of large files to a worker.
+        std::string garbage = getTmpDir() + "/gc-" + binToHex(j->first) + ".xdr";
+        if (!filename.empty() && rename(filename.c_str(), garbage.c_str()) == 0)
         {
-            CLOG(TRACE, "Bucket")
-                << "BucketManager::forgetUnreferencedBuckets dropping "
-                << j->second->getFilename();
-            j->second->setRetain(false);
-            mSharedBuckets.erase(j);
+            j->second->setRetain(true);
+            toDelete.emplace_back(garbage);
         }
         else
         {
-            j->second->setRetain(true);
+            j->second->setRetain(false);
+        }
+        mBucketStatsDirty =
+            mBucketStats.erase(j->first) != 0 || mBucketStatsDirty;
+        auto o = mMergeMemoByOutput.find(j->first);
+        if (o != mMergeMemoByOutput.end())
+        {
+            for (auto const& key : o->second)
+            {
+                mMergeMemo.erase(key);
+            }
+            mMergeMemoByOutput.erase(o);
+            mMergeMemoDirty = true;
         }
+        mSharedBuckets.erase(j);
+        mGCDropped.Mark();
+        i = mGCCandidates.erase(i);
     }
     mSharedBucketsSize.set_count(mSharedBuckets.size());
+    mGCCandidatesSize.set_count(mGCCandidates.size());
+
+    if (!toDelete.empty())
+    {
+        mApp.getWorkerIOService().post([toDelete]() {
+            for (auto const& f : toDelete)
+            {
+                std::remove(f.c_str());
+            }
+        });
+    }
 }
 
 void
@@ -282,7 +876,49 @@ BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
                             std::vector<LedgerKey> const& deadEntries)
 {
     auto timer = mBucketAddBatch.TimeScope();
+
+    // Only level 0 and the levels spilling at currLedger (with the level
+    // above each of them) change their curr and snap: the buckets they drop
+    // may now be unreferenced, the ones they take (merge outputs) are
+    // referenced by the BucketList.
+    std::set<size_t> levels{0};
+    for (size_t i = 1; i < BucketList::kNumLevels; ++i)
+    {
+        if (BucketList::levelShouldSpill(currLedger, i - 1))
+        {
+            levels.insert(i - 1);
+            levels.insert(i);
+        }
+    }
+    std::vector<std::shared_ptr<Bucket>> before;
+    for (auto i : levels)
+    {
+        before.push_back(mBucketList.getLevel(i).getCurr());
+        before.push_back(mBucketList.getLevel(i).getSnap());
+    }
+
     mBucketList.addBatch(app, currLedger, liveEntries, deadEntries);
+
+    std::set<Hash> after;
+    for (auto i : levels)
+    {
+        after.insert(mBucketList.getLevel(i).getCurr()->getHash());
+        after.insert(mBucketList.getLevel(i).getSnap()->getHash());
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& b : before)
+    {
+        if (after.find(b->getHash()) == after.end())
+        {
+            mGCCandidates.insert(b->getHash());
+        }
+    }
+    for (auto const& h : after)
+    {
+        mGCCandidates.erase(h);
+    }
+    mGCCandidatesSize.set_count(mGCCandidates.size());
 }
 
 // updates the given LedgerHeader to reflect the current state of the bucket
@@ -337,6 +973,21 @@ BucketManagerImpl::checkForMissingBucketsFiles(HistoryArchiveState const& has)
 void
 BucketManagerImpl::assumeState(HistoryArchiveState const& has)
 {
+    {
+        // Everything the BucketList referenced may now be unreferenced.
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+        for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+        {
+            auto const& level = mBucketList.getLevel(i);
+            mGCCandidates.insert(level.getCurr()->getHash());
+            mGCCandidates.insert(level.getSnap()->getHash());
+            for (auto const& h : level.getNext().getHashes())
+            {
+                mGCCandidates.insert(hexToBin256(h));
+            }
+        }
+    }
+
     for (size_t i = 0; i < BucketList::kNumLevels; ++i)
     {
         auto curr = getBucketByHash(hexToBin256(has.currentBuckets.at(i).curr));
@@ -349,7 +1000,15 @@ BucketManagerImpl::assumeState(HistoryArchiveState const& has)
         mBucketList.getLevel(i).setCurr(curr);
         mBucketList.getLevel(i).setSnap(snap);
         mBucketList.getLevel(i).setNext(has.currentBuckets.at(i).next);
+
+        std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+        mGCCandidates.erase(curr->getHash());
+        mGCCandidates.erase(snap->getHash());
     }
     mBucketList.restartMerges(mApp, has.currentLedger);
+    dropPreviousMergeCheckpoints();
+
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    mGCCandidatesSize.set_count(mGCCandidates.size());
 }
 }
@@ -7,6 +7,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 
 // Copyright 2015 Stellar Development Foundation and contributors. Licensed
@@ -43,8 +44,63 @@ class BucketManagerImpl : public BucketManager
     medida::Meter& mBucketByteInsert;
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
+    medida::Meter& mBucketMergeResumed;
     medida::Counter& mSharedBucketsSize;
 
+    // Number of states in the publish queue referencing each bucket, loaded
+    // from the database on first use and then kept up to date by the
+    // HistoryManager.
+    std::map<Hash, uint32_t> mPublishQueueReferences;
+    bool mPublishQueueReferencesLoaded;
+
+    // Buckets that may have lost their last reference since the last
+    // forgetUnreferencedBuckets.
+    std::set<Hash> mGCCandidates;
+    medida::Counter& mGCCandidatesSize;
+    medida::Meter& mGCDropped;
+
+    void loadPublishQueueReferences();
+
+    // Checkpoints of the merges in progress live in the "merges" directory of
+    // the bucket directory; on startup the ones of the previous run are moved
+    // aside, the merges restarted take theirs back, and the rest is deleted.
+    std::string mMergeDir;
+    std::string mPreviousMergeDir;
+    std::set<std::string> mActiveMergeCheckpoints;
+    std::string const& getMergeDir();
+    void dropPreviousMergeCheckpoints();
+
+    // Output bucket of the merges done so far, by merge key; saved to the
+    // bucket directory by saveMergeState, when changed. The merges of each
+    // output are indexed, so that forgetUnreferencedBuckets forgets the
+    // outputs it drops directly.
+    std::map<Hash, Hash> mMergeMemo;
+    std::map<Hash, std::set<Hash>> mMergeMemoByOutput;
+    bool mMergeMemoLoaded;
+    bool mMergeMemoDirty;
+    medida::Meter& mMergeMemoHit;
+    medida::Meter& mMergeMemoMiss;
+    std::string getMergeMemoFilename();
+    void loadMergeMemo();
+    void saveMergeMemo();
+    std::map<Hash, Hash>::iterator
+    eraseMergeMemo(std::map<Hash, Hash>::iterator i);
+    // whether the bucket with this hash is loaded or in the bucket directory
+    bool isBucketAround(Hash const& hash);
+
+    // Stats of the buckets merged, saved next to the merge memo, at the same
+    // times and forgetting the same (dropped) buckets.
+    std::map<Hash, BucketStats> mBucketStats;
+    bool mBucketStatsLoaded;
+    bool mBucketStatsDirty;
+    std::string getBucketStatsFilename();
+    void loadBucketStats();
+    void saveBucketStats();
+    medida::Meter& mMergeShadowed;
+    medida::Meter& mMergeDeadElided;
+    medida::Meter& mMergeBytesReclaimed;
+    void dumpBucketStats(std::shared_ptr<Bucket> const& b, Json::Value& ret);
+
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
     std::string bucketFilename(std::string const& bucketHexHash);
@@ -57,13 +113,24 @@ class BucketManagerImpl : public BucketManager
     std::string const& getBucketDir() override;
     BucketList& getBucketList() override;
     medida::Timer& getMergeTimer() override;
+    medida::Meter& getMergeResumedMeter() override;
     std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
                                               uint256 const& hash,
                                               size_t nObjects,
                                               size_t nBytes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
+    std::string acquireMergeCheckpointPath(Hash const& mergeKey) override;
+    void releaseMergeCheckpointPath(std::string const& path) override;
+    std::shared_ptr<Bucket> getMergeOutput(Hash const& mergeKey) override;
+    void recordMergeOutput(Hash const& mergeKey, Hash const& output) override;
+    void recordBucketStats(Hash const& hash, BucketStats const& stats) override;
+    bool getBucketStats(Hash const& hash, BucketStats& stats) override;
+    void dumpStats(Json::Value& ret) override;
+    void saveMergeState() override;
 
     void forgetUnreferencedBuckets() override;
+    void addPublishQueueReferences(HistoryArchiveState const& has) override;
+    void removePublishQueueReferences(HistoryArchiveState const& has) override;
     void addBatch(Application& app, uint32_t currLedger,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries) override;
@@ -15,10 +15,14 @@
 #include "crypto/Hex.h"
 #include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
+#include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
@@ -30,6 +34,8 @@
 #include "util/types.h"
 #include "xdrpp/autocheck.h"
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <future>
 
 using namespace stellar;
@@ -397,6 +403,46 @@ TEST_CASE("bucket tombstones expire at bottom level", "[bucket][tombstones]")
     REQUIRE(pair2.second == 0);
 }
 
+TEST_CASE("bucket tombstone elision is accounted", "[bucket][tombstones]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto oldLive = LedgerTestUtils::generateValidLedgerEntries(50);
+    auto newLive = LedgerTestUtils::generateValidLedgerEntries(50);
+    std::vector<LedgerKey> oldDead, newDead;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        oldDead.push_back(LedgerEntryKey(
+            LedgerTestUtils::generateValidLedgerEntry(10)));
+        newDead.push_back(LedgerEntryKey(
+            LedgerTestUtils::generateValidLedgerEntry(10)));
+    }
+    auto oldBucket = Bucket::fresh(bm, oldLive, oldDead);
+    auto newBucket = Bucket::fresh(bm, newLive, newDead);
+
+    auto kept = Bucket::merge(bm, oldBucket, newBucket);
+    auto elided = Bucket::merge(bm, oldBucket, newBucket, {}, false);
+
+    BucketStats keptStats, elidedStats;
+    REQUIRE(bm.getBucketStats(kept->getHash(), keptStats));
+    REQUIRE(bm.getBucketStats(elided->getHash(), elidedStats));
+    REQUIRE(keptStats.countDead() == 40);
+    REQUIRE(keptStats.mDeadElided == 0);
+    REQUIRE(elidedStats.countDead() == 0);
+    REQUIRE(elidedStats.mDeadElided == 40);
+    REQUIRE(elidedStats.mBytesReclaimed ==
+            keptStats.mBytes - elidedStats.mBytes);
+
+    // the live entries are written exactly as without tombstones
+    std::vector<LedgerEntry> live(oldLive);
+    live.insert(live.end(), newLive.begin(), newLive.end());
+    std::vector<LedgerKey> noDead;
+    REQUIRE(elided->getHash() == Bucket::fresh(bm, live, noDead)->getHash());
+}
+
 TEST_CASE("file-backed buckets", "[bucket][bucketbench]")
 {
     VirtualClock clock;
@@ -536,18 +582,10 @@ TEST_CASE("merging bucket entries", "[bucket]")
 }
 
 static void
-clearFutures(Application::pointer app, BucketList& bl)
+waitForWorkers(Application::pointer app)
 {
-
-    // First go through the BL and mop up all the FutureBuckets.
-    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
-    {
-        bl.getLevel(i).getNext().clear();
-    }
-
-    // Then go through all the _worker threads_ and mop up any work they
-    // might still be doing (that might be "dropping a shared_ptr<Bucket>").
-
+    // Go through all the _worker threads_ and mop up any work they might
+    // still be doing (that might be "dropping a shared_ptr<Bucket>").
     size_t n = std::thread::hardware_concurrency();
     std::mutex mutex;
     std::condition_variable cv, cv2;
@@ -574,6 +612,280 @@ clearFutures(Application::pointer app, BucketList& bl)
     }
 }
 
+static void
+clearFutures(Application::pointer app, BucketList& bl)
+{
+
+    // First go through the BL and mop up all the FutureBuckets.
+    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        bl.getLevel(i).getNext().clear();
+    }
+
+    // Then wait for the workers to drop what they hold.
+    waitForWorkers(app);
+}
+
+TEST_CASE("merge resumes from checkpoint", "[bucket][mergecheckpoint]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto makeBucket = [&bm](size_t n) -> std::shared_ptr<Bucket> {
+        std::vector<LedgerEntry> live(n);
+        std::vector<LedgerKey> dead;
+        for (auto& e : live)
+        {
+            e = LedgerTestUtils::generateValidLedgerEntry(10);
+        }
+        return Bucket::fresh(bm, live, dead);
+    };
+    auto oldBucket = makeBucket(1000);
+    auto newBucket = makeBucket(1000);
+    std::vector<std::shared_ptr<Bucket>> shadows{makeBucket(200)};
+    auto expected =
+        Bucket::merge(bm, oldBucket, newBucket, shadows)->getHash();
+    // drop the output, so that the merges below are not satisfied by it
+    bm.forgetUnreferencedBuckets();
+
+    TmpDir dir = app->getTmpDirManager().tmpDir("merge-checkpoint");
+    uint64_t const interval = 4096;
+
+    size_t fullCount = 0;
+    Bucket::MergeCheckpointing full{dir.getName() + "/full", interval,
+                                    [&fullCount]() { ++fullCount; }};
+    auto b = Bucket::merge(bm, oldBucket, newBucket, shadows, true, &full);
+    REQUIRE(b->getHash() == expected);
+    REQUIRE(fullCount > 3);
+    b.reset();
+    bm.forgetUnreferencedBuckets();
+
+    // stop the merge on its third checkpoint, as a crash would
+    auto path = dir.getName() + "/merge";
+    size_t count = 0;
+    Bucket::MergeCheckpointing interrupted{path, interval, [&count]() {
+                                               if (++count == 3)
+                                               {
+                                                   throw std::runtime_error(
+                                                       "interrupted");
+                                               }
+                                           }};
+    REQUIRE_THROWS(
+        Bucket::merge(bm, oldBucket, newBucket, shadows, true, &interrupted));
+    REQUIRE(fs::exists(path + ".state"));
+
+    count = 0;
+    Bucket::MergeCheckpointing resumed{path, interval,
+                                       [&count]() { ++count; }};
+    b = Bucket::merge(bm, oldBucket, newBucket, shadows, true, &resumed);
+    REQUIRE(b->getHash() == expected);
+    REQUIRE(count == fullCount - 3);
+    REQUIRE(!fs::exists(path + ".state"));
+
+    // while the output is around, a merge left unfinished is not resumed but
+    // reuses it, dropping its checkpoint and partial output
+    auto unfinished = dir.getName() + "/unfinished";
+    {
+        std::ofstream out(unfinished + ".xdr");
+        out << "partial output";
+    }
+    {
+        std::ofstream out(unfinished + ".state");
+        out << "checkpoint";
+    }
+    Bucket::MergeCheckpointing reused{unfinished, interval, nullptr};
+    REQUIRE(Bucket::merge(bm, oldBucket, newBucket, shadows, true, &reused) ==
+            b);
+    REQUIRE(!fs::exists(unfinished + ".xdr"));
+    REQUIRE(!fs::exists(unfinished + ".state"));
+}
+
+TEST_CASE("merge outputs are reused", "[bucket][mergememo]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+
+    std::vector<LedgerKey> dead;
+    Hash oldHash, newHash, outputHash;
+    {
+        Application::pointer app = Application::create(clock, cfg);
+        auto& bm = app->getBucketManager();
+        auto& hit = app->getMetrics().NewMeter(
+            {"bucket", "merge-memo", "hit"}, "merge");
+        auto& miss = app->getMetrics().NewMeter(
+            {"bucket", "merge-memo", "miss"}, "merge");
+
+        auto oldBucket = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        auto newBucket = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        oldHash = oldBucket->getHash();
+        newHash = newBucket->getHash();
+        auto hits = hit.count();
+        auto misses = miss.count();
+
+        auto b1 = Bucket::merge(bm, oldBucket, newBucket);
+        REQUIRE(miss.count() == misses + 1);
+        auto b2 = Bucket::merge(bm, oldBucket, newBucket);
+        REQUIRE(hit.count() == hits + 1);
+        REQUIRE(b2 == b1);
+        outputHash = b1->getHash();
+
+        // any difference in the inputs is another merge
+        Bucket::merge(bm, newBucket, oldBucket);
+        REQUIRE(miss.count() == misses + 2);
+        Bucket::merge(bm, oldBucket, newBucket, {}, false);
+        REQUIRE(miss.count() == misses + 3);
+
+        // a dropped output is merged again
+        auto otherBucket = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        misses = miss.count();
+        auto b3 = Bucket::merge(bm, oldBucket, otherBucket);
+        REQUIRE(miss.count() == misses + 1);
+        b3.reset();
+        bm.forgetUnreferencedBuckets();
+        b3 = Bucket::merge(bm, oldBucket, otherBucket);
+        REQUIRE(miss.count() == misses + 2);
+
+        // the memo is only saved when asked to, not by GC passes
+        auto memoFile = bm.getBucketDir() + "/merge-memo.json";
+        REQUIRE(!fs::exists(memoFile));
+        bm.saveMergeState();
+        REQUIRE(fs::exists(memoFile));
+
+        // dropping a bucket only changes the memo if it is a merge output
+        std::remove(memoFile.c_str());
+        Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(10),
+                      dead);
+        bm.forgetUnreferencedBuckets();
+        bm.saveMergeState();
+        REQUIRE(!fs::exists(memoFile));
+        b3.reset();
+        bm.forgetUnreferencedBuckets();
+        bm.saveMergeState();
+        REQUIRE(fs::exists(memoFile));
+    }
+
+    // the memo survives a restart, along with the buckets
+    {
+        Application::pointer app = Application::create(clock, cfg, false);
+        auto& bm = app->getBucketManager();
+        auto& hit = app->getMetrics().NewMeter(
+            {"bucket", "merge-memo", "hit"}, "merge");
+        auto oldBucket = bm.getBucketByHash(oldHash);
+        auto newBucket = bm.getBucketByHash(newHash);
+        REQUIRE(oldBucket);
+        REQUIRE(newBucket);
+        auto hits = hit.count();
+        auto b = Bucket::merge(bm, oldBucket, newBucket);
+        REQUIRE(hit.count() == hits + 1);
+        REQUIRE(b->getHash() == outputHash);
+    }
+}
+
+TEST_CASE("bucket stats are accounted while merging", "[bucket][bucketstats]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(100);
+    std::vector<LedgerKey> dead;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        dead.push_back(LedgerEntryKey(
+            LedgerTestUtils::generateValidLedgerEntry(10)));
+    }
+    // a quarter of the live entries are shadowed
+    std::vector<LedgerEntry> shadowed(live.begin(), live.begin() + 25);
+    std::vector<LedgerKey> noDead;
+
+    auto b1 = Bucket::fresh(bm, live, dead);
+    auto newLive = LedgerTestUtils::generateValidLedgerEntries(50);
+    auto b2 = Bucket::fresh(bm, newLive, noDead);
+    std::vector<std::shared_ptr<Bucket>> shadows{
+        Bucket::fresh(bm, shadowed, noDead)};
+    auto merged = Bucket::merge(bm, b1, b2, shadows);
+
+    BucketStats stats;
+    REQUIRE(bm.getBucketStats(merged->getHash(), stats));
+    auto counts = merged->countLiveAndDeadEntries();
+    REQUIRE(stats.countLive() == counts.first);
+    REQUIRE(stats.countDead() == counts.second);
+    REQUIRE(stats.mShadowed == 25);
+    REQUIRE(stats.mBytes == static_cast<uint64_t>(
+                                fileSize(merged->getFilename())));
+    std::map<LedgerEntryType, uint64_t> expected;
+    for (size_t i = shadowed.size(); i < live.size(); ++i)
+    {
+        ++expected[live[i].data.type()];
+    }
+    for (auto const& e : newLive)
+    {
+        ++expected[e.data.type()];
+    }
+    REQUIRE(stats.mLiveEntries == expected);
+
+    auto& bl = bm.getBucketList();
+    bl.addBatch(*app, 1, live, noDead);
+    clearFutures(app, bl);
+    Json::Value ret;
+    bm.dumpStats(ret);
+    REQUIRE(ret["levels"].size() == BucketList::kNumLevels);
+    REQUIRE(ret["levels"][0]["curr"]["hash"].asString() ==
+            binToHex(bl.getLevel(0).getCurr()->getHash()));
+    REQUIRE(ret["levels"][0]["curr"]["live"].isObject());
+}
+
+TEST_CASE("bucket stats survive a restart", "[bucket][bucketstats]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+
+    std::vector<LedgerKey> dead;
+    Hash keptHash, droppedHash;
+    BucketStats kept;
+    {
+        Application::pointer app = Application::create(clock, cfg);
+        auto& bm = app->getBucketManager();
+        auto b1 = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        auto b2 = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        auto b3 = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(100), dead);
+        auto keptBucket = Bucket::merge(bm, b1, b2);
+        auto droppedBucket = Bucket::merge(bm, b1, b3);
+        keptHash = keptBucket->getHash();
+        droppedHash = droppedBucket->getHash();
+        REQUIRE(bm.getBucketStats(keptHash, kept));
+        BucketStats stats;
+        REQUIRE(bm.getBucketStats(droppedHash, stats));
+
+        droppedBucket.reset();
+        bm.forgetUnreferencedBuckets();
+        REQUIRE(!bm.getBucketStats(droppedHash, stats));
+    }
+
+    {
+        Application::pointer app = Application::create(clock, cfg, false);
+        auto& bm = app->getBucketManager();
+        REQUIRE(bm.getBucketByHash(keptHash));
+        BucketStats stats;
+        REQUIRE(bm.getBucketStats(keptHash, stats));
+        REQUIRE(stats.mLiveEntries == kept.mLiveEntries);
+        REQUIRE(stats.mDeadEntries == kept.mDeadEntries);
+        REQUIRE(stats.mBytes == kept.mBytes);
+        REQUIRE(stats.mShadowed == kept.mShadowed);
+        REQUIRE(stats.mMergeDuration == kept.mMergeDuration);
+        REQUIRE(!bm.getBucketStats(droppedHash, stats));
+    }
+}
+
 TEST_CASE("bucketmanager ownership", "[bucket]")
 {
     VirtualClock clock;
@@ -641,6 +953,277 @@ TEST_CASE("bucketmanager ownership", "[bucket]")
     CHECK(!fs::exists(filename));
 }
 
+// Wait for the merges of `bl` to be done, and for their inputs to be
+// released.
+static void
+resolveMerges(Application::pointer app, BucketList& bl)
+{
+    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto& next = bl.getLevel(i).getNext();
+        if (next.isMerging())
+        {
+            next.resolve();
+        }
+    }
+    waitForWorkers(app);
+}
+
+static std::set<Hash>
+referencedBuckets(BucketList& bl)
+{
+    std::set<Hash> hashes;
+    for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto const& level = bl.getLevel(i);
+        for (auto const& b : {level.getCurr(), level.getSnap()})
+        {
+            if (!isZero(b->getHash()))
+            {
+                hashes.insert(b->getHash());
+            }
+        }
+    }
+    return hashes;
+}
+
+TEST_CASE("bucket files are dropped once they leave the bucketlist",
+          "[bucket][bucketgc]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& bl = bm.getBucketList();
+    auto& candidates =
+        app->getMetrics().NewCounter({"bucket", "gc", "candidates"});
+    auto& dropped =
+        app->getMetrics().NewMeter({"bucket", "gc", "dropped"}, "bucket");
+
+    std::vector<LedgerKey> noDead;
+    std::map<Hash, std::string> filenames;
+    std::vector<Hash> droppedHashes;
+    for (uint32_t ledger = 1; ledger <= 40; ++ledger)
+    {
+        bm.addBatch(*app, ledger,
+                    LedgerTestUtils::generateValidLedgerEntries(5), noDead);
+        resolveMerges(app, bl);
+
+        auto referenced = referencedBuckets(bl);
+        std::vector<Hash> left;
+        for (auto const& f : filenames)
+        {
+            if (referenced.find(f.first) == referenced.end())
+            {
+                left.push_back(f.first);
+            }
+        }
+        for (auto const& h : referenced)
+        {
+            filenames[h] = bm.getBucketByHash(h)->getFilename();
+        }
+        REQUIRE(candidates.count() >= static_cast<int64_t>(left.size()));
+
+        auto droppedBefore = dropped.count();
+        bm.forgetUnreferencedBuckets();
+        for (auto const& h : referenced)
+        {
+            REQUIRE(fs::exists(filenames[h]));
+        }
+        for (auto const& h : left)
+        {
+            REQUIRE(!fs::exists(filenames[h]));
+            REQUIRE(!bm.getBucketByHash(h));
+            filenames.erase(h);
+            droppedHashes.push_back(h);
+        }
+        REQUIRE(dropped.count() >= droppedBefore + left.size());
+
+        // Nothing else goes until the BucketList changes again.
+        droppedBefore = dropped.count();
+        auto candidatesBefore = candidates.count();
+        bm.forgetUnreferencedBuckets();
+        REQUIRE(dropped.count() == droppedBefore);
+        REQUIRE(candidates.count() == candidatesBefore);
+    }
+    REQUIRE(!droppedHashes.empty());
+
+    // The dropped files are deleted from the tmp dir by the workers.
+    waitForWorkers(app);
+    for (auto const& h : droppedHashes)
+    {
+        REQUIRE(!fs::exists(bm.getTmpDir() + "/gc-" + binToHex(h) + ".xdr"));
+    }
+}
+
+TEST_CASE("bucket references are rebuilt by assumeState", "[bucket][bucketgc]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& bl = bm.getBucketList();
+    auto& candidates =
+        app->getMetrics().NewCounter({"bucket", "gc", "candidates"});
+
+    std::vector<LedgerKey> noDead;
+    uint32_t ledger = 1;
+    for (; ledger <= 16; ++ledger)
+    {
+        bm.addBatch(*app, ledger,
+                    LedgerTestUtils::generateValidLedgerEntries(5), noDead);
+    }
+    resolveMerges(app, bl);
+    // As loaded from the database: the merges only known by their hashes.
+    HistoryArchiveState has;
+    has.fromString(HistoryArchiveState(ledger - 1, bl).toString());
+    auto assumed = referencedBuckets(bl);
+    std::set<Hash> kept;
+    for (auto const& h : has.allBuckets())
+    {
+        if (!isZero(hexToBin256(h)))
+        {
+            kept.insert(hexToBin256(h));
+        }
+    }
+
+    // Move on without collecting, so that the buckets of `has` that leave
+    // the BucketList are still around (as candidates) when it's assumed.
+    for (; ledger <= 40; ++ledger)
+    {
+        bm.addBatch(*app, ledger,
+                    LedgerTestUtils::generateValidLedgerEntries(5), noDead);
+    }
+    resolveMerges(app, bl);
+    std::map<Hash, std::string> replaced;
+    for (auto const& h : referencedBuckets(bl))
+    {
+        if (kept.find(h) == kept.end())
+        {
+            replaced[h] = bm.getBucketByHash(h)->getFilename();
+        }
+    }
+    REQUIRE(!replaced.empty());
+
+    bm.assumeState(has);
+    REQUIRE(referencedBuckets(bl) == assumed);
+    REQUIRE(candidates.count() >= static_cast<int64_t>(replaced.size()));
+    auto candidatesBefore = candidates.count();
+
+    resolveMerges(app, bl);
+    bm.forgetUnreferencedBuckets();
+    REQUIRE(candidates.count() < candidatesBefore);
+    for (auto const& h : kept)
+    {
+        auto b = bm.getBucketByHash(h);
+        REQUIRE(b);
+        REQUIRE(fs::exists(b->getFilename()));
+    }
+    for (auto const& r : replaced)
+    {
+        REQUIRE(!fs::exists(r.second));
+    }
+}
+
+TEST_CASE("buckets of queued publishes are kept until published",
+          "[bucket][bucketgc]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    Application::pointer app = Application::create(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& bl = bm.getBucketList();
+
+    std::vector<LedgerKey> noDead;
+    uint32_t ledger = 1;
+    for (; ledger <= 16; ++ledger)
+    {
+        bm.addBatch(*app, ledger,
+                    LedgerTestUtils::generateValidLedgerEntries(5), noDead);
+    }
+    resolveMerges(app, bl);
+
+    // Queue the state the way HistoryManager::queueCurrentHistory does; but
+    // as loaded back from the database, so it doesn't hold its buckets.
+    HistoryArchiveState has;
+    has.fromString(HistoryArchiveState(ledger - 1, bl).toString());
+    uint32_t queued = has.currentLedger;
+    std::string state = has.toBinaryString();
+    bm.addPublishQueueReferences(has);
+    app->getDatabase().getSession()
+        << "INSERT INTO publishqueue (ledger, state) VALUES (:lg, :st);",
+        soci::use(queued), soci::use(state);
+
+    // Let its buckets leave the BucketList.
+    for (; ledger <= 48; ++ledger)
+    {
+        bm.addBatch(*app, ledger,
+                    LedgerTestUtils::generateValidLedgerEntries(5), noDead);
+        bm.forgetUnreferencedBuckets();
+    }
+    resolveMerges(app, bl);
+
+    auto referenced = referencedBuckets(bl);
+    std::map<Hash, std::string> queuedOnly;
+    for (auto const& h : has.allBuckets())
+    {
+        auto hash = hexToBin256(h);
+        if (!isZero(hash) && referenced.find(hash) == referenced.end())
+        {
+            auto b = bm.getBucketByHash(hash);
+            REQUIRE(b);
+            queuedOnly[hash] = b->getFilename();
+        }
+    }
+    REQUIRE(!queuedOnly.empty());
+
+    bm.forgetUnreferencedBuckets();
+    for (auto const& q : queuedOnly)
+    {
+        REQUIRE(fs::exists(q.second));
+    }
+
+    SECTION("until historyPublished")
+    {
+        auto& dropped =
+            app->getMetrics().NewMeter({"bucket", "gc", "dropped"}, "bucket");
+        auto droppedBefore = dropped.count();
+        app->getHistoryManager().historyPublished(queued, true);
+        bm.forgetUnreferencedBuckets();
+        for (auto const& q : queuedOnly)
+        {
+            REQUIRE(!fs::exists(q.second));
+        }
+        REQUIRE(dropped.count() == droppedBefore + queuedOnly.size());
+    }
+
+    SECTION("across a restart")
+    {
+        app.reset();
+        app = Application::create(clock, cfg, false);
+        auto& bm2 = app->getBucketManager();
+
+        // The restored BucketList doesn't reference them, only the publish
+        // queue does; loading them makes them candidates.
+        for (auto const& q : queuedOnly)
+        {
+            REQUIRE(bm2.getBucketByHash(q.first));
+        }
+        bm2.forgetUnreferencedBuckets();
+        for (auto const& q : queuedOnly)
+        {
+            REQUIRE(fs::exists(q.second));
+        }
+
+        app->getHistoryManager().historyPublished(queued, true);
+        bm2.forgetUnreferencedBuckets();
+        for (auto const& q : queuedOnly)
+        {
+            REQUIRE(!fs::exists(q.second));
+        }
+    }
+}
+
 TEST_CASE("single entry bubbling up", "[bucket][bucketbubble]")
 {
     VirtualClock clock;
@@ -835,6 +1418,215 @@ TEST_CASE("bucket persistence over app restart", "[bucket][bucketpersist]")
     }
 }
 
+TEST_CASE("merge checkpoints are resumed over app restart",
+          "[bucket][mergecheckpoint][bucketpersist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = true;
+    uint64_t const interval = 256;
+    cfg.BUCKET_MERGE_CHECKPOINT_BYTES = interval;
+    std::string bucketDir = cfg.BUCKET_DIR_PATH;
+    std::vector<LedgerKey> noDead;
+
+    // First run some ledgers, leaving merges in progress in the saved
+    // BucketList state; note the inputs and output of the largest one.
+    size_t level = 0;
+    std::vector<std::string> inputs;
+    Hash expected;
+    {
+        Application::pointer app = Application::create(clock, cfg);
+        app->start();
+        auto& bm = app->getBucketManager();
+        auto& bl = bm.getBucketList();
+        for (uint32_t i = 2; i < 40; ++i)
+        {
+            bl.addBatch(*app, i,
+                        LedgerTestUtils::generateValidLedgerEntries(10),
+                        noDead);
+        }
+        closeLedger(*app);
+
+        uint64_t largest = 0;
+        for (size_t i = 0; i < BucketList::kNumLevels; ++i)
+        {
+            auto const& next = bl.getLevel(i).getNext();
+            if (!next.isMerging())
+            {
+                continue;
+            }
+            uint64_t bytes = 0;
+            for (auto const& h : next.getHashes())
+            {
+                auto f = bm.getBucketByHash(hexToBin256(h))->getFilename();
+                if (!f.empty())
+                {
+                    bytes += static_cast<uint64_t>(fileSize(f));
+                }
+            }
+            if (inputs.empty() || bytes > largest)
+            {
+                level = i;
+                inputs = next.getHashes();
+                largest = bytes;
+            }
+        }
+        REQUIRE(inputs.size() >= 2);
+        expected = bl.getLevel(level).getNext().resolve()->getHash();
+    }
+
+    // Then leave a checkpoint of that merge, as if the process had stopped
+    // in the middle of it: the merge is done again in another app (the first
+    // remembers its output), up to its second checkpoint.
+    std::remove((bucketDir + "/merge-memo.json").c_str());
+    std::string mergeDir = bucketDir + "/merges";
+    std::string checkpoint;
+    {
+        Application::pointer app = Application::create(clock, getTestConfig(1));
+        auto& bm = app->getBucketManager();
+        std::vector<std::shared_ptr<Bucket>> buckets;
+        for (auto const& h : inputs)
+        {
+            auto name = "/bucket-" + h + ".xdr";
+            if (fs::exists(bucketDir + name))
+            {
+                std::ifstream in(bucketDir + name, std::ifstream::binary);
+                std::ofstream out(bm.getBucketDir() + name,
+                                  std::ofstream::binary);
+                out << in.rdbuf();
+            }
+            buckets.push_back(bm.getBucketByHash(hexToBin256(h)));
+            REQUIRE(buckets.back());
+        }
+        std::vector<std::shared_ptr<Bucket>> shadows(buckets.begin() + 2,
+                                                     buckets.end());
+        bool keepDeadEntries = level < BucketList::kNumLevels - 1;
+        auto key = Bucket::getMergeKey(buckets[0], buckets[1], shadows,
+                                       keepDeadEntries);
+        checkpoint = mergeDir + "/merge-" + binToHex(key);
+
+        size_t count = 0;
+        Bucket::MergeCheckpointing interrupted{
+            checkpoint, interval, [&count]() {
+                if (++count == 2)
+                {
+                    throw std::runtime_error("interrupted");
+                }
+            }};
+        REQUIRE_THROWS(Bucket::merge(bm, buckets[0], buckets[1], shadows,
+                                     keepDeadEntries, &interrupted));
+        REQUIRE(fs::exists(checkpoint + ".state"));
+    }
+    // and a checkpoint no merge claims
+    std::string unclaimed = mergeDir + "/merge-" + std::string(64, 'f');
+    {
+        std::ofstream out(unclaimed + ".state");
+        out << "unclaimed";
+    }
+
+    // Finally restart the first app: the merge picks its checkpoint back up
+    // and the rest of the previous checkpoints are deleted.
+    cfg.FORCE_SCP = false;
+    {
+        Application::pointer app = Application::create(clock, cfg, false);
+        auto& resumed = app->getMetrics().NewMeter(
+            {"bucket", "merge", "resumed"}, "merge");
+        app->start();
+        auto& bl = app->getBucketManager().getBucketList();
+
+        REQUIRE(!fs::exists(bucketDir + "/merges-previous"));
+        REQUIRE(!fs::exists(unclaimed + ".state"));
+
+        auto& next = bl.getLevel(level).getNext();
+        REQUIRE(next.isMerging());
+        REQUIRE(next.resolve()->getHash() == expected);
+        REQUIRE(resumed.count() == 1);
+        REQUIRE(!fs::exists(checkpoint + ".state"));
+    }
+}
+
+TEST_CASE("bucket GC runs after ledger close", "[bucket][bucketgc]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto& bm = app->getBucketManager();
+    auto& gc = app->getMetrics().NewTimer({"ledger", "close", "bucket-gc"});
+    auto crankSome = [&]() {
+        for (int i = 0; i < 10; ++i)
+        {
+            clock.crank(false);
+        }
+    };
+
+    // a bucket nothing references: the next GC pass drops it
+    std::vector<LedgerKey> dead;
+    auto b = Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(10),
+                           dead);
+    auto hash = b->getHash();
+    auto filename = b->getFilename();
+    b.reset();
+    REQUIRE(fs::exists(filename));
+
+    SECTION("repeated closes coalesce into one pass")
+    {
+        closeLedger(*app);
+        closeLedger(*app);
+        closeLedger(*app);
+        // nothing is collected on the close path
+        REQUIRE(gc.count() == 0);
+        REQUIRE(fs::exists(filename));
+
+        crankSome();
+        REQUIRE(gc.count() == 1);
+        REQUIRE(!fs::exists(filename));
+
+        // the file was moved to the tmp dir, to be deleted by a worker
+        waitForWorkers(app);
+        REQUIRE(!fs::exists(bm.getTmpDir() + "/gc-" + binToHex(hash) +
+                            ".xdr"));
+    }
+
+    SECTION("skipped while catching up")
+    {
+        closeLedger(*app);
+        lm.setState(LedgerManager::LM_CATCHING_UP_STATE);
+        crankSome();
+        REQUIRE(gc.count() == 0);
+        REQUIRE(fs::exists(filename));
+
+        lm.setState(LedgerManager::LM_SYNCED_STATE);
+        closeLedger(*app);
+        crankSome();
+        REQUIRE(gc.count() == 1);
+        REQUIRE(!fs::exists(filename));
+    }
+
+    SECTION("merge state saved after checkpoints")
+    {
+        // a merge makes the memo change
+        auto b1 = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(10), dead);
+        auto b2 = Bucket::fresh(
+            bm, LedgerTestUtils::generateValidLedgerEntries(10), dead);
+        Bucket::merge(bm, b1, b2);
+
+        auto memoFile = bm.getBucketDir() + "/merge-memo.json";
+        auto& hm = app->getHistoryManager();
+        while (hm.nextCheckpointLedger(lm.getLastClosedLedgerNum() + 1) !=
+               lm.getLastClosedLedgerNum() + 1)
+        {
+            REQUIRE(!fs::exists(memoFile));
+            closeLedger(*app);
+            crankSome();
+        }
+        REQUIRE(fs::exists(memoFile));
+    }
+}
+
 TEST_CASE("checkdb succeeding", "[bucket][checkdb]")
 {
     VirtualClock clock;
@@ -12,6 +12,7 @@
 #include "bucket/FutureBucket.h"
 #include "crypto/Hex.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 
 #include <chrono>
@@ -282,14 +283,45 @@ FutureBucket::startMerge(Application& app)
 
     BucketManager& bm = app.getBucketManager();
 
+    // A merge is identified by its inputs, so that it can pick up the
+    // checkpoint it left if the process restarts before it completes.
+    std::string checkpointPath;
+    uint64_t checkpointInterval = app.getConfig().BUCKET_MERGE_CHECKPOINT_BYTES;
+    if (checkpointInterval != 0)
+    {
+        checkpointPath = bm.acquireMergeCheckpointPath(
+            Bucket::getMergeKey(curr, snap, shadows, keepDeadEntries));
+    }
+
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
-    std::shared_ptr<task_t> task =
-        std::make_shared<task_t>([curr, snap, &bm, shadows, keepDeadEntries]() {
+    std::shared_ptr<task_t> task = std::make_shared<task_t>(
+        [curr, snap, &bm, shadows, keepDeadEntries, checkpointPath,
+         checkpointInterval]() -> std::shared_ptr<Bucket> {
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
                 << " with snap=" << hexAbbrev(snap->getHash());
 
-            auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries);
+            Bucket::MergeCheckpointing checkpointing{
+                checkpointPath, checkpointInterval, nullptr};
+            std::shared_ptr<Bucket> res;
+            try
+            {
+                res = Bucket::merge(
+                    bm, curr, snap, shadows, keepDeadEntries,
+                    checkpointPath.empty() ? nullptr : &checkpointing);
+            }
+            catch (...)
+            {
+                if (!checkpointPath.empty())
+                {
+                    bm.releaseMergeCheckpointPath(checkpointPath);
+                }
+                throw;
+            }
+            if (!checkpointPath.empty())
+            {
+                bm.releaseMergeCheckpointPath(checkpointPath);
+            }
 
             CLOG(TRACE, "Bucket")
                 << "Worker finished merging curr=" << hexAbbrev(curr->getHash())
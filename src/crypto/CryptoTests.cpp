@@ -11,9 +11,13 @@
 #include "lib/catch.hpp"
 #include "test/test.h"
 #include "util/Logging.h"
+#include "util/TmpDir.h"
 #include "util/basen.h"
 #include <autocheck/autocheck.hpp>
+#include <chrono>
+#include <fstream>
 #include <map>
+#include <random>
 #include <regex>
 #include <sodium.h>
 
@@ -100,6 +104,89 @@ TEST_CASE("Stateful SHA256 tests", "[crypto]")
     }
 }
 
+static uint256
+sodiumSha256(std::vector<uint8_t> const& bin)
+{
+    uint256 out;
+    crypto_hash_sha256(out.data(), bin.data(), bin.size());
+    return out;
+}
+
+TEST_CASE("SHA256 matches libsodium", "[crypto]")
+{
+    LOG(DEBUG) << "SHA256 accelerated: " << SHA256::isAccelerated();
+    std::default_random_engine gen;
+    std::uniform_int_distribution<size_t> chunk(0, 200);
+    // every length around the padding boundaries, then longer inputs
+    for (size_t n = 0; n < 2000; n = (n < 200 ? n + 1 : n * 3 / 2))
+    {
+        auto bin = randomBytes(n);
+        auto expected = sodiumSha256(bin);
+        CHECK(sha256(bin) == expected);
+
+        auto h = SHA256::create();
+        size_t off = 0;
+        while (off < n)
+        {
+            auto k = std::min(n - off, chunk(gen));
+            h->add(ByteSlice(bin.data() + off, k));
+            off += k;
+        }
+        CHECK(h->finish() == expected);
+    }
+}
+
+TEST_CASE("SHA256 of a file", "[crypto]")
+{
+    TmpDir dir("sha256-file");
+    auto bin = randomBytes(3 * 1024 * 1024 + 17);
+    auto filename = dir.getName() + "/data";
+    {
+        std::ofstream out(filename, std::ofstream::binary);
+        out.write(reinterpret_cast<char const*>(bin.data()), bin.size());
+    }
+    CHECK(sha256File(filename) == sodiumSha256(bin));
+    CHECK_THROWS(sha256File(dir.getName() + "/missing"));
+}
+
+TEST_CASE("SHA256 benchmarking", "[crypto-bench][bench][hide]")
+{
+    size_t const size = 256 * 1024 * 1024;
+    std::vector<uint8_t> bin(size, 0x5a);
+    LOG(INFO) << "Benchmarking SHA256 of " << size << " bytes, accelerated: "
+              << SHA256::isAccelerated();
+
+    auto mbPerSec = [size](std::chrono::steady_clock::duration d) {
+        return (size / (1024.0 * 1024.0)) /
+               std::chrono::duration<double>(d).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto h1 = sodiumSha256(bin);
+    auto sodiumTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    auto h2 = sha256(bin);
+    auto oneShotTime = std::chrono::steady_clock::now() - start;
+
+    // the way buckets are hashed as they are written: one add per entry
+    start = std::chrono::steady_clock::now();
+    auto hasher = SHA256::create();
+    for (size_t off = 0; off < size; off += 128)
+    {
+        hasher->add(ByteSlice(bin.data() + off, 128));
+    }
+    auto h3 = hasher->finish();
+    auto incrementalTime = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(h1 == h2);
+    REQUIRE(h1 == h3);
+    LOG(INFO) << "libsodium: " << mbPerSec(sodiumTime) << " MB/s";
+    LOG(INFO) << "sha256: " << mbPerSec(oneShotTime) << " MB/s";
+    LOG(INFO) << "SHA256 in 128 byte adds: " << mbPerSec(incrementalTime)
+              << " MB/s";
+}
+
 TEST_CASE("HMAC test vector", "[crypto]")
 {
     HmacSha256Key k;
@@ -6,15 +6,227 @@
 #include "crypto/ByteSlice.h"
 #include "util/NonCopyable.h"
 #include "util/make_unique.h"
+#include <cstring>
+#include <fstream>
 #include <sodium.h>
+#include <vector>
+
+// SHA256 is computed with the x86 SHA extensions when the CPU has them,
+// which is several times faster than libsodium's portable code; otherwise
+// (or when building with a compiler we can't target them with) libsodium
+// is used.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define STELLAR_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 namespace stellar
 {
 
+#ifdef STELLAR_SHA_NI
+namespace
+{
+
+alignas(16) uint32_t const SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+bool
+cpuHasShaNi()
+{
+    unsigned int a, b, c, d;
+    if (__get_cpuid_max(0, nullptr) < 7)
+    {
+        return false;
+    }
+    __cpuid(1, a, b, c, d);
+    bool ssse3 = (c & (1u << 9)) != 0;
+    bool sse41 = (c & (1u << 19)) != 0;
+    __cpuid_count(7, 0, a, b, c, d);
+    bool sha = (b & (1u << 29)) != 0;
+    return ssse3 && sse41 && sha;
+}
+
+bool const gUseShaNi = cpuHasShaNi();
+
+// Compresses `blocks` 64-byte blocks of `data` into `state`.
+__attribute__((target("sha,sse4.1,ssse3"))) void
+sha256BlocksNi(uint32_t state[8], uint8_t const* data, size_t blocks)
+{
+    __m128i const byteSwap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions keep the state as (ABEF, CDGH).
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state));
+    __m128i state1 =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; --blocks, data += 64)
+    {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i w[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(data + 16 * i)),
+                byteSwap);
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            if (i >= 4)
+            {
+                // w[i] = msg2(msg1(w[i-4], w[i-3]) + (w[i-2]:w[i-1]), w[i-1])
+                __m128i prev = w[(i + 3) & 3];
+                __m128i next = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                next = _mm_add_epi32(
+                    next, _mm_alignr_epi8(prev, w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(next, prev);
+            }
+            __m128i msg = _mm_add_epi32(
+                w[i & 3], _mm_load_si128(reinterpret_cast<__m128i const*>(
+                              SHA256_K + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+class SHA256NiImpl : public SHA256, NonCopyable
+{
+    uint32_t mState[8];
+    uint8_t mBuf[64];
+    size_t mBufLen;
+    uint64_t mTotalLen;
+    bool mFinished;
+
+  public:
+    SHA256NiImpl();
+    void reset() override;
+    void add(ByteSlice const& bin) override;
+    uint256 finish() override;
+};
+
+SHA256NiImpl::SHA256NiImpl()
+{
+    reset();
+}
+
+void
+SHA256NiImpl::reset()
+{
+    static uint32_t const init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                     0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                     0x1f83d9ab, 0x5be0cd19};
+    std::memcpy(mState, init, sizeof(mState));
+    mBufLen = 0;
+    mTotalLen = 0;
+    mFinished = false;
+}
+
+void
+SHA256NiImpl::add(ByteSlice const& bin)
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("adding bytes to finished SHA256");
+    }
+    auto data = bin.data();
+    auto size = bin.size();
+    mTotalLen += size;
+    if (mBufLen > 0)
+    {
+        auto n = std::min(size, sizeof(mBuf) - mBufLen);
+        std::memcpy(mBuf + mBufLen, data, n);
+        mBufLen += n;
+        data += n;
+        size -= n;
+        if (mBufLen < sizeof(mBuf))
+        {
+            return;
+        }
+        sha256BlocksNi(mState, mBuf, 1);
+        mBufLen = 0;
+    }
+    if (size >= 64)
+    {
+        sha256BlocksNi(mState, data, size / 64);
+        data += size & ~size_t(63);
+        size &= 63;
+    }
+    std::memcpy(mBuf, data, size);
+    mBufLen = size;
+}
+
+uint256
+SHA256NiImpl::finish()
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("finishing already-finished SHA256");
+    }
+    uint64_t bits = mTotalLen * 8;
+    uint8_t pad[72] = {0x80};
+    size_t padLen = (mBufLen < 56 ? 56 : 120) - mBufLen;
+    for (int i = 0; i < 8; ++i)
+    {
+        pad[padLen + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    add(ByteSlice(pad, padLen + 8));
+    assert(mBufLen == 0);
+
+    uint256 out;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        out[4 * i] = static_cast<uint8_t>(mState[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(mState[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(mState[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(mState[i]);
+    }
+    mFinished = true;
+    return out;
+}
+}
+#endif
+
 // Plain SHA256
 uint256
 sha256(ByteSlice const& bin)
 {
+#ifdef STELLAR_SHA_NI
+    if (gUseShaNi)
+    {
+        SHA256NiImpl hasher;
+        hasher.add(bin);
+        return hasher.finish();
+    }
+#endif
     uint256 out;
     if (crypto_hash_sha256(out.data(), bin.data(), bin.size()) != 0)
     {
@@ -23,6 +235,28 @@ sha256(ByteSlice const& bin)
     return out;
 }
 
+uint256
+sha256File(std::string const& filename)
+{
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in)
+    {
+        throw std::runtime_error("unable to open " + filename);
+    }
+    auto hasher = SHA256::create();
+    std::vector<char> buf(1024 * 1024);
+    while (in)
+    {
+        in.read(buf.data(), buf.size());
+        hasher->add(ByteSlice(buf.data(), in.gcount()));
+    }
+    if (in.bad())
+    {
+        throw std::runtime_error("error reading " + filename);
+    }
+    return hasher->finish();
+}
+
 class SHA256Impl : public SHA256, NonCopyable
 {
     crypto_hash_sha256_state mState;
@@ -38,9 +272,25 @@ class SHA256Impl : public SHA256, NonCopyable
 std::unique_ptr<SHA256>
 SHA256::create()
 {
+#ifdef STELLAR_SHA_NI
+    if (gUseShaNi)
+    {
+        return make_unique<SHA256NiImpl>();
+    }
+#endif
     return make_unique<SHA256Impl>();
 }
 
+bool
+SHA256::isAccelerated()
+{
+#ifdef STELLAR_SHA_NI
+    return gUseShaNi;
+#else
+    return false;
+#endif
+}
+
 SHA256Impl::SHA256Impl() : mFinished(false)
 {
     reset();
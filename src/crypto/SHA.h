@@ -7,6 +7,7 @@
 #include "crypto/ByteSlice.h"
 #include "xdr/Stellar-types.h"
 #include <memory>
+#include <string>
 
 namespace stellar
 {
@@ -14,11 +15,18 @@ namespace stellar
 // Plain SHA256
 uint256 sha256(ByteSlice const& bin);
 
+// SHA256 of the contents of a file, read in large chunks. Throws if the file
+// can't be read.
+uint256 sha256File(std::string const& filename);
+
 // SHA256 in incremental mode, for large inputs.
 class SHA256
 {
   public:
     static std::unique_ptr<SHA256> create();
+    // Whether the hashers are using the CPU's SHA instructions rather than
+    // the portable implementation.
+    static bool isAccelerated();
     virtual ~SHA256(){};
     virtual void reset() = 0;
     virtual void add(ByteSlice const& bin) = 0;
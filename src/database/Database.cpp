@@ -29,8 +29,10 @@
 #include "transactions/TransactionFrame.h"
 
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
+#include "soci-sqlite3.h"
 
 #include <sstream>
 #include <stdexcept>
@@ -56,6 +58,10 @@ bool Database::gDriversRegistered = false;
 
 static unsigned long const SCHEMA_VERSION = 5;
 
+// The set of distinct queries is small and fixed, this is only a safety net
+// against callers building query text dynamically.
+static size_t const PREPARED_STATEMENT_CACHE_SIZE = 1024;
+
 static void
 setSerializable(soci::session& sess)
 {
@@ -80,8 +86,13 @@ Database::Database(Application& app)
     : mApp(app)
     , mQueryMeter(
           app.getMetrics().NewMeter({"database", "query", "exec"}, "query"))
+    , mStatements(PREPARED_STATEMENT_CACHE_SIZE)
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
+    , mStatementsPrepared(app.getMetrics().NewMeter(
+          {"database", "statement", "prepare"}, "statement"))
+    , mStatementsReused(app.getMetrics().NewMeter(
+          {"database", "statement", "reuse"}, "statement"))
     , mEntryCache(4096)
     , mExcludedQueryTime(0)
     , mExcludedTotalTime(0)
@@ -272,12 +283,17 @@ void
 Database::clearPreparedStatementCache()
 {
     // Flush all prepared statements; in sqlite they represent open cursors
-    // and will conflict with any DROP TABLE commands issued below
-    for (auto st : mStatements)
+    // and will conflict with any DROP TABLE commands issued below, in
+    // postgres their plans are invalidated by schema changes
+    auto cleanUp = [](std::shared_ptr<soci::statement> const& st) {
+        st->clean_up(true);
+        return true;
+    };
+    mStatements.erase_if(cleanUp);
+    for (auto& cache : mPoolStatements)
     {
-        st.second->clean_up(true);
+        cache->erase_if(cleanUp);
     }
-    mStatements.clear();
     mStatementsSize.set_count(mStatements.size());
 }
 
@@ -337,6 +353,8 @@ Database::getPool()
             {
                 setSerializable(sess);
             }
+            mPoolStatements.emplace_back(
+                make_unique<StatementCache>(PREPARED_STATEMENT_CACHE_SIZE));
         }
     }
     assert(mPool);
@@ -385,22 +403,84 @@ class SQLLogContext : NonCopyable
     }
 };
 
+StatementContext::StatementContext(std::shared_ptr<soci::statement> stmt)
+    : mStmt(stmt)
+{
+    mStmt->clean_up(false);
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
+    {
+        mStmt->clean_up(false);
+        // statements outlive the transaction they were used in: make sure
+        // sqlite does not keep an open cursor (and its read snapshot) around
+        auto sqliteStmt = dynamic_cast<soci::sqlite3_statement_backend*>(
+            mStmt->get_backend());
+        if (sqliteStmt && sqliteStmt->stmt_)
+        {
+            sqlite_api::sqlite3_reset(sqliteStmt->stmt_);
+        }
+    }
+}
+
+soci::session&
+Database::getCachingSession(soci::session& session, StatementCache*& cache)
+{
+    if (&session == &mSession)
+    {
+        cache = &mStatements;
+        return mSession;
+    }
+
+    // a session borrowed from the pool shares its backend with the pool
+    // entry, which (unlike the borrowing session) lives as long as we do
+    if (mPool)
+    {
+        for (size_t i = 0; i < mPoolStatements.size(); ++i)
+        {
+            auto& pooled = mPool->at(i);
+            if (pooled.get_backend() == session.get_backend())
+            {
+                cache = mPoolStatements[i].get();
+                return pooled;
+            }
+        }
+    }
+    throw std::runtime_error("Session does not belong to the database");
+}
+
 StatementContext
 Database::getPreparedStatement(std::string const& query)
 {
-    auto i = mStatements.find(query);
+    return getPreparedStatement(query, mSession);
+}
+
+StatementContext
+Database::getPreparedStatement(std::string const& query,
+                               soci::session& session)
+{
+    StatementCache* cache = nullptr;
+    soci::session& owner = getCachingSession(session, cache);
+
     std::shared_ptr<soci::statement> p;
-    if (i == mStatements.end())
+    if (cache->exists(query))
     {
-        p = std::make_shared<soci::statement>(mSession);
-        p->alloc();
-        p->prepare(query);
-        mStatements.insert(std::make_pair(query, p));
-        mStatementsSize.set_count(mStatements.size());
+        p = cache->get(query);
+        mStatementsReused.Mark();
     }
     else
     {
-        p = i->second;
+        p = std::make_shared<soci::statement>(owner);
+        p->alloc();
+        p->prepare(query);
+        cache->put(query, p);
+        mStatementsPrepared.Mark();
+        if (cache == &mStatements)
+        {
+            mStatementsSize.set_count(mStatements.size());
+        }
     }
     StatementContext sc(p);
     return sc;
@@ -12,6 +12,7 @@
 #include "util/lrucache.hpp"
 #include <set>
 #include <string>
+#include <vector>
 
 namespace medida
 {
@@ -35,22 +36,13 @@ class StatementContext : NonCopyable
     std::shared_ptr<soci::statement> mStmt;
 
   public:
-    StatementContext(std::shared_ptr<soci::statement> stmt) : mStmt(stmt)
-    {
-        mStmt->clean_up(false);
-    }
+    StatementContext(std::shared_ptr<soci::statement> stmt);
     StatementContext(StatementContext&& other)
     {
         mStmt = other.mStmt;
         other.mStmt.reset();
     }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    ~StatementContext();
     soci::statement&
     statement()
     {
@@ -89,8 +81,15 @@ class Database : NonMovableOrCopyable
     soci::session mSession;
     std::unique_ptr<soci::connection_pool> mPool;
 
-    std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
+    // Prepared statements are kept across transactions, for the main session
+    // and for each entry of the connection pool (indexed as in mPool).
+    typedef cache::lru_cache<std::string, std::shared_ptr<soci::statement>>
+        StatementCache;
+    StatementCache mStatements;
+    std::vector<std::unique_ptr<StatementCache>> mPoolStatements;
     medida::Counter& mStatementsSize;
+    medida::Meter& mStatementsPrepared;
+    medida::Meter& mStatementsReused;
 
     cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
         mEntryCache;
@@ -106,6 +105,8 @@ class Database : NonMovableOrCopyable
     static bool gDriversRegistered;
     static void registerDrivers();
     void applySchemaUpgrade(unsigned long vers);
+    soci::session& getCachingSession(soci::session& session,
+                                     StatementCache*& cache);
 
   public:
     // Instantiate object and connect to app.getConfig().DATABASE;
@@ -139,11 +140,18 @@ class Database : NonMovableOrCopyable
     // Return a helper object that borrows, from the Database, a prepared
     // statement handle for the provided query. The prepared statement handle
     // is ceated if necessary before borrowing, and reset (unbound from data)
-    // when the statement context is destroyed.
+    // when the statement context is destroyed. Handles stay prepared across
+    // transactions and ledger closes, up to a fixed number per session.
     StatementContext getPreparedStatement(std::string const& query);
 
+    // Same as above, for a session borrowed from the connection pool (or the
+    // main session); each pool entry keeps its own prepared statements.
+    StatementContext getPreparedStatement(std::string const& query,
+                                          soci::session& session);
+
     // Purge all cached prepared statements, closing their handles with the
-    // database.
+    // database. This must be done whenever the schema changes or a
+    // connection is reset, and only while no pooled session is in use.
     void clearPreparedStatementCache();
 
     // Return metric-gathering timers for various families of SQL operation.
@@ -8,6 +8,8 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
@@ -178,6 +180,76 @@ checkMVCCIsolation(Application::pointer app)
     CHECK(s1r3 == tx1v2);
 }
 
+TEST_CASE("prepared statements are reused", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    session << "DROP TABLE IF EXISTS test";
+    session << "CREATE TABLE test (x INTEGER)";
+
+    auto& prepared = app->getMetrics().NewMeter(
+        {"database", "statement", "prepare"}, "statement");
+    auto& reused = app->getMetrics().NewMeter(
+        {"database", "statement", "reuse"}, "statement");
+
+    auto insert = [&](soci::session& sess, int v) {
+        auto prep =
+            db.getPreparedStatement("INSERT INTO test (x) VALUES (:v)", sess);
+        auto& st = prep.statement();
+        st.exchange(soci::use(v));
+        st.define_and_bind();
+        st.execute(true);
+    };
+    auto count = [&](soci::session& sess) {
+        int n = 0;
+        auto prep = db.getPreparedStatement("SELECT COUNT(*) FROM test", sess);
+        auto& st = prep.statement();
+        st.exchange(soci::into(n));
+        st.define_and_bind();
+        st.execute(true);
+        return n;
+    };
+
+    auto prepared0 = prepared.count();
+    auto reused0 = reused.count();
+    for (int i = 0; i < 3; ++i)
+    {
+        soci::transaction tx(session);
+        insert(session, i);
+        REQUIRE(count(session) == i + 1);
+        tx.commit();
+    }
+    // statements survive commits
+    REQUIRE(prepared.count() - prepared0 == 2);
+    REQUIRE(reused.count() - reused0 == 4);
+
+    {
+        // pooled sessions get their own statements, which outlive the
+        // borrowing session
+        for (int i = 0; i < 2; ++i)
+        {
+            soci::session sess(db.getPool());
+            REQUIRE(count(sess) == 3);
+        }
+        REQUIRE(prepared.count() - prepared0 >= 3);
+        REQUIRE(reused.count() - reused0 >= 4);
+    }
+
+    // writes on the main session are not held back by cached cursors
+    insert(session, 3);
+    {
+        soci::session sess(db.getPool());
+        REQUIRE(count(sess) == 4);
+    }
+
+    db.clearPreparedStatementCache();
+    session << "DROP TABLE test";
+}
+
 TEST_CASE("sqlite MVCC test", "[db]")
 {
     Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
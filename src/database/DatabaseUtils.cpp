@@ -0,0 +1,38 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/DatabaseUtils.h"
+#include "database/Database.h"
+
+#include <cassert>
+
+namespace stellar
+{
+
+size_t
+deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
+                       uint32_t count, std::string const& table,
+                       std::string const& ledgerSeqColumn)
+{
+    assert(count > 0);
+
+    uint32_t curMin = 0;
+    soci::indicator minIndicator;
+    sess << "SELECT MIN(" << ledgerSeqColumn << ") FROM " << table,
+        soci::into(curMin, minIndicator);
+    if (minIndicator != soci::indicator::i_ok || curMin > ledgerSeq)
+    {
+        return 0;
+    }
+
+    uint32_t maxLedger =
+        (ledgerSeq - curMin < count) ? ledgerSeq : curMin + count - 1;
+    soci::statement st =
+        (sess.prepare << "DELETE FROM " << table << " WHERE "
+                      << ledgerSeqColumn << " <= :v",
+         soci::use(maxLedger));
+    st.execute(true);
+    return static_cast<size_t>(st.get_affected_rows());
+}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <string>
+
+namespace soci
+{
+class session;
+}
+
+namespace stellar
+{
+
+// Deletes the rows of `table` whose `ledgerSeqColumn` is <= `ledgerSeq`, but
+// only those of the `count` oldest ledgers still in the table, so that a
+// single statement never deletes an unbounded number of rows. Returns the
+// number of rows deleted, 0 once there is nothing left to delete.
+size_t deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
+                              uint32_t count, std::string const& table,
+                              std::string const& ledgerSeqColumn);
+}
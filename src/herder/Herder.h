@@ -140,6 +140,9 @@ class Herder
                                          uint32_t ledgerCount,
                                          XDROutputFileStream& scpHistory);
     static void dropAll(Database& db);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq);
+    // deletes the SCP history of the `count` oldest ledgers <= ledgerSeq,
+    // returns the number of rows deleted
+    static size_t deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                   uint32_t count);
 };
 }
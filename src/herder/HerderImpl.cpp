@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
+#include "database/DatabaseUtils.h"
 #include "herder/HerderUtils.h"
 #include "herder/LedgerCloseData.h"
 #include "herder/TxSetFrame.h"
@@ -28,6 +29,7 @@
 #include "util/basen.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
 #include <ctime>
 
 using namespace std;
@@ -36,6 +38,10 @@ using namespace soci;
 namespace stellar
 {
 
+// number of slices the rebroadcast of pending transactions is split into,
+// over a ledger interval
+static int const TX_REBROADCAST_SLICES = 10;
+
 std::unique_ptr<Herder>
 Herder::create(Application& app)
 {
@@ -97,13 +103,23 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewCounter({"herder", "pending-txs", "age2"}))
     , mHerderPendingTxs3(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age3"}))
+
+    , mTxRebroadcast(app.getMetrics().NewMeter(
+          {"herder", "rebroadcast", "transaction"}, "transaction"))
+    , mTxRebroadcastBytes(app.getMetrics().NewMeter(
+          {"herder", "rebroadcast", "bytes"}, "byte"))
+    , mTxRebroadcastSkipped(app.getMetrics().NewMeter(
+          {"herder", "rebroadcast", "skipped"}, "transaction"))
 {
 }
 
 HerderImpl::HerderImpl(Application& app)
     : mSCP(*this, app.getConfig().NODE_SEED, app.getConfig().NODE_IS_VALIDATOR,
            app.getConfig().QUORUM_SET)
-    , mPendingTransactions(4)
+    , mTransactionQueue(app, 4)
+    , mTxRebroadcastSlicesLeft(0)
+    , mTxRebroadcastBytesLeft(0)
+    , mTxRebroadcastTimer(app)
     , mPendingEnvelopes(app, *this)
     , mLastSlotSaved(0)
     , mLastStateChange(app.getClock().now())
@@ -489,34 +505,6 @@ HerderImpl::updateSCPCounters()
         mSCP.getCumulativeStatemtCount());
 }
 
-static uint64_t
-countTxs(HerderImpl::AccountTxMap const& acc)
-{
-    uint64_t sz = 0;
-    for (auto const& a : acc)
-    {
-        sz += a.second->mTransactions.size();
-    }
-    return sz;
-}
-
-static std::shared_ptr<HerderImpl::TxMap>
-findOrAdd(HerderImpl::AccountTxMap& acc, AccountID const& aid)
-{
-    std::shared_ptr<HerderImpl::TxMap> txmap = nullptr;
-    auto i = acc.find(aid);
-    if (i == acc.end())
-    {
-        txmap = std::make_shared<HerderImpl::TxMap>();
-        acc.insert(std::make_pair(aid, txmap));
-    }
-    else
-    {
-        txmap = i->second;
-    }
-    return txmap;
-}
-
 void
 HerderImpl::logQuorumInformation(uint64 index)
 {
@@ -870,31 +858,6 @@ HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
     startRebroadcastTimer();
 }
 
-void
-HerderImpl::TxMap::addTx(TransactionFramePtr tx)
-{
-    auto const& h = tx->getFullHash();
-    if (mTransactions.find(h) != mTransactions.end())
-    {
-        return;
-    }
-    mTransactions.insert(std::make_pair(h, tx));
-    mMaxSeq = std::max(tx->getSeqNum(), mMaxSeq);
-    mTotalFees += tx->getFee();
-}
-
-void
-HerderImpl::TxMap::recalculate()
-{
-    mMaxSeq = 0;
-    mTotalFees = 0;
-    for (auto const& pair : mTransactions)
-    {
-        mMaxSeq = std::max(pair.second->getSeqNum(), mMaxSeq);
-        mTotalFees += pair.second->getFee();
-    }
-}
-
 Herder::TransactionSubmitStatus
 HerderImpl::recvTransaction(TransactionFramePtr tx)
 {
@@ -906,24 +869,12 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
 
     // determine if we have seen this tx before and if not if it has the right
     // seq num
-    int64_t totFee = tx->getFee();
-    SequenceNumber highSeq = 0;
-
-    for (auto& map : mPendingTransactions)
+    if (mTransactionQueue.contains(txID))
     {
-        auto i = map.find(acc);
-        if (i != map.end())
-        {
-            auto& txmap = i->second;
-            auto j = txmap->mTransactions.find(txID);
-            if (j != txmap->mTransactions.end())
-            {
-                return TX_STATUS_DUPLICATE;
-            }
-            totFee += txmap->mTotalFees;
-            highSeq = std::max(highSeq, txmap->mMaxSeq);
-        }
+        return TX_STATUS_DUPLICATE;
     }
+    int64_t totFee = tx->getFee() + mTransactionQueue.getTotalFees(acc);
+    SequenceNumber highSeq = mTransactionQueue.getMaxSeq(acc);
 
     if (!tx->checkValid(mApp, highSeq))
     {
@@ -940,8 +891,12 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
         CLOG(TRACE, "Herder") << "recv transaction " << hexAbbrev(txID)
                               << " for " << KeyUtils::toShortString(acc);
 
-    auto txmap = findOrAdd(mPendingTransactions[0], acc);
-    txmap->addTx(tx);
+    if (!mTransactionQueue.add(tx))
+    {
+        // the queue is full of transactions paying more
+        tx->getResult().result.code(txINSUFFICIENT_FEE);
+        return TX_STATUS_ERROR;
+    }
 
     return TX_STATUS_PENDING;
 }
@@ -1174,49 +1129,6 @@ HerderImpl::ledgerClosed()
                                  &VirtualTimer::onFailureNoop);
 }
 
-void
-HerderImpl::removeReceivedTxs(std::vector<TransactionFramePtr> const& dropTxs)
-{
-    for (auto& m : mPendingTransactions)
-    {
-        if (m.empty())
-        {
-            continue;
-        }
-
-        std::set<std::shared_ptr<TxMap>> toRecalculate;
-
-        for (auto const& tx : dropTxs)
-        {
-            auto const& acc = tx->getSourceID();
-            auto const& txID = tx->getFullHash();
-            auto i = m.find(acc);
-            if (i != m.end())
-            {
-                auto& txs = i->second->mTransactions;
-                auto j = txs.find(txID);
-                if (j != txs.end())
-                {
-                    txs.erase(j);
-                    if (txs.empty())
-                    {
-                        m.erase(i);
-                    }
-                    else
-                    {
-                        toRecalculate.insert(i->second);
-                    }
-                }
-            }
-        }
-
-        for (auto txm : toRecalculate)
-        {
-            txm->recalculate();
-        }
-    }
-}
-
 bool
 HerderImpl::recvSCPQuorumSet(Hash const& hash, const SCPQuorumSet& qset)
 {
@@ -1268,17 +1180,7 @@ HerderImpl::getCurrentLedgerSeq() const
 SequenceNumber
 HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 {
-    SequenceNumber highSeq = 0;
-    for (auto const& m : mPendingTransactions)
-    {
-        auto i = m.find(acc);
-        if (i == m.end())
-        {
-            continue;
-        }
-        highSeq = std::max(i->second->mMaxSeq, highSeq);
-    }
-    return highSeq;
+    return mTransactionQueue.getMaxSeq(acc);
 }
 
 // called to take a position during the next round
@@ -1295,30 +1197,27 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     updateSCPCounters();
 
     // our first choice for this round's set is all the tx we have collected
-    // during last ledger close
+    // during last ledger close; only those the last ledger may have
+    // invalidated need to be checked again
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    TxSetFramePtr proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
-
-    for (auto const& m : mPendingTransactions)
-    {
-        for (auto const& pair : m)
-        {
-            for (auto const& tx : pair.second->mTransactions)
-            {
-                proposedSet->add(tx.second);
-            }
-        }
-    }
-
-    std::vector<TransactionFramePtr> removed;
-    proposedSet->trimInvalid(mApp, removed);
-    removeReceivedTxs(removed);
-
+    mTransactionQueue.revalidate(false);
+    TxSetFramePtr proposedSet = mTransactionQueue.toTxSet(lcl.hash);
     proposedSet->surgePricingFilter(mLedgerManager);
 
     if (!proposedSet->checkValid(mApp))
     {
-        throw std::runtime_error("wanting to emit an invalid txSet");
+        // a transaction was invalidated by a change the queue does not track
+        // (say, an offer of its account was taken): check all of them
+        CLOG(DEBUG, "Herder") << "triggerNextLedger: re-checking all "
+                              << mTransactionQueue.size()
+                              << " pending transactions";
+        mTransactionQueue.revalidate(true);
+        proposedSet = mTransactionQueue.toTxSet(lcl.hash);
+        proposedSet->surgePricingFilter(mLedgerManager);
+        if (!proposedSet->checkValid(mApp))
+        {
+            throw std::runtime_error("wanting to emit an invalid txSet");
+        }
     }
 
     auto txSetHash = proposedSet->getContentsHash();
@@ -1644,41 +1543,131 @@ void
 HerderImpl::updatePendingTransactions(
     std::vector<TransactionFramePtr> const& applied)
 {
-    // remove all these tx from mPendingTransactions
-    removeReceivedTxs(applied);
+    // remove all these tx from the queue, and age the others
+    mTransactionQueue.removeApplied(applied);
+    mTransactionQueue.shift();
 
-    // drop the highest level
-    mPendingTransactions.erase(--mPendingTransactions.end());
+    startTxRebroadcast();
 
-    // shift entries up
-    mPendingTransactions.emplace_front();
+    auto sizes = mTransactionQueue.sizeByAge();
+    mSCPMetrics.mHerderPendingTxs0.set_count(sizes[0]);
+    mSCPMetrics.mHerderPendingTxs1.set_count(sizes[1]);
+    mSCPMetrics.mHerderPendingTxs2.set_count(sizes[2]);
+    mSCPMetrics.mHerderPendingTxs3.set_count(sizes[3]);
+}
 
-    // rebroadcast entries, sorted in apply-order to maximize chances of
-    // propagation
+std::vector<PeerPtr>
+HerderImpl::getAuthenticatedPeers()
+{
+    std::vector<PeerPtr> peers;
+    for (auto const& peer : mApp.getOverlayManager().getPeers())
     {
-        Hash h;
-        TxSetFrame toBroadcast(h);
-        for (auto const& l : mPendingTransactions)
+        if (peer->isAuthenticated())
         {
-            for (auto const& pair : l)
-            {
-                for (auto const& tx : pair.second->mTransactions)
-                {
-                    toBroadcast.add(tx.second);
-                }
-            }
+            peers.push_back(peer);
         }
-        for (auto tx : toBroadcast.sortForApply())
+    }
+    return peers;
+}
+
+bool
+HerderImpl::needsRebroadcast(TransactionFramePtr const& tx,
+                             std::vector<PeerPtr> const& peers)
+{
+    auto knows = mApp.getOverlayManager().getPeersKnows(
+        mTransactionQueue.getMessageHash(tx->getFullHash()));
+    return std::any_of(peers.begin(), peers.end(),
+                       [&knows](PeerPtr const& peer) {
+                           return knows.find(peer) == knows.end();
+                       });
+}
+
+void
+HerderImpl::startTxRebroadcast()
+{
+    if (!mTxRebroadcastQueue.empty())
+    {
+        mSCPMetrics.mTxRebroadcastSkipped.Mark(mTxRebroadcastQueue.size());
+        mTxRebroadcastQueue.clear();
+    }
+    mTxRebroadcastTimer.cancel();
+
+    mTxRebroadcastBytesLeft =
+        mApp.getConfig().TX_REBROADCAST_BYTES_PER_LEDGER;
+    auto peers = getAuthenticatedPeers();
+    if (mTxRebroadcastBytesLeft == 0 || peers.empty())
+    {
+        return;
+    }
+
+    // only what some peer is missing, sorted in apply-order to maximize
+    // chances of propagation
+    Hash h;
+    TxSetFrame toBroadcast(h);
+    for (auto const& tx : mTransactionQueue.getTransactions())
+    {
+        if (needsRebroadcast(tx, peers))
+        {
+            toBroadcast.add(tx);
+        }
+    }
+    if (toBroadcast.size() == 0)
+    {
+        return;
+    }
+    auto txs = toBroadcast.sortForApply();
+    mTxRebroadcastQueue.assign(txs.begin(), txs.end());
+    mTxRebroadcastSlicesLeft = TX_REBROADCAST_SLICES;
+    rebroadcastTxSlice();
+}
+
+void
+HerderImpl::rebroadcastTxSlice()
+{
+    assert(mTxRebroadcastSlicesLeft > 0);
+    auto slices = mTxRebroadcastSlicesLeft--;
+    auto count = (mTxRebroadcastQueue.size() + slices - 1) / slices;
+    auto peers = getAuthenticatedPeers();
+
+    while (count > 0 && !mTxRebroadcastQueue.empty())
+    {
+        auto tx = mTxRebroadcastQueue.front();
+        // applied, dropped or received from every peer in the meantime
+        if (!mTransactionQueue.contains(tx->getFullHash()) ||
+            !needsRebroadcast(tx, peers))
         {
-            auto msg = tx->toStellarMessage();
-            mApp.getOverlayManager().broadcastMessage(msg);
+            mTxRebroadcastQueue.pop_front();
+            continue;
         }
+
+        auto msg = tx->toStellarMessage();
+        auto size = xdr::xdr_argpack_size(msg);
+        if (size > mTxRebroadcastBytesLeft)
+        {
+            // out of budget until the next ledger
+            mSCPMetrics.mTxRebroadcastSkipped.Mark(mTxRebroadcastQueue.size());
+            mTxRebroadcastQueue.clear();
+            break;
+        }
+        mTxRebroadcastBytesLeft -= size;
+        mTxRebroadcastQueue.pop_front();
+        --count;
+
+        mApp.getOverlayManager().broadcastMessage(msg);
+        mSCPMetrics.mTxRebroadcast.Mark();
+        mSCPMetrics.mTxRebroadcastBytes.Mark(size);
     }
 
-    mSCPMetrics.mHerderPendingTxs0.set_count(countTxs(mPendingTransactions[0]));
-    mSCPMetrics.mHerderPendingTxs1.set_count(countTxs(mPendingTransactions[1]));
-    mSCPMetrics.mHerderPendingTxs2.set_count(countTxs(mPendingTransactions[2]));
-    mSCPMetrics.mHerderPendingTxs3.set_count(countTxs(mPendingTransactions[3]));
+    if (!mTxRebroadcastQueue.empty() && mTxRebroadcastSlicesLeft > 0)
+    {
+        mTxRebroadcastTimer.expires_from_now(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                Herder::EXP_LEDGER_TIMESPAN_SECONDS) /
+            TX_REBROADCAST_SLICES);
+        mTxRebroadcastTimer.async_wait(
+            std::bind(&HerderImpl::rebroadcastTxSlice, this),
+            &VirtualTimer::onFailureNoop);
+    }
 }
 
 void
@@ -1933,12 +1922,13 @@ Herder::dropAll(Database& db)
                        ")";
 }
 
-void
-Herder::deleteOldEntries(Database& db, uint32_t ledgerSeq)
+size_t
+Herder::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                         uint32_t count)
 {
-    db.getSession() << "DELETE FROM scphistory WHERE ledgerseq <= "
-                    << ledgerSeq;
-    db.getSession() << "DELETE FROM scpquorums WHERE lastledgerseq <= "
-                    << ledgerSeq;
+    return deleteOldEntriesHelper(sess, ledgerSeq, count, "scphistory",
+                                  "ledgerseq") +
+           deleteOldEntriesHelper(sess, ledgerSeq, count, "scpquorums",
+                                  "lastledgerseq");
 }
 }
@@ -6,11 +6,11 @@
 
 #include "PendingEnvelopes.h"
 #include "herder/Herder.h"
+#include "herder/TransactionQueue.h"
 #include "scp/SCP.h"
 #include "util/Timer.h"
 #include <deque>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 namespace medida
@@ -121,20 +121,9 @@ class HerderImpl : public Herder, public SCPDriver
     void dumpQuorumInfo(Json::Value& ret, NodeID const& id, bool summary,
                         uint64 index) override;
 
-    struct TxMap
-    {
-        SequenceNumber mMaxSeq{0};
-        int64_t mTotalFees{0};
-        std::unordered_map<Hash, TransactionFramePtr> mTransactions;
-        void addTx(TransactionFramePtr);
-        void recalculate();
-    };
-    typedef std::unordered_map<AccountID, std::shared_ptr<TxMap>> AccountTxMap;
-
   private:
     void logQuorumInformation(uint64 index);
     void ledgerClosed();
-    void removeReceivedTxs(std::vector<TransactionFramePtr> const& txs);
 
     void saveSCPHistory(uint64 index);
 
@@ -157,15 +146,26 @@ class HerderImpl : public Herder, public SCPDriver
     // this slot
     bool isSlotCompatibleWithCurrentState(uint64 slotIndex);
 
-    // 0- tx we got during ledger close
-    // 1- one ledger ago. rebroadcast
-    // 2- two ledgers ago. rebroadcast
-    // ...
-    std::deque<AccountTxMap> mPendingTransactions;
+    // transactions we got during the last 4 ledger closes, rebroadcast until
+    // they are applied or too old
+    TransactionQueue mTransactionQueue;
 
     void
     updatePendingTransactions(std::vector<TransactionFramePtr> const& applied);
 
+    // pending transactions that some peer is not known to have, rebroadcast
+    // a slice at a time over the ledger interval, within a byte budget
+    std::deque<TransactionFramePtr> mTxRebroadcastQueue;
+    size_t mTxRebroadcastSlicesLeft;
+    size_t mTxRebroadcastBytesLeft;
+    VirtualTimer mTxRebroadcastTimer;
+
+    void startTxRebroadcast();
+    void rebroadcastTxSlice();
+    bool needsRebroadcast(TransactionFramePtr const& tx,
+                          std::vector<PeerPtr> const& peers);
+    std::vector<PeerPtr> getAuthenticatedPeers();
+
     PendingEnvelopes mPendingEnvelopes;
 
     void herderOutOfSync();
@@ -287,6 +287,11 @@ class HerderImpl : public Herder, public SCPDriver
         medida::Counter& mHerderPendingTxs2;
         medida::Counter& mHerderPendingTxs3;
 
+        // Pending tx rebroadcast
+        medida::Meter& mTxRebroadcast;
+        medida::Meter& mTxRebroadcastBytes;
+        medida::Meter& mTxRebroadcastSkipped;
+
         SCPMetrics(Application& app);
     };
 
@@ -3,8 +3,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderImpl.h"
+#include "herder/TransactionQueue.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "main/Maintainer.h"
 #include "scp/SCP.h"
 #include "simulation/Simulation.h"
 #include "test/TestAccount.h"
@@ -16,11 +18,17 @@
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/CommandHandler.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "simulation/Simulation.h"
 #include "test/TxTests.h"
+#include "util/Logging.h"
+#include "util/Math.h"
 
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <chrono>
 
 using namespace stellar;
 using namespace stellar::txtest;
@@ -95,7 +103,15 @@ TEST_CASE("standalone", "[herder]")
 
         SECTION("Queue processing test")
         {
-            app->getCommandHandler().manualCmd("maintenance?queue=true");
+            // maintenance deletes history in chunks, on the main loop
+            auto maintenance = [&]() {
+                app->getCommandHandler().manualCmd("maintenance?queue=true");
+                while (app->getMaintainer().isRunning())
+                {
+                    app->getClock().crank(true);
+                }
+            };
+            maintenance();
 
             while (app->getLedgerManager().getLastClosedLedgerNum() <
                    (app->getHistoryManager().getCheckpointFrequency() + 5))
@@ -104,21 +120,25 @@ TEST_CASE("standalone", "[herder]")
             }
 
             app->getCommandHandler().manualCmd("setcursor?id=A1&cursor=1");
-            app->getCommandHandler().manualCmd("maintenance?queue=true");
+            maintenance();
             auto& db = app->getDatabase();
             auto& sess = db.getSession();
             LedgerHeaderFrame::pointer lh;
 
             app->getCommandHandler().manualCmd("setcursor?id=A2&cursor=3");
-            app->getCommandHandler().manualCmd("maintenance?queue=true");
+            maintenance();
             lh = LedgerHeaderFrame::loadBySequence(2, db, sess);
             REQUIRE(!!lh);
 
             app->getCommandHandler().manualCmd("setcursor?id=A1&cursor=2");
             // this should delete items older than sequence 2
-            app->getCommandHandler().manualCmd("maintenance?queue=true");
+            auto& rowsDeleted = app->getMetrics().NewMeter(
+                {"maintenance", "prune", "rows"}, "row");
+            auto rowsBefore = rowsDeleted.count();
+            maintenance();
             lh = LedgerHeaderFrame::loadBySequence(2, db, sess);
             REQUIRE(!lh);
+            REQUIRE(rowsDeleted.count() > rowsBefore);
             lh = LedgerHeaderFrame::loadBySequence(3, db, sess);
             REQUIRE(!!lh);
 
@@ -126,14 +146,14 @@ TEST_CASE("standalone", "[herder]")
             SECTION("set min to 3 by update")
             {
                 app->getCommandHandler().manualCmd("setcursor?id=A1&cursor=3");
-                app->getCommandHandler().manualCmd("maintenance?queue=true");
+                maintenance();
                 lh = LedgerHeaderFrame::loadBySequence(3, db, sess);
                 REQUIRE(!lh);
             }
             SECTION("set min to 3 by deletion")
             {
                 app->getCommandHandler().manualCmd("dropcursor?id=A1");
-                app->getCommandHandler().manualCmd("maintenance?queue=true");
+                maintenance();
                 lh = LedgerHeaderFrame::loadBySequence(3, db, sess);
                 REQUIRE(!lh);
             }
@@ -296,6 +316,225 @@ TEST_CASE("txset", "[herder]")
     }
 }
 
+TEST_CASE("transaction queue", "[herder]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    // holds 4 * 2 * 1 transactions
+    app->getLedgerManager().getCurrentLedgerHeader().maxTxSetSize = 1;
+    TransactionQueue queue(*app, 2);
+
+    auto root = TestAccount::createRoot(*app);
+    auto const minBalance = app->getLedgerManager().getMinBalance(0);
+    auto a1 = root.create("A1", minBalance * 10);
+    auto a2 = root.create("A2", minBalance * 10);
+    auto a3 = root.create("A3", minBalance * 10);
+    auto a4 = root.create("A4", minBalance * 10);
+
+    auto sn = root.getLastSequenceNumber();
+    auto tx1 = root.tx({payment(a1, 10)}, sn + 1);
+    auto tx2 = root.tx({payment(a1, 10)}, sn + 2);
+    REQUIRE(queue.add(tx1));
+    REQUIRE(queue.add(tx2));
+
+    REQUIRE(queue.contains(tx1->getFullHash()));
+    REQUIRE(queue.size() == 2);
+    REQUIRE(queue.getMaxSeq(root) == sn + 2);
+    REQUIRE(queue.getMaxSeq(a1) == 0);
+    REQUIRE(queue.getTotalFees(root) == tx1->getFee() + tx2->getFee());
+
+    SECTION("aging")
+    {
+        queue.shift();
+        REQUIRE(queue.sizeByAge() == std::vector<size_t>{0, 2});
+        queue.shift();
+        REQUIRE(queue.size() == 0);
+        REQUIRE(queue.getMaxSeq(root) == 0);
+    }
+
+    SECTION("removing a transaction removes the ones depending on it")
+    {
+        queue.remove({tx1});
+        REQUIRE(queue.size() == 0);
+    }
+
+    SECTION("applied transactions")
+    {
+        queue.removeApplied({tx1});
+        REQUIRE(!queue.contains(tx1->getFullHash()));
+        REQUIRE(queue.getMaxSeq(root) == sn + 2);
+        REQUIRE(queue.getTotalFees(root) == tx2->getFee());
+    }
+
+    SECTION("revalidation")
+    {
+        queue.revalidate(true);
+        REQUIRE(queue.size() == 2);
+
+        // the sequence number of tx1 gets used by another transaction
+        root.pay(a1, 10);
+        queue.revalidate(true);
+        REQUIRE(queue.size() == 0);
+    }
+
+    SECTION("incremental revalidation")
+    {
+        auto a1tx = a1.tx({payment(root, 10)}, a1.getLastSequenceNumber() + 1);
+        auto closeTime =
+            app->getLedgerManager().getCurrentLedgerHeader().scpValue.closeTime;
+        a1tx->getEnvelope().tx.timeBounds.activate().maxTime = closeTime + 10;
+        a1tx->getEnvelope().signatures.clear();
+        a1tx->addSignature(a1);
+
+        auto a2sn = a2.getLastSequenceNumber();
+        auto a2tx1 = a2.tx({payment(root, 10)}, a2sn + 1);
+        auto a2tx2 = a2.tx({payment(root, 10)}, a2sn + 2);
+
+        // pays from A4, which has to sign it as well
+        auto a3tx =
+            a3.tx({a4.op(payment(root, 10))}, a3.getLastSequenceNumber() + 1);
+        a3tx->addSignature(a4);
+
+        for (auto const& tx : {a1tx, a2tx1, a2tx2, a3tx})
+        {
+            REQUIRE(queue.add(tx));
+        }
+        queue.revalidate(true);
+        REQUIRE(queue.size() == 6);
+
+        auto contains = [&](std::vector<TransactionFramePtr> const& txs) {
+            return std::all_of(txs.begin(), txs.end(),
+                               [&](TransactionFramePtr const& tx) {
+                                   return queue.contains(tx->getFullHash());
+                               });
+        };
+        auto containsNone =
+            [&](std::vector<TransactionFramePtr> const& txs) {
+                return std::none_of(txs.begin(), txs.end(),
+                                    [&](TransactionFramePtr const& tx) {
+                                        return queue.contains(
+                                            tx->getFullHash());
+                                    });
+            };
+
+        SECTION("sequence number of a source account")
+        {
+            // both A2 and root use their next sequence number, but only
+            // A2's transaction is seen applied
+            auto applied = a2.tx({payment(root, 11)}, a2sn + 1);
+            applyTx(applied, *app);
+            root.pay(a1, 10);
+
+            queue.removeApplied({applied});
+            queue.revalidate(false);
+            REQUIRE(containsNone({a2tx1, a2tx2}));
+            REQUIRE(contains({tx1, tx2, a1tx, a3tx}));
+            REQUIRE(queue.size() == 4);
+
+            // root's chain is only found invalid by a full re-check
+            queue.revalidate(true);
+            REQUIRE(containsNone({tx1, tx2}));
+            REQUIRE(contains({a1tx, a3tx}));
+            REQUIRE(queue.size() == 2);
+        }
+
+        SECTION("balance of an operation source account")
+        {
+            // root's transaction drains A2 down to the reserve: A2 can no
+            // longer pay for its transactions
+            auto applied = root.tx(
+                {a2.op(payment(root, a2.getBalance() - minBalance))});
+            applied->addSignature(a2);
+            applyTx(applied, *app);
+
+            queue.removeApplied({applied});
+            queue.revalidate(false);
+            REQUIRE(containsNone({tx1, tx2, a2tx1, a2tx2}));
+            REQUIRE(contains({a1tx, a3tx}));
+            REQUIRE(queue.size() == 2);
+        }
+
+        SECTION("account used as an operation source by a queued transaction")
+        {
+            auto applied = a4.tx({accountMerge(root)});
+            applyTx(applied, *app);
+
+            queue.removeApplied({applied});
+            queue.revalidate(false);
+            REQUIRE(containsNone({a3tx}));
+            REQUIRE(contains({tx1, tx2, a1tx, a2tx1, a2tx2}));
+            REQUIRE(queue.size() == 5);
+        }
+
+        SECTION("expired time bounds")
+        {
+            app->getLedgerManager()
+                .getCurrentLedgerHeader()
+                .scpValue.closeTime = closeTime + 11;
+            queue.revalidate(false);
+            REQUIRE(containsNone({a1tx}));
+            REQUIRE(contains({tx1, tx2, a2tx1, a2tx2, a3tx}));
+            REQUIRE(queue.size() == 5);
+        }
+    }
+
+    SECTION("eviction when full")
+    {
+        // root's chain: tx1, then the cheapest transaction of the queue,
+        // then expensive ones depending on it
+        queue.remove({tx2});
+        auto cheapest = root.tx({payment(a1, 10)}, sn + 2);
+        cheapest->getEnvelope().tx.fee /= 2;
+        REQUIRE(queue.add(cheapest));
+        std::vector<TransactionFramePtr> rootTail;
+        for (int i = 3; i <= 5; i++)
+        {
+            auto tx = root.tx({payment(a1, 10)}, sn + i);
+            tx->getEnvelope().tx.fee *= 3;
+            REQUIRE(queue.add(tx));
+            rootTail.push_back(tx);
+        }
+        // A2's chain pays less than root's tail, more than the cheapest
+        auto a2sn = a2.getLastSequenceNumber();
+        std::vector<TransactionFramePtr> a2Txs;
+        for (int i = 1; i <= 3; i++)
+        {
+            auto tx = a2.tx({payment(root, 10)}, a2sn + i);
+            tx->getEnvelope().tx.fee *= 2;
+            REQUIRE(queue.add(tx));
+            a2Txs.push_back(tx);
+        }
+        REQUIRE(queue.size() == 8);
+
+        // paying the same fee as the cheapest does not get in
+        auto a1sn = a1.getLastSequenceNumber();
+        auto cheap = a1.tx({payment(root, 10)}, a1sn + 1);
+        cheap->getEnvelope().tx.fee = cheapest->getFee();
+        REQUIRE(!queue.add(cheap));
+
+        // paying more pushes out the cheapest transaction, and the ones
+        // of its chain that depend on it, but nothing else
+        auto expensive = a1.tx({payment(root, 10)}, a1sn + 1);
+        REQUIRE(queue.add(expensive));
+        REQUIRE(queue.contains(expensive->getFullHash()));
+        REQUIRE(!queue.contains(cheapest->getFullHash()));
+        for (auto const& tx : rootTail)
+        {
+            REQUIRE(!queue.contains(tx->getFullHash()));
+        }
+        REQUIRE(queue.contains(tx1->getFullHash()));
+        REQUIRE(queue.getMaxSeq(root) == sn + 1);
+        for (auto const& tx : a2Txs)
+        {
+            REQUIRE(queue.contains(tx->getFullHash()));
+        }
+        REQUIRE(queue.size() == 5);
+    }
+}
+
 // under surge
 // over surge
 // make sure it drops the correct txs
@@ -415,6 +654,66 @@ TEST_CASE("surge", "[herder]")
     }
 }
 
+TEST_CASE("surge pricing benchmark", "[herder-bench][bench][hide]")
+{
+    Config cfg(getTestConfig());
+    cfg.DESIRED_MAX_TX_PER_LEDGER = 1000;
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    Hash const& networkID = app->getNetworkID();
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    lm.getCurrentLedgerHeader().maxTxSetSize = cfg.DESIRED_MAX_TX_PER_LEDGER;
+    auto baseFee = lm.getTxFee();
+
+    PublicKey dest;
+    for (size_t n : {10000, 50000, 100000, 500000})
+    {
+        // about 5 transactions per account, with fees from 1 to 10 times
+        // the minimum
+        std::vector<TransactionFramePtr> candidates;
+        candidates.reserve(n);
+        PublicKey source;
+        SequenceNumber seq = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (seq == 0 || rand_uniform<int>(0, 4) == 0)
+            {
+                for (auto& b : source.ed25519())
+                {
+                    b = static_cast<uint8_t>(rand_uniform<int>(0, 255));
+                }
+                seq = 0;
+            }
+            TransactionEnvelope e;
+            e.tx.sourceAccount = source;
+            e.tx.fee = static_cast<uint32_t>(baseFee * rand_uniform<int>(1, 10));
+            e.tx.seqNum = ++seq;
+            e.tx.operations.push_back(payment(dest, 1));
+            candidates.push_back(
+                TransactionFrame::makeTransactionFromWire(networkID, e));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        TxSetFrame txSet(lm.getLastClosedLedgerHeader().hash);
+        for (auto const& tx : candidates)
+        {
+            txSet.add(tx);
+        }
+        txSet.surgePricingFilter(lm);
+        txSet.getContentsHash();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(txSet.size() == cfg.DESIRED_MAX_TX_PER_LEDGER);
+        LOG(INFO) << "Built a tx set of " << txSet.size() << " from " << n
+                  << " candidates in "
+                  << std::chrono::duration<double, std::milli>(elapsed).count()
+                  << " ms";
+    }
+}
+
 TEST_CASE("SCP Driver", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -837,3 +1136,63 @@ TEST_CASE("SCP State", "[herder]")
         }
     }
 }
+
+TEST_CASE("pending transaction rebroadcast", "[herder]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer sim =
+        std::make_shared<Simulation>(Simulation::OVER_LOOPBACK, networkID);
+
+    // two validators in lockstep and an observer only connected to node0
+    SecretKey nodeKeys[3];
+    PublicKey nodeIDs[3];
+    SCPQuorumSet qSet;
+    qSet.threshold = 2;
+    for (int i = 0; i < 3; i++)
+    {
+        nodeKeys[i] = SecretKey::fromSeed(sha256("Node_" + std::to_string(i)));
+        nodeIDs[i] = nodeKeys[i].getPublicKey();
+        if (i < 2)
+        {
+            qSet.validators.push_back(nodeIDs[i]);
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        Config cfg = getTestConfig(i + 1);
+        cfg.NODE_IS_VALIDATOR = i < 2;
+        sim->addNode(nodeKeys[i], qSet, sim->getClock(), &cfg);
+    }
+    sim->addPendingConnection(nodeIDs[0], nodeIDs[1]);
+    sim->addPendingConnection(nodeIDs[2], nodeIDs[0]);
+    sim->startAllNodes();
+
+    sim->crankUntil([&]() { return sim->haveAllExternalized(2, 1); },
+                    2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, true);
+
+    // submitted to the observer without being flooded: only rebroadcast
+    // gets it to the validators
+    auto observer = sim->getNode(nodeIDs[2]);
+    auto root = TestAccount::createRoot(*observer);
+    auto dest = SecretKey::random().getPublicKey();
+    auto tx = root.tx({createAccount(dest, 1000000000)});
+    REQUIRE(observer->getHerder().recvTransaction(tx) ==
+            Herder::TX_STATUS_PENDING);
+
+    sim->crankUntil(
+        [&]() {
+            return AccountFrame::loadAccount(dest, observer->getDatabase()) !=
+                   nullptr;
+        },
+        5 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, true);
+
+    // sent once: node0 is then known to have it
+    auto& rebroadcast = observer->getMetrics().NewMeter(
+        {"herder", "rebroadcast", "transaction"}, "transaction");
+    REQUIRE(rebroadcast.count() == 1);
+    for (int i = 0; i < 2; i++)
+    {
+        REQUIRE(AccountFrame::loadAccount(
+                    dest, sim->getNode(nodeIDs[i])->getDatabase()) != nullptr);
+    }
+}
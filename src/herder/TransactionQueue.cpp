@@ -0,0 +1,352 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TransactionQueue.h"
+#include "crypto/SHA.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+const uint32_t TransactionQueue::QUEUE_SIZE_MULTIPLIER = 4;
+
+TransactionQueue::TransactionQueue(Application& app, size_t pendingDepth)
+    : mApp(app)
+    , mPendingDepth(pendingDepth)
+    , mByAge(pendingDepth)
+    , mGeneration(0)
+    , mValidatedLedger(0)
+    , mValidatedBaseFee(0)
+    , mValidatedBaseReserve(0)
+    , mValidatedLedgerVersion(0)
+    , mEvicted(app.getMetrics().NewMeter({"herder", "pending-txs", "evicted"},
+                                         "transaction"))
+    , mInvalidated(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "invalidated"}, "transaction"))
+    , mAppliedAge(
+          app.getMetrics().NewHistogram({"herder", "pending-txs", "applied-age"}))
+{
+    assert(mPendingDepth > 0);
+}
+
+bool
+TransactionQueue::contains(Hash const& txHash) const
+{
+    return mTransactions.find(txHash) != mTransactions.end();
+}
+
+SequenceNumber
+TransactionQueue::getMaxSeq(AccountID const& account) const
+{
+    auto i = mAccounts.find(account);
+    if (i == mAccounts.end())
+    {
+        return 0;
+    }
+    return i->second.mChain.rbegin()->first;
+}
+
+int64_t
+TransactionQueue::getTotalFees(AccountID const& account) const
+{
+    auto i = mAccounts.find(account);
+    if (i == mAccounts.end())
+    {
+        return 0;
+    }
+    return i->second.mTotalFees;
+}
+
+size_t
+TransactionQueue::getCapacity() const
+{
+    return QUEUE_SIZE_MULTIPLIER * mPendingDepth *
+           mApp.getLedgerManager().getMaxTxSetSize();
+}
+
+bool
+TransactionQueue::add(TransactionFramePtr tx)
+{
+    auto const& txHash = tx->getFullHash();
+    assert(!contains(txHash));
+
+    auto ops = std::max<size_t>(1, tx->getOperations().size());
+    double feePerOp = static_cast<double>(tx->getFee()) / ops;
+
+    // make room by evicting the cheapest transactions (with the ones that
+    // depend on them), as long as they pay less than this one
+    while (mTransactions.size() >= getCapacity())
+    {
+        auto lowest = mByFee.begin();
+        if (lowest == mByFee.end() || lowest->first >= feePerOp)
+        {
+            return false;
+        }
+        auto victim = mTransactions.find(lowest->second)->second.mTx;
+        if (victim->getSourceID() == tx->getSourceID())
+        {
+            // tx would not be valid without it
+            return false;
+        }
+        mEvicted.Mark(removeFrom(victim));
+    }
+
+    auto msgHash = sha256(xdr::xdr_to_opaque(tx->toStellarMessage()));
+    QueuedTx qtx{tx, mGeneration, feePerOp, msgHash};
+    mTransactions.insert(std::make_pair(txHash, qtx));
+    mByFee.insert(std::make_pair(feePerOp, txHash));
+    mByAge.front().insert(txHash);
+
+    auto& account = mAccounts[tx->getSourceID()];
+    account.mChain[tx->getSeqNum()] = tx;
+    account.mTotalFees += tx->getFee();
+    return true;
+}
+
+void
+TransactionQueue::eraseTx(Hash const& txHash)
+{
+    auto i = mTransactions.find(txHash);
+    if (i == mTransactions.end())
+    {
+        return;
+    }
+    auto const& qtx = i->second;
+    auto const& tx = qtx.mTx;
+
+    mByFee.erase(std::make_pair(qtx.mFeePerOp, txHash));
+    mByAge[mGeneration - qtx.mGeneration].erase(txHash);
+
+    auto a = mAccounts.find(tx->getSourceID());
+    assert(a != mAccounts.end());
+    auto& account = a->second;
+    auto c = account.mChain.find(tx->getSeqNum());
+    if (c != account.mChain.end() && c->second == tx)
+    {
+        account.mChain.erase(c);
+        account.mTotalFees -= tx->getFee();
+    }
+    if (account.mChain.empty())
+    {
+        mAccounts.erase(a);
+    }
+
+    mTransactions.erase(i);
+}
+
+size_t
+TransactionQueue::removeFrom(TransactionFramePtr const& tx)
+{
+    std::vector<Hash> toRemove;
+    auto a = mAccounts.find(tx->getSourceID());
+    if (a != mAccounts.end())
+    {
+        auto const& chain = a->second.mChain;
+        for (auto i = chain.lower_bound(tx->getSeqNum()); i != chain.end();
+             ++i)
+        {
+            toRemove.push_back(i->second->getFullHash());
+        }
+    }
+    if (std::find(toRemove.begin(), toRemove.end(), tx->getFullHash()) ==
+        toRemove.end())
+    {
+        toRemove.push_back(tx->getFullHash());
+    }
+
+    size_t removed = 0;
+    for (auto const& h : toRemove)
+    {
+        if (contains(h))
+        {
+            eraseTx(h);
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+void
+TransactionQueue::remove(std::vector<TransactionFramePtr> const& txs)
+{
+    for (auto const& tx : txs)
+    {
+        if (contains(tx->getFullHash()))
+        {
+            removeFrom(tx);
+        }
+    }
+}
+
+void
+TransactionQueue::removeApplied(std::vector<TransactionFramePtr> const& applied)
+{
+    for (auto const& tx : applied)
+    {
+        mTouched.insert(tx->getSourceID());
+        for (auto const& op : tx->getEnvelope().tx.operations)
+        {
+            if (op.sourceAccount)
+            {
+                mTouched.insert(*op.sourceAccount);
+            }
+        }
+
+        auto i = mTransactions.find(tx->getFullHash());
+        if (i != mTransactions.end())
+        {
+            mAppliedAge.Update(mGeneration - i->second.mGeneration);
+            eraseTx(tx->getFullHash());
+        }
+    }
+}
+
+void
+TransactionQueue::shift()
+{
+    // transactions depending on aged out ones go with them
+    auto oldest = mByAge.back();
+    for (auto const& h : oldest)
+    {
+        auto i = mTransactions.find(h);
+        if (i != mTransactions.end())
+        {
+            auto tx = i->second.mTx;
+            mEvicted.Mark(removeFrom(tx));
+        }
+    }
+    assert(mByAge.back().empty());
+
+    mByAge.pop_back();
+    mByAge.emplace_front();
+    ++mGeneration;
+}
+
+bool
+TransactionQueue::needsRecheck(AccountTxs const& txs, uint64 closeTime) const
+{
+    for (auto const& c : txs.mChain)
+    {
+        auto const& tx = c.second->getEnvelope().tx;
+        if (tx.timeBounds && tx.timeBounds->maxTime &&
+            tx.timeBounds->maxTime < closeTime)
+        {
+            return true;
+        }
+        for (auto const& op : tx.operations)
+        {
+            if (op.sourceAccount &&
+                mTouched.find(*op.sourceAccount) != mTouched.end())
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+TransactionQueue::revalidate(bool all)
+{
+    auto& lm = mApp.getLedgerManager();
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    auto const& header = lm.getCurrentLedgerHeader();
+
+    // the applied transactions we have seen only account for one ledger
+    if ((lcl.header.ledgerSeq != mValidatedLedger &&
+         lcl.header.ledgerSeq != mValidatedLedger + 1) ||
+        header.baseFee != mValidatedBaseFee ||
+        header.baseReserve != mValidatedBaseReserve ||
+        header.ledgerVersion != mValidatedLedgerVersion)
+    {
+        all = true;
+    }
+
+    TxSetFrame toCheck(lcl.hash);
+    for (auto const& a : mAccounts)
+    {
+        if (all || mTouched.find(a.first) != mTouched.end() ||
+            needsRecheck(a.second, header.scpValue.closeTime))
+        {
+            for (auto const& c : a.second.mChain)
+            {
+                toCheck.add(c.second);
+            }
+        }
+    }
+
+    if (toCheck.size() != 0)
+    {
+        CLOG(TRACE, "Herder") << "re-checking " << toCheck.size() << " of "
+                              << size() << " pending transactions";
+        std::vector<TransactionFramePtr> trimmed;
+        toCheck.trimInvalid(mApp, trimmed);
+        mInvalidated.Mark(trimmed.size());
+        remove(trimmed);
+    }
+
+    mTouched.clear();
+    mValidatedLedger = lcl.header.ledgerSeq;
+    mValidatedBaseFee = header.baseFee;
+    mValidatedBaseReserve = header.baseReserve;
+    mValidatedLedgerVersion = header.ledgerVersion;
+}
+
+TxSetFramePtr
+TransactionQueue::toTxSet(Hash const& previousLedgerHash) const
+{
+    auto txSet = std::make_shared<TxSetFrame>(previousLedgerHash);
+    for (auto const& t : mTransactions)
+    {
+        txSet->add(t.second.mTx);
+    }
+    txSet->sortForHash();
+    return txSet;
+}
+
+std::vector<TransactionFramePtr>
+TransactionQueue::getTransactions() const
+{
+    std::vector<TransactionFramePtr> txs;
+    txs.reserve(mTransactions.size());
+    for (auto const& t : mTransactions)
+    {
+        txs.push_back(t.second.mTx);
+    }
+    return txs;
+}
+
+Hash const&
+TransactionQueue::getMessageHash(Hash const& txHash) const
+{
+    auto i = mTransactions.find(txHash);
+    assert(i != mTransactions.end());
+    return i->second.mMessageHash;
+}
+
+size_t
+TransactionQueue::size() const
+{
+    return mTransactions.size();
+}
+
+std::vector<size_t>
+TransactionQueue::sizeByAge() const
+{
+    std::vector<size_t> sizes;
+    for (auto const& g : mByAge)
+    {
+        sizes.push_back(g.size());
+    }
+    return sizes;
+}
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "herder/TxSetFrame.h"
+#include "transactions/TransactionFrame.h"
+#include "util/HashOfHash.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace medida
+{
+class Histogram;
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Transactions received by the herder and waiting to be included in a
+ * ledger.
+ *
+ * Every transaction is indexed by its full hash (duplicate detection), in its
+ * source account's chain ordered by sequence number (each chain is
+ * contiguous: a transaction is only accepted on top of the account's highest
+ * pending sequence number) and in a global index ordered by fee per
+ * operation, which decides what to evict when the queue is full.
+ *
+ * Transactions age by one every ledger close (`shift`) and are dropped once
+ * they are `pendingDepth` ledgers old. Rather than checking every queued
+ * transaction against the ledger before proposing a set, `revalidate` only
+ * re-checks the chains that a closed ledger may have invalidated: those whose
+ * account (or operation source account) was a source in the applied
+ * transactions, or whose time bounds have expired. A change in the header
+ * fields validity depends on, or a gap in the ledgers seen, re-checks all of
+ * them.
+ */
+class TransactionQueue
+{
+  public:
+    // The queue holds at most QUEUE_SIZE_MULTIPLIER * pendingDepth ledgers
+    // worth of transactions (of the current maximum tx set size).
+    static const uint32_t QUEUE_SIZE_MULTIPLIER;
+
+    TransactionQueue(Application& app, size_t pendingDepth);
+
+    bool contains(Hash const& txHash) const;
+    SequenceNumber getMaxSeq(AccountID const& account) const;
+    int64_t getTotalFees(AccountID const& account) const;
+
+    // Adds a transaction that was validated against getMaxSeq and
+    // getTotalFees of its account. Returns false if the queue is full of
+    // transactions paying at least as much per operation.
+    bool add(TransactionFramePtr tx);
+
+    // Removes transactions (and the ones following them in their account's
+    // chain), e.g. because they were found invalid.
+    void remove(std::vector<TransactionFramePtr> const& txs);
+
+    // Removes the transactions applied by the last ledger and notes which
+    // accounts need to be re-checked.
+    void removeApplied(std::vector<TransactionFramePtr> const& applied);
+
+    // Ages every transaction by one ledger, dropping the oldest generation.
+    void shift();
+
+    // Re-checks the chains that may have been invalidated since the last call
+    // (or all of them) against the last closed ledger, and drops the invalid
+    // transactions.
+    void revalidate(bool all);
+
+    // All pending transactions, as a set sorted for hashing.
+    TxSetFramePtr toTxSet(Hash const& previousLedgerHash) const;
+
+    std::vector<TransactionFramePtr> getTransactions() const;
+
+    // Hash of the message flooding a queued transaction, as recorded by the
+    // overlay.
+    Hash const& getMessageHash(Hash const& txHash) const;
+
+    size_t size() const;
+    // Number of transactions of each age, from the most recent.
+    std::vector<size_t> sizeByAge() const;
+
+  private:
+    struct QueuedTx
+    {
+        TransactionFramePtr mTx;
+        uint64_t mGeneration;
+        double mFeePerOp;
+        Hash mMessageHash;
+    };
+
+    struct AccountTxs
+    {
+        std::map<SequenceNumber, TransactionFramePtr> mChain;
+        int64_t mTotalFees{0};
+    };
+
+    Application& mApp;
+    size_t const mPendingDepth;
+
+    std::unordered_map<Hash, QueuedTx> mTransactions;
+    std::unordered_map<AccountID, AccountTxs> mAccounts;
+    std::set<std::pair<double, Hash>> mByFee;
+    // hashes of the transactions of each generation, most recent first
+    std::deque<std::unordered_set<Hash>> mByAge;
+    uint64_t mGeneration;
+
+    // accounts touched by applied transactions since the last revalidation
+    std::unordered_set<AccountID> mTouched;
+    uint32_t mValidatedLedger;
+    uint32_t mValidatedBaseFee;
+    uint32_t mValidatedBaseReserve;
+    uint32_t mValidatedLedgerVersion;
+
+    medida::Meter& mEvicted;
+    medida::Meter& mInvalidated;
+    medida::Histogram& mAppliedAge;
+
+    size_t getCapacity() const;
+    bool needsRecheck(AccountTxs const& txs, uint64 closeTime) const;
+    // removes txHash and every later transaction of its account
+    size_t removeFrom(TransactionFramePtr const& tx);
+    void eraseTx(Hash const& txHash);
+};
+}
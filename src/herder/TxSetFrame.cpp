@@ -6,12 +6,15 @@
 #include "TxSetFrame.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "xdrpp/printer.h"
 
@@ -133,25 +136,38 @@ TxSetFrame::sortForApply()
     return retList;
 }
 
-struct SurgeSorter
+namespace
 {
-    map<AccountID, double>& mAccountFeeMap;
-    SurgeSorter(map<AccountID, double>& afm) : mAccountFeeMap(afm)
+// the transactions of an account competing for a spot in the set, ranked
+// by the lowest fee ratio among them
+struct SurgeAccount
+{
+    AccountID const* mAccount;
+    double mFeeRatio;
+    vector<size_t> mTxs;
+};
+
+// heap order: the account that should get in first is the largest, ties
+// broken by account id so every node builds the same set
+struct SurgeAccountLess
+{
+    vector<SurgeAccount> const& mAccounts;
+    SurgeAccountLess(vector<SurgeAccount> const& accounts)
+        : mAccounts(accounts)
     {
     }
 
     bool
-    operator()(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
+    operator()(size_t a, size_t b) const
     {
-        if (tx1->getSourceID() == tx2->getSourceID())
-            return tx1->getSeqNum() < tx2->getSeqNum();
-        double fee1 = mAccountFeeMap[tx1->getSourceID()];
-        double fee2 = mAccountFeeMap[tx2->getSourceID()];
-        if (fee1 == fee2)
-            return tx1->getSourceID() < tx2->getSourceID();
-        return fee1 > fee2;
+        auto const& acc1 = mAccounts[a];
+        auto const& acc2 = mAccounts[b];
+        if (acc1.mFeeRatio != acc2.mFeeRatio)
+            return acc1.mFeeRatio < acc2.mFeeRatio;
+        return *acc2.mAccount < *acc1.mAccount;
     }
 };
+}
 
 void
 TxSetFrame::surgePricingFilter(LedgerManager const& lm)
@@ -162,27 +178,75 @@ TxSetFrame::surgePricingFilter(LedgerManager const& lm)
         CLOG(WARNING, "Herder") << "surge pricing in effect! "
                                 << mTransactions.size();
 
-        // determine the fee ratio for each account
-        map<AccountID, double> accountFeeMap;
-        for (auto& tx : mTransactions)
+        // group the transactions by account, with the fee ratio of each
+        // account
+        vector<SurgeAccount> accounts;
+        unordered_map<AccountID, size_t> accountIndex;
+        for (size_t i = 0; i < mTransactions.size(); i++)
         {
+            auto const& tx = mTransactions[i];
             double r = tx->getFeeRatio(lm);
-            double now = accountFeeMap[tx->getSourceID()];
-            if (now == 0)
-                accountFeeMap[tx->getSourceID()] = r;
-            else if (r < now)
-                accountFeeMap[tx->getSourceID()] = r;
+            auto res = accountIndex.insert(
+                make_pair(tx->getSourceID(), accounts.size()));
+            if (res.second)
+            {
+                accounts.emplace_back();
+                accounts.back().mAccount = &res.first->first;
+                accounts.back().mFeeRatio = r;
+            }
+            auto& acc = accounts[res.first->second];
+            if (r < acc.mFeeRatio)
+                acc.mFeeRatio = r;
+            acc.mTxs.push_back(i);
         }
 
-        // sort tx by amount of fee they have paid
-        // remove the bottom that aren't paying enough
-        std::vector<TransactionFramePtr> tempList = mTransactions;
-        std::sort(tempList.begin(), tempList.end(), SurgeSorter(accountFeeMap));
+        // take the best paying accounts until the set is full, only sorting
+        // as many as needed
+        vector<size_t> heap(accounts.size());
+        for (size_t i = 0; i < heap.size(); i++)
+            heap[i] = i;
+        SurgeAccountLess less(accounts);
+        std::make_heap(heap.begin(), heap.end(), less);
+
+        auto seqLess = [this](size_t a, size_t b) {
+            return mTransactions[a]->getSeqNum() <
+                   mTransactions[b]->getSeqNum();
+        };
+
+        vector<bool> keep(mTransactions.size(), false);
+        size_t remaining = max;
+        while (remaining > 0 && !heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), less);
+            auto& txs = accounts[heap.back()].mTxs;
+            heap.pop_back();
 
-        for (auto iter = tempList.begin() + max; iter != tempList.end(); iter++)
+            if (txs.size() > remaining)
+            {
+                // the last account to get in only keeps its lowest
+                // sequence numbers
+                std::nth_element(txs.begin(), txs.begin() + remaining,
+                                 txs.end(), seqLess);
+                txs.resize(remaining);
+            }
+            for (auto i : txs)
+                keep[i] = true;
+            remaining -= txs.size();
+        }
+
+        // drop the others in a single pass, preserving the order
+        size_t kept = 0;
+        for (size_t i = 0; i < mTransactions.size(); i++)
         {
-            removeTx(*iter);
+            if (keep[i])
+            {
+                if (kept != i)
+                    mTransactions[kept] = std::move(mTransactions[i]);
+                kept++;
+            }
         }
+        mTransactions.resize(kept);
+        mHashIsValid = false;
     }
 }
 
@@ -197,6 +261,7 @@ TxSetFrame::trimInvalid(Application& app,
     sortForHash();
 
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
+    unordered_set<TransactionFramePtr> removed;
 
     for (auto tx : mTransactions)
     {
@@ -216,7 +281,7 @@ TxSetFrame::trimInvalid(Application& app,
             if (!tx->checkValid(app, lastSeq))
             {
                 trimmed.push_back(tx);
-                removeTx(tx);
+                removed.insert(tx);
                 continue;
             }
             totFee += tx->getFee();
@@ -235,11 +300,22 @@ TxSetFrame::trimInvalid(Application& app,
                 for (auto& tx : item.second)
                 {
                     trimmed.push_back(tx);
-                    removeTx(tx);
+                    removed.insert(tx);
                 }
             }
         }
     }
+
+    if (!removed.empty())
+    {
+        mTransactions.erase(
+            std::remove_if(mTransactions.begin(), mTransactions.end(),
+                           [&removed](TransactionFramePtr const& tx) {
+                               return removed.find(tx) != removed.end();
+                           }),
+            mTransactions.end());
+        mHashIsValid = false;
+    }
 }
 
 // need to make sure every account that is submitting a tx has enough to pay
@@ -18,9 +18,12 @@
 #include "process/ProcessManager.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/basen.h"
 #include "util/make_unique.h"
 #include <cereal/archives/json.hpp>
+#include <cereal/archives/portable_binary.hpp>
 #include <cereal/cereal.hpp>
+#include <cereal/types/string.hpp>
 #include <cereal/types/vector.hpp>
 
 #include <chrono>
@@ -132,6 +135,56 @@ HistoryArchiveState::fromString(std::string const& str)
     assert(futuresAllResolved());
 }
 
+std::string
+HistoryArchiveState::toBinaryString() const
+{
+    std::ostringstream out;
+    {
+        cereal::PortableBinaryOutputArchive ar(out);
+        serialize(ar);
+    }
+    return bn::encode_b64(out.str());
+}
+
+void
+HistoryArchiveState::fromBinaryString(std::string const& str)
+{
+    std::string bin;
+    bn::decode_b64(str, bin);
+    std::istringstream in(bin);
+    cereal::PortableBinaryInputArchive ar(in);
+    serialize(ar);
+    if (version != HISTORY_ARCHIVE_STATE_VERSION)
+    {
+        CLOG(ERROR, "History") << "unexpected history archive state version: "
+                               << version;
+        throw std::runtime_error("unexpected history archive state version");
+    }
+}
+
+std::string
+HistoryArchiveState::levelToBinaryString(HistoryStateBucket const& level)
+{
+    std::ostringstream out;
+    {
+        cereal::PortableBinaryOutputArchive ar(out);
+        level.serialize(ar);
+    }
+    return bn::encode_b64(out.str());
+}
+
+HistoryStateBucket
+HistoryArchiveState::levelFromBinaryString(std::string const& str)
+{
+    std::string bin;
+    bn::decode_b64(str, bin);
+    std::istringstream in(bin);
+    cereal::PortableBinaryInputArchive ar(in);
+    HistoryStateBucket level;
+    level.serialize(ar);
+    return level;
+}
+
 std::string
 HistoryArchiveState::baseName()
 {
@@ -281,8 +334,15 @@ HistoryArchiveState::HistoryArchiveState(uint32_t ledgerSeq,
 HistoryArchive::HistoryArchive(std::string const& name,
                                std::string const& getCmd,
                                std::string const& putCmd,
-                               std::string const& mkdirCmd)
-    : mName(name), mGetCmd(getCmd), mPutCmd(putCmd), mMkdirCmd(mkdirCmd)
+                               std::string const& mkdirCmd,
+                               std::string const& url,
+                               std::string const& helperCmd)
+    : mName(name)
+    , mGetCmd(getCmd)
+    , mPutCmd(putCmd)
+    , mMkdirCmd(mkdirCmd)
+    , mUrl(url)
+    , mHelperCmd(helperCmd)
 {
 }
 
@@ -293,7 +353,13 @@ HistoryArchive::~HistoryArchive()
 bool
 HistoryArchive::hasGetCmd() const
 {
-    return !mGetCmd.empty();
+    return !mGetCmd.empty() || !mUrl.empty();
+}
+
+bool
+HistoryArchive::hasGetUrl() const
+{
+    return !mUrl.empty();
 }
 
 bool
@@ -314,6 +380,12 @@ HistoryArchive::getName() const
     return mName;
 }
 
+std::string const&
+HistoryArchive::getHelperCmd() const
+{
+    return mHelperCmd;
+}
+
 std::string
 HistoryArchive::getFileCmd(std::string const& remote,
                            std::string const& local) const
@@ -339,4 +411,14 @@ HistoryArchive::mkdirCmd(std::string const& remoteDir) const
         return "";
     return fmt::format(mMkdirCmd, remoteDir);
 }
+
+std::string
+HistoryArchive::getFileUrl(std::string const& remote) const
+{
+    if (mUrl.empty())
+        return "";
+    if (mUrl.back() == '/')
+        return mUrl + remote;
+    return mUrl + "/" + remote;
+}
 }
@@ -47,9 +47,10 @@ struct HistoryStateBucket
 /**
  * A snapshot of a ledger number and associated set of buckets; this is used
  * when writing to HistoryArchives as well as when persisting the state of the
- * BucketList to the local database, as PersistentState kHistoryArchiveState. It
- * might reasonably be renamed BucketListState or similar, since it really only
- * describes a BucketList, not an entire HistoryArchive.
+ * BucketList to the local database, level by level in binary (and, at
+ * checkpoints, as PersistentState kHistoryArchiveState). It might reasonably
+ * be renamed BucketListState or similar, since it really only describes a
+ * BucketList, not an entire HistoryArchive.
  */
 struct HistoryArchiveState
 {
@@ -124,6 +125,15 @@ struct HistoryArchiveState
 
     std::string toString() const;
     void fromString(std::string const& str);
+
+    // Compact binary encoding (base64-encoded, to fit in text columns) used
+    // to persist states locally; JSON remains the format of history archives.
+    std::string toBinaryString() const;
+    void fromBinaryString(std::string const& str);
+
+    // Same encoding, for a single level.
+    static std::string levelToBinaryString(HistoryStateBucket const& level);
+    static HistoryStateBucket levelFromBinaryString(std::string const& str);
 };
 
 class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
@@ -132,20 +142,33 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
     std::string mGetCmd;
     std::string mPutCmd;
     std::string mMkdirCmd;
+    std::string mUrl;
+    std::string mHelperCmd;
 
   public:
+    // `url`, if set, is an http:// base url the archive is read from
+    // in-process (see HttpArchiveFetcher) instead of through `getCmd`.
+    // `helperCmd`, if set, starts persistent helper processes the get, put
+    // and mkdir commands are sent to instead of being spawned each (see
+    // ProcessManager::runOnHelper).
     HistoryArchive(std::string const& name, std::string const& getCmd,
-                   std::string const& putCmd, std::string const& mkdirCmd);
+                   std::string const& putCmd, std::string const& mkdirCmd,
+                   std::string const& url = "",
+                   std::string const& helperCmd = "");
     ~HistoryArchive();
+    // True if the archive is readable, by get command or by url.
     bool hasGetCmd() const;
+    bool hasGetUrl() const;
     bool hasPutCmd() const;
     bool hasMkdirCmd() const;
     std::string const& getName() const;
+    std::string const& getHelperCmd() const;
 
     std::string getFileCmd(std::string const& remote,
                            std::string const& local) const;
     std::string putFileCmd(std::string const& local,
                            std::string const& remote) const;
     std::string mkdirCmd(std::string const& remoteDir) const;
+    std::string getFileUrl(std::string const& remote) const;
 };
 }
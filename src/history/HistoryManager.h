@@ -179,6 +179,7 @@ class BucketList;
 class Config;
 class Database;
 class HistoryArchive;
+class HttpArchiveFetcher;
 struct StateSnapshot;
 
 class HistoryManager
@@ -289,8 +290,9 @@ class HistoryManager
     // returns 0 if the publish queue has nothing in it.
     virtual uint32_t getMaxLedgerQueuedToPublish() = 0;
 
-    // Publish any checkpoints queued (in the database) for publication.
-    // Returns the number of publishes initiated.
+    // Publish any checkpoints queued (in the database) for publication, the
+    // oldest ones first and several of them together. Returns the number of
+    // checkpoints being published.
     virtual size_t publishQueuedHistory() = 0;
 
     // Return the set of buckets referenced by the persistent (DB) publish
@@ -299,9 +301,8 @@ class HistoryManager
     virtual std::vector<std::string>
     getMissingBucketsReferencedByPublishQueue() = 0;
 
-    // Return the set of buckets referenced by the persistent (DB) publish
-    // queue.
-    virtual std::vector<std::string> getBucketsReferencedByPublishQueue() = 0;
+    // Return the states in the persistent (DB) publish queue.
+    virtual std::vector<HistoryArchiveState> getPublishQueueStates() = 0;
 
     // Callback from Publication, indicates that a given snapshot was
     // published. The `success` parameter indicates whether _all_ the
@@ -320,6 +321,10 @@ class HistoryManager
     // Infer a quorum set by reading SCP messages in history archives.
     virtual InferredQuorum inferQuorum() = 0;
 
+    // Return the in-process downloader used for archives configured with an
+    // http:// url.
+    virtual HttpArchiveFetcher& getHttpArchiveFetcher() = 0;
+
     // Return the name of the HistoryManager's tmpdir (used for storing files in
     // transit).
     virtual std::string const& getTmpDir() = 0;
@@ -14,6 +14,7 @@
 #include "herder/HerderImpl.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryManagerImpl.h"
+#include "history/HttpArchiveFetcher.h"
 #include "history/StateSnapshot.h"
 #include "historywork/FetchRecentQsetsWork.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
@@ -26,6 +27,7 @@
 #include "main/Config.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/StellarXDR.h"
 #include "process/ProcessManager.h"
 #include "util/Logging.h"
@@ -49,6 +51,9 @@ static string kSQLCreateStatement = "CREATE TABLE IF NOT EXISTS publishqueue ("
                                     "state    TEXT"
                                     "); ";
 
+// Most queued checkpoints published by a single PublishWork.
+static const size_t kMaxPublishBatch = 16;
+
 void
 HistoryManager::dropAll(Database& db)
 {
@@ -211,6 +216,7 @@ HistoryManager::checkSensibleConfig(Config const& cfg)
 HistoryManagerImpl::HistoryManagerImpl(Application& app)
     : mApp(app)
     , mWorkDir(nullptr)
+    , mHttpArchiveFetcher(make_unique<HttpArchiveFetcher>(app))
     , mPublishWork(nullptr)
 
     , mPublishSkip(
@@ -225,6 +231,8 @@ HistoryManagerImpl::HistoryManagerImpl(Application& app)
           app.getMetrics().NewMeter({"history", "publish", "success"}, "event"))
     , mPublishFailure(
           app.getMetrics().NewMeter({"history", "publish", "failure"}, "event"))
+    , mPublishLatency(
+          app.getMetrics().NewTimer({"history", "publish", "latency"}))
 {
 }
 
@@ -292,7 +300,8 @@ HistoryManagerImpl::logAndUpdateStatus(bool contiguous)
     else if (mPublishWork)
     {
         auto qlen = publishQueueLength();
-        stateStr << "Publishing " << qlen << " queued checkpoints"
+        stateStr << "Publishing " << mPublishing.size() << " of " << qlen
+                 << " queued checkpoints"
                  << " [" << getMinLedgerQueuedToPublish() << "-"
                  << getMaxLedgerQueuedToPublish() << "]"
                  << ": " << mPublishWork->getStatus();
@@ -339,6 +348,12 @@ HistoryManagerImpl::getTmpDir()
     return mWorkDir->getName();
 }
 
+HttpArchiveFetcher&
+HistoryManagerImpl::getHttpArchiveFetcher()
+{
+    return *mHttpArchiveFetcher;
+}
+
 std::string
 HistoryManagerImpl::localFilename(std::string const& basename)
 {
@@ -495,7 +510,8 @@ HistoryManagerImpl::queueCurrentHistory()
 
     auto ledger = has.currentLedger;
     CLOG(DEBUG, "History") << "Queueing publish state for ledger " << ledger;
-    auto state = has.toString();
+    auto state = has.toBinaryString();
+    mApp.getBucketManager().addPublishQueueReferences(has);
     auto timer = mApp.getDatabase().getInsertTimer("publishqueue");
     auto prep = mApp.getDatabase().getPreparedStatement(
         "INSERT INTO publishqueue (ledger, state) VALUES (:lg, :st);");
@@ -514,46 +530,100 @@ HistoryManagerImpl::queueCurrentHistory()
     // merges-in-progress, avoid restarting them.
 
     mPublishQueue.Mark();
-    takeSnapshotAndPublish(has);
-}
-
-void
-HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
-{
+    mPublishQueuedTimes[ledger] = mApp.getClock().now();
     if (mPublishWork)
     {
         mPublishDelay.Mark();
         return;
     }
-    auto ledgerSeq = has.currentLedger;
-    CLOG(DEBUG, "History") << "Activating publish for ledger " << ledgerSeq;
-    auto snap = std::make_shared<StateSnapshot>(mApp, has);
+    auto states = loadPublishBatch();
+    for (auto& s : states)
+    {
+        if (s.currentLedger == ledger)
+        {
+            s = has;
+        }
+    }
+    takeSnapshotAndPublish(states);
+}
 
-    mPublishWork = mApp.getWorkManager().addWork<PublishWork>(snap);
-    mApp.getWorkManager().advanceChildren();
+// Queued states are stored in binary; older versions stored them as JSON.
+static HistoryArchiveState
+parseQueuedState(std::string const& state)
+{
+    HistoryArchiveState has;
+    if (!state.empty() && state[0] == '{')
+    {
+        has.fromString(state);
+    }
+    else
+    {
+        has.fromBinaryString(state);
+    }
+    return has;
 }
 
-size_t
-HistoryManagerImpl::publishQueuedHistory()
+std::vector<HistoryArchiveState>
+HistoryManagerImpl::loadPublishBatch()
 {
+    std::vector<HistoryArchiveState> states;
     std::string state;
-
     auto prep = mApp.getDatabase().getPreparedStatement(
         "SELECT state FROM publishqueue"
-        " ORDER BY ledger ASC LIMIT 1;");
+        " ORDER BY ledger ASC LIMIT :lim;");
     auto& st = prep.statement();
-    soci::indicator stateIndicator;
-    st.exchange(soci::into(state, stateIndicator));
+    int limit = static_cast<int>(kMaxPublishBatch);
+    st.exchange(soci::into(state));
+    st.exchange(soci::use(limit));
     st.define_and_bind();
     st.execute(true);
-    if (st.got_data() && stateIndicator == soci::indicator::i_ok)
+    while (st.got_data())
     {
-        HistoryArchiveState has;
-        has.fromString(state);
-        takeSnapshotAndPublish(has);
-        return 1;
+        states.emplace_back();
+        states.back() = parseQueuedState(state);
+        st.fetch();
     }
-    return 0;
+    return states;
+}
+
+void
+HistoryManagerImpl::takeSnapshotAndPublish(
+    std::vector<HistoryArchiveState> const& states)
+{
+    assert(!mPublishWork);
+    if (states.empty())
+    {
+        return;
+    }
+    std::vector<std::shared_ptr<StateSnapshot>> snaps;
+    for (auto const& has : states)
+    {
+        auto ledgerSeq = has.currentLedger;
+        CLOG(DEBUG, "History") << "Activating publish for ledger "
+                               << ledgerSeq;
+        snaps.push_back(std::make_shared<StateSnapshot>(mApp, has));
+        mPublishing.insert(ledgerSeq);
+        if (mPublishQueuedTimes.find(ledgerSeq) == mPublishQueuedTimes.end())
+        {
+            mPublishQueuedTimes[ledgerSeq] = mApp.getClock().now();
+        }
+        mPublishStart.Mark();
+    }
+
+    mPublishWork = mApp.getWorkManager().addWork<PublishWork>(snaps);
+    mApp.getWorkManager().advanceChildren();
+}
+
+size_t
+HistoryManagerImpl::publishQueuedHistory()
+{
+    if (mPublishWork)
+    {
+        return mPublishing.size();
+    }
+    auto states = loadPublishBatch();
+    takeSnapshotAndPublish(states);
+    return states.size();
 }
 
 std::vector<HistoryArchiveState>
@@ -570,25 +640,12 @@ HistoryManagerImpl::getPublishQueueStates()
     while (st.got_data())
     {
         states.emplace_back();
-        states.back().fromString(state);
+        states.back() = parseQueuedState(state);
         st.fetch();
     }
     return states;
 }
 
-std::vector<std::string>
-HistoryManagerImpl::getBucketsReferencedByPublishQueue()
-{
-    auto states = getPublishQueueStates();
-    std::set<std::string> buckets;
-    for (auto const& s : states)
-    {
-        auto sb = s.allBuckets();
-        buckets.insert(sb.begin(), sb.end());
-    }
-    return std::vector<std::string>(buckets.begin(), buckets.end());
-}
-
 std::vector<std::string>
 HistoryManagerImpl::getMissingBucketsReferencedByPublishQueue()
 {
@@ -608,6 +665,33 @@ HistoryManagerImpl::historyPublished(uint32_t ledgerSeq, bool success)
     if (success)
     {
         this->mPublishSuccess.Mark();
+        auto i = mPublishQueuedTimes.find(ledgerSeq);
+        if (i != mPublishQueuedTimes.end())
+        {
+            mPublishLatency.Update(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    mApp.getClock().now() - i->second));
+            mPublishQueuedTimes.erase(i);
+        }
+
+        std::string state;
+        {
+            auto prep = mApp.getDatabase().getPreparedStatement(
+                "SELECT state FROM publishqueue WHERE ledger = :lg;");
+            auto& st = prep.statement();
+            st.exchange(soci::into(state));
+            st.exchange(soci::use(ledgerSeq));
+            st.define_and_bind();
+            st.execute(true);
+            if (st.got_data())
+            {
+                // The buckets it references can be forgotten once no longer
+                // in the BucketList.
+                mApp.getBucketManager().removePublishQueueReferences(
+                    parseQueuedState(state));
+            }
+        }
+
         auto timer = mApp.getDatabase().getDeleteTimer("publishqueue");
         auto prep = mApp.getDatabase().getPreparedStatement(
             "DELETE FROM publishqueue WHERE ledger = :lg;");
@@ -620,6 +704,11 @@ HistoryManagerImpl::historyPublished(uint32_t ledgerSeq, bool success)
     {
         this->mPublishFailure.Mark();
     }
+    mPublishing.erase(ledgerSeq);
+    if (!mPublishing.empty())
+    {
+        return;
+    }
     mPublishWork.reset();
     mApp.getClock().getIOService().post(
         [this]() { this->publishQueuedHistory(); });
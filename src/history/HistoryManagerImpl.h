@@ -5,12 +5,16 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "history/HistoryManager.h"
+#include "util/Timer.h"
 #include "util/TmpDir.h"
+#include <map>
 #include <memory>
+#include <set>
 
 namespace medida
 {
 class Meter;
+class Timer;
 }
 
 namespace stellar
@@ -23,14 +27,23 @@ class HistoryManagerImpl : public HistoryManager
 {
     Application& mApp;
     std::unique_ptr<TmpDir> mWorkDir;
+    std::unique_ptr<HttpArchiveFetcher> mHttpArchiveFetcher;
     std::shared_ptr<Work> mPublishWork;
 
+    // Checkpoints of the running publish, and when each was first seen in the
+    // queue (queued by this process or loaded from the database on restart).
+    std::set<uint32_t> mPublishing;
+    std::map<uint32_t, VirtualClock::time_point> mPublishQueuedTimes;
+
     medida::Meter& mPublishSkip;
     medida::Meter& mPublishQueue;
     medida::Meter& mPublishDelay;
     medida::Meter& mPublishStart;
     medida::Meter& mPublishSuccess;
     medida::Meter& mPublishFailure;
+    medida::Timer& mPublishLatency;
+
+    std::vector<HistoryArchiveState> loadPublishBatch();
 
   public:
     HistoryManagerImpl(Application& app);
@@ -52,7 +65,8 @@ class HistoryManagerImpl : public HistoryManager
 
     void queueCurrentHistory() override;
 
-    void takeSnapshotAndPublish(HistoryArchiveState const& has);
+    void
+    takeSnapshotAndPublish(std::vector<HistoryArchiveState> const& states);
 
     bool hasAnyWritableHistoryArchive() override;
 
@@ -65,9 +79,7 @@ class HistoryManagerImpl : public HistoryManager
     std::vector<std::string>
     getMissingBucketsReferencedByPublishQueue() override;
 
-    std::vector<std::string> getBucketsReferencedByPublishQueue() override;
-
-    std::vector<HistoryArchiveState> getPublishQueueStates();
+    std::vector<HistoryArchiveState> getPublishQueueStates() override;
 
     void historyPublished(uint32_t ledgerSeq, bool success) override;
 
@@ -79,6 +91,8 @@ class HistoryManagerImpl : public HistoryManager
 
     InferredQuorum inferQuorum() override;
 
+    HttpArchiveFetcher& getHttpArchiveFetcher() override;
+
     std::string const& getTmpDir() override;
 
     std::string localFilename(std::string const& basename) override;
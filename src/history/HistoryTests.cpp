@@ -6,6 +6,7 @@
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
+#include "database/Database.h"
 #include "herder/LedgerCloseData.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
@@ -13,12 +14,17 @@
 #include "historywork/GunzipFileWork.h"
 #include "historywork/GzipFileWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
+#include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
-#include "main/ExternalQueue.h"
+#include "main/Maintainer.h"
 #include "main/PersistentState.h"
+#include "main/replay.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "process/ProcessManager.h"
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
@@ -250,6 +256,30 @@ TEST_CASE_METHOD(HistoryTests, "HistoryArchiveState::get_put", "[history]")
     REQUIRE(has2.currentLedger == 0x1234);
 }
 
+TEST_CASE_METHOD(HistoryTests, "HistoryArchiveState binary encoding",
+                 "[history]")
+{
+    generateAndPublishInitialHistory(1);
+
+    HistoryArchiveState has(app.getLedgerManager().getLastClosedLedgerNum(),
+                            app.getBucketManager().getBucketList());
+    has.resolveAllFutures();
+
+    HistoryArchiveState has2;
+    has2.fromBinaryString(has.toBinaryString());
+    REQUIRE(has2.toString() == has.toString());
+    REQUIRE(has.toBinaryString().size() < has.toString().size());
+
+    for (auto const& level : has.currentBuckets)
+    {
+        auto level2 = HistoryArchiveState::levelFromBinaryString(
+            HistoryArchiveState::levelToBinaryString(level));
+        REQUIRE(level2.curr == level.curr);
+        REQUIRE(level2.snap == level.snap);
+        REQUIRE(level2.next.getHashes() == level.next.getHashes());
+    }
+}
+
 extern LedgerEntry generateValidLedgerEntry();
 
 void
@@ -599,6 +629,60 @@ TEST_CASE_METHOD(HistoryTests, "History publish", "[history]")
     generateAndPublishInitialHistory(1);
 }
 
+TEST_CASE_METHOD(HistoryTests, "replay from within a checkpoint",
+                 "[history][replay]")
+{
+    generateAndPublishInitialHistory(4);
+
+    // 150 is in the checkpoint [128, 191]: replay has to start from 128,
+    // after catching up to 127, and run to the end of the checkpoint of 180
+    TmpDirManager tdm("replay");
+    TmpDir td = tdm.tmpDir("report");
+    std::string reportFile = td.getName() + "/report.json";
+    REQUIRE(replay(getTestConfig(1), mConfigurator->getArchiveDirName(), 150,
+                   180, reportFile) == 0);
+
+    std::ifstream in(reportFile);
+    Json::Reader reader;
+    Json::Value report;
+    REQUIRE(reader.parse(in, report));
+    CHECK(report["first"].asUInt() == 128);
+    CHECK(report["last"].asUInt() == 191);
+    auto const& ledgers = report["ledgers"];
+    REQUIRE(ledgers.size() == 64);
+    CHECK(ledgers[0]["ledger"].asUInt() == 128);
+    CHECK(ledgers[ledgers.size() - 1]["ledger"].asUInt() == 191);
+}
+
+TEST_CASE_METHOD(HistoryTests, "apply by stage matches the published history",
+                 "[history][applystages]")
+{
+    generateAndPublishInitialHistory(2);
+
+    // replay every ledger of the history on a node applying transactions in
+    // stage order, which must yield the same results and ledgers
+    Config cfg2(getTestConfig(1));
+    cfg2.ARTIFICIALLY_APPLY_BY_STAGE_FOR_TESTING = true;
+    Application::pointer app2 =
+        Application::create(clock, mConfigurator->configure(cfg2, false));
+    app2->start();
+
+    auto& lm2 = app2->getLedgerManager();
+    for (auto const& lcd : mLedgerCloseDatas)
+    {
+        lm2.closeLedger(lcd);
+
+        auto want = LedgerHeaderFrame::loadBySequence(
+            lcd.getLedgerSeq(), app.getDatabase(),
+            app.getDatabase().getSession());
+        REQUIRE(want);
+        auto const& have = lm2.getLastClosedLedgerHeader();
+        REQUIRE(have.header.ledgerSeq == lcd.getLedgerSeq());
+        REQUIRE(have.header.txSetResultHash == want->mHeader.txSetResultHash);
+        REQUIRE(have.hash == want->getHash());
+    }
+}
+
 static std::string
 resumeModeName(CatchupManager::CatchupMode mode)
 {
@@ -941,8 +1025,11 @@ TEST_CASE("persist publish queue", "[history]")
         LOG(INFO) << app0->isStopping();
 
         // Trim history after publishing.
-        ExternalQueue ps(*app0);
-        ps.process();
+        app0->maintenance();
+        while (app0->getMaintainer().isRunning())
+        {
+            clock.crank(true);
+        }
     }
 
     cfg.MAX_CONCURRENT_SUBPROCESSES = 32;
@@ -955,13 +1042,14 @@ TEST_CASE("persist publish queue", "[history]")
             clock.crank(false);
         app1->start();
         auto& hm1 = app1->getHistoryManager();
+        // The queued checkpoints are published together.
+        CHECK(hm1.getPublishStartCount() == hm1.publishQueueLength());
         while (hm1.getPublishSuccessCount() < 5)
         {
             clock.crank(true);
 
             // Trim history after publishing whenever possible.
-            ExternalQueue ps(*app1);
-            ps.process();
+            app1->maintenance();
         }
         // We should have either an empty publish queue or a
         // ledger sometime after the 5th checkpoint
@@ -969,6 +1057,9 @@ TEST_CASE("persist publish queue", "[history]")
         LOG(INFO) << "minLedger " << minLedger;
         bool okQueue = minLedger == 0 || minLedger >= 35;
         CHECK(okQueue);
+        auto& latency =
+            app1->getMetrics().NewTimer({"history", "publish", "latency"});
+        CHECK(latency.count() == hm1.getPublishSuccessCount());
         clock.cancelAllEvents();
         while (clock.cancelAllEvents() ||
                app1->getProcessManager().getNumRunningProcesses() > 0)
@@ -988,6 +1079,59 @@ TEST_CASE("persist publish queue", "[history]")
 // (Both the hard-failure and the clear/reset weren't working when this
 // test was written)
 
+TEST_CASE("history maintenance on sqlite", "[history][maintenance]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+    cfg.MAINTENANCE_LEDGERS_PER_CHUNK = 4;
+    Application::pointer app = Application::create(clock, cfg);
+    for (uint32_t i = 2; i < 40; ++i)
+    {
+        closeLedgerOn(*app, i, 1 + i % 28, 1 + i / 28, 2017);
+    }
+
+    auto& db = app->getDatabase();
+    auto countHeaders = [&db]() -> int {
+        int n = 0;
+        db.getSession() << "SELECT COUNT(*) FROM ledgerheaders;",
+            soci::into(n);
+        return n;
+    };
+    auto& maintainer = app->getMaintainer();
+    auto runMaintenance = [&]() {
+        REQUIRE(maintainer.performMaintenance());
+        while (maintainer.isRunning())
+        {
+            clock.crank(false);
+        }
+    };
+    auto before = countHeaders();
+
+    SECTION("fails cleanly while the database is locked")
+    {
+        // another connection holds the write lock, as ledger close would
+        soci::session other(cfg.DATABASE.value);
+        other << "BEGIN IMMEDIATE;";
+        db.getSession() << "PRAGMA busy_timeout = 0;";
+        runMaintenance();
+        other << "ROLLBACK;";
+        REQUIRE(countHeaders() == before);
+
+        // and runs again afterwards
+        runMaintenance();
+        REQUIRE(countHeaders() < before);
+    }
+
+    SECTION("runs within a transaction of the main connection")
+    {
+        soci::transaction tx(db.getSession());
+        runMaintenance();
+        tx.commit();
+        REQUIRE(countHeaders() < before);
+    }
+}
+
 TEST_CASE_METHOD(HistoryTests, "too far behind / catchup restart",
                  "[history][catchupstall]")
 {
@@ -0,0 +1,661 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/HttpArchiveFetcher.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace stellar
+{
+
+using asio::ip::tcp;
+
+// Largest response head accepted; longer ones are most likely not http.
+static size_t const MAX_HEAD_SIZE = 64 * 1024;
+
+struct FetchRequest
+{
+    std::string mPath;
+    std::string mLocalFile;
+    HttpArchiveFetcher::Handler mHandler;
+    bool mRetried;
+};
+
+class HttpArchiveConnection
+    : public std::enable_shared_from_this<HttpArchiveConnection>
+{
+  public:
+    HttpArchiveConnection(asio::io_service& ioService,
+                          std::weak_ptr<HttpArchiveFetcher::Host> host,
+                          std::chrono::seconds timeout);
+
+    void start(FetchRequest&& req);
+    void close();
+
+  private:
+    void connect();
+    void sendRequest();
+    void readHead();
+    bool parseHead(std::string const& head);
+    void readBody();
+    void writeBody(char const* data, size_t size);
+    void finish(asio::error_code ec);
+
+    // Each step of a request (resolving, connecting, writing, every read)
+    // has to complete within mTimeout, or the request fails.
+    void armDeadline();
+    void timedOut();
+
+    std::weak_ptr<HttpArchiveFetcher::Host> mHost;
+    tcp::socket mSocket;
+    tcp::resolver mResolver;
+    asio::steady_timer mDeadline;
+    std::chrono::seconds const mTimeout;
+    bool mTimedOut{false};
+    bool mConnected{false};
+    size_t mServed{0};
+
+    FetchRequest mRequest;
+    std::string mRequestText;
+    asio::streambuf mResponse;
+    std::vector<char> mBuffer;
+    std::ofstream mOut;
+    bool mGotResponse{false};
+    bool mHasLength{false};
+    uint64_t mRemaining{0};
+    bool mKeepAlive{false};
+};
+
+class HttpArchiveFetcher::Host : public std::enable_shared_from_this<Host>
+{
+    Application& mApp;
+    std::deque<FetchRequest> mQueue;
+    std::vector<std::shared_ptr<HttpArchiveConnection>> mIdle;
+    std::vector<std::shared_ptr<HttpArchiveConnection>> mBusy;
+
+    void dispatch();
+
+  public:
+    Host(Application& app, std::string const& host, unsigned short port);
+    ~Host();
+
+    void enqueue(FetchRequest&& req, bool front);
+    void onDone(std::shared_ptr<HttpArchiveConnection> conn, bool reusable);
+
+    std::string const mHostName;
+    unsigned short const mPort;
+    medida::Meter& mConnectMeter;
+    medida::Meter& mRequestMeter;
+    medida::Meter& mFailureMeter;
+};
+
+static std::string
+toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+static std::string
+trim(std::string const& s)
+{
+    auto b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+    {
+        return "";
+    }
+    auto e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+HttpArchiveConnection::HttpArchiveConnection(
+    asio::io_service& ioService, std::weak_ptr<HttpArchiveFetcher::Host> host,
+    std::chrono::seconds timeout)
+    : mHost(host)
+    , mSocket(ioService)
+    , mResolver(ioService)
+    , mDeadline(ioService)
+    , mTimeout(timeout)
+    , mResponse(MAX_HEAD_SIZE)
+    , mBuffer(64 * 1024)
+{
+}
+
+void
+HttpArchiveConnection::start(FetchRequest&& req)
+{
+    mRequest = std::move(req);
+    mResponse.consume(mResponse.size());
+    mGotResponse = false;
+    mHasLength = false;
+    mRemaining = 0;
+    mKeepAlive = false;
+    mTimedOut = false;
+    if (mConnected)
+    {
+        sendRequest();
+    }
+    else
+    {
+        connect();
+    }
+}
+
+void
+HttpArchiveConnection::close()
+{
+    asio::error_code ec;
+    mDeadline.cancel(ec);
+    mResolver.cancel();
+    mSocket.close(ec);
+    mConnected = false;
+    mServed = 0;
+}
+
+void
+HttpArchiveConnection::armDeadline()
+{
+    mDeadline.expires_from_now(mTimeout);
+    std::weak_ptr<HttpArchiveConnection> weak = shared_from_this();
+    mDeadline.async_wait([weak](asio::error_code const& ec) {
+        auto self = weak.lock();
+        if (ec || !self || !self->mRequest.mHandler)
+        {
+            return;
+        }
+        // re-armed after this expiry was queued
+        if (self->mDeadline.expires_at() >
+            asio::steady_timer::clock_type::now())
+        {
+            return;
+        }
+        self->timedOut();
+    });
+}
+
+void
+HttpArchiveConnection::timedOut()
+{
+    if (auto host = mHost.lock())
+    {
+        CLOG(DEBUG, "History") << "Timed out fetching " << mRequest.mPath
+                               << " from " << host->mHostName;
+    }
+    // fails the pending operation, whose handler finishes the request
+    mTimedOut = true;
+    asio::error_code ec;
+    mResolver.cancel();
+    mSocket.close(ec);
+}
+
+void
+HttpArchiveConnection::connect()
+{
+    auto host = mHost.lock();
+    if (!host)
+    {
+        return;
+    }
+
+    auto self = shared_from_this();
+    armDeadline();
+    tcp::resolver::query query(host->mHostName, std::to_string(host->mPort));
+    mResolver.async_resolve(query, [self](asio::error_code const& ec,
+                                          tcp::resolver::iterator it) {
+        if (ec)
+        {
+            self->finish(ec);
+            return;
+        }
+        asio::async_connect(
+            self->mSocket, it,
+            [self](asio::error_code const& ec, tcp::resolver::iterator) {
+                if (ec)
+                {
+                    self->finish(ec);
+                    return;
+                }
+                self->mConnected = true;
+                if (auto host = self->mHost.lock())
+                {
+                    host->mConnectMeter.Mark();
+                }
+                self->sendRequest();
+            });
+    });
+}
+
+void
+HttpArchiveConnection::sendRequest()
+{
+    auto host = mHost.lock();
+    if (!host)
+    {
+        return;
+    }
+
+    mRequestText = fmt::format("GET {:s} HTTP/1.1\r\n"
+                               "Host: {:s}:{:d}\r\n"
+                               "Accept: */*\r\n"
+                               "Connection: keep-alive\r\n\r\n",
+                               mRequest.mPath, host->mHostName, host->mPort);
+    auto self = shared_from_this();
+    armDeadline();
+    asio::async_write(mSocket, asio::buffer(mRequestText),
+                      [self](asio::error_code const& ec, size_t) {
+                          if (ec)
+                          {
+                              self->finish(ec);
+                              return;
+                          }
+                          self->readHead();
+                      });
+}
+
+bool
+HttpArchiveConnection::parseHead(std::string const& head)
+{
+    std::istringstream in(head);
+    std::string version;
+    unsigned int status = 0;
+    in >> version >> status;
+    if (!in || version.compare(0, 5, "HTTP/") != 0)
+    {
+        CLOG(WARNING, "History") << "Invalid HTTP response for "
+                                 << mRequest.mPath;
+        return false;
+    }
+    if (status != 200)
+    {
+        CLOG(DEBUG, "History") << "HTTP status " << status << " for "
+                               << mRequest.mPath;
+        return false;
+    }
+
+    mKeepAlive = version != "HTTP/1.0";
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line))
+    {
+        auto colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        auto name = toLower(trim(line.substr(0, colon)));
+        auto value = toLower(trim(line.substr(colon + 1)));
+        if (name == "content-length")
+        {
+            try
+            {
+                mRemaining = std::stoull(value);
+                mHasLength = true;
+            }
+            catch (std::exception&)
+            {
+                return false;
+            }
+        }
+        else if (name == "connection")
+        {
+            if (value == "close")
+            {
+                mKeepAlive = false;
+            }
+            else if (value == "keep-alive")
+            {
+                mKeepAlive = true;
+            }
+        }
+        else if (name == "transfer-encoding" && value != "identity")
+        {
+            CLOG(WARNING, "History") << "Unsupported transfer encoding '"
+                                     << value << "' for " << mRequest.mPath;
+            return false;
+        }
+    }
+
+    if (!mHasLength)
+    {
+        // body ends with the connection
+        mKeepAlive = false;
+    }
+    return true;
+}
+
+void
+HttpArchiveConnection::readHead()
+{
+    auto self = shared_from_this();
+    armDeadline();
+    asio::async_read_until(
+        mSocket, mResponse, "\r\n\r\n",
+        [self](asio::error_code const& ec, size_t headSize) {
+            if (ec)
+            {
+                self->finish(ec);
+                return;
+            }
+            self->mGotResponse = true;
+
+            auto data = self->mResponse.data();
+            std::string head(asio::buffers_begin(data),
+                             asio::buffers_begin(data) + headSize);
+            self->mResponse.consume(headSize);
+            if (!self->parseHead(head))
+            {
+                self->finish(std::make_error_code(std::errc::io_error));
+                return;
+            }
+
+            self->mOut.open(self->mRequest.mLocalFile,
+                            std::ios::binary | std::ios::trunc);
+            if (!self->mOut)
+            {
+                CLOG(WARNING, "History") << "Failed to open "
+                                         << self->mRequest.mLocalFile;
+                self->finish(std::make_error_code(std::errc::io_error));
+                return;
+            }
+
+            // part of the body may have been read along with the head
+            std::istream leftover(&self->mResponse);
+            while (self->mResponse.size() > 0 &&
+                   (!self->mHasLength || self->mRemaining > 0))
+            {
+                size_t n =
+                    std::min(self->mResponse.size(), self->mBuffer.size());
+                if (self->mHasLength)
+                {
+                    n = static_cast<size_t>(
+                        std::min<uint64_t>(n, self->mRemaining));
+                }
+                leftover.read(self->mBuffer.data(), n);
+                self->writeBody(self->mBuffer.data(), n);
+            }
+            if (self->mResponse.size() > 0)
+            {
+                // more than announced: do not trust the connection anymore
+                self->mKeepAlive = false;
+            }
+            self->readBody();
+        });
+}
+
+void
+HttpArchiveConnection::writeBody(char const* data, size_t size)
+{
+    mOut.write(data, size);
+    if (mHasLength)
+    {
+        mRemaining -= size;
+    }
+}
+
+void
+HttpArchiveConnection::readBody()
+{
+    if (mHasLength && mRemaining == 0)
+    {
+        finish(asio::error_code());
+        return;
+    }
+
+    auto self = shared_from_this();
+    armDeadline();
+    mSocket.async_read_some(
+        asio::buffer(mBuffer), [self](asio::error_code const& ec, size_t n) {
+            if (n > 0)
+            {
+                size_t take = n;
+                if (self->mHasLength)
+                {
+                    take = static_cast<size_t>(
+                        std::min<uint64_t>(n, self->mRemaining));
+                }
+                self->writeBody(self->mBuffer.data(), take);
+            }
+            if (ec == asio::error::eof && !self->mHasLength)
+            {
+                self->finish(asio::error_code());
+                return;
+            }
+            if (ec)
+            {
+                self->finish(ec);
+                return;
+            }
+            self->readBody();
+        });
+}
+
+void
+HttpArchiveConnection::finish(asio::error_code ec)
+{
+    asio::error_code ignored;
+    mDeadline.cancel(ignored);
+    if (mTimedOut)
+    {
+        ec = asio::error::timed_out;
+    }
+    if (mOut.is_open())
+    {
+        mOut.close();
+        if (!ec && !mOut)
+        {
+            ec = std::make_error_code(std::errc::io_error);
+        }
+    }
+
+    bool stale = ec && !mGotResponse && mServed > 0;
+    bool reusable = !ec && mKeepAlive;
+    if (reusable)
+    {
+        ++mServed;
+    }
+    else
+    {
+        close();
+    }
+
+    FetchRequest req = std::move(mRequest);
+    mRequest = FetchRequest();
+
+    auto host = mHost.lock();
+    if (!host)
+    {
+        return;
+    }
+
+    if (stale && !req.mRetried)
+    {
+        CLOG(DEBUG, "History") << "Connection to " << host->mHostName
+                               << " went away, retrying " << req.mPath;
+        req.mRetried = true;
+        host->enqueue(std::move(req), true);
+        host->onDone(shared_from_this(), false);
+        return;
+    }
+
+    if (ec)
+    {
+        CLOG(DEBUG, "History") << "Failed to fetch " << req.mPath << " from "
+                               << host->mHostName << ": " << ec.message();
+        host->mFailureMeter.Mark();
+        std::remove(req.mLocalFile.c_str());
+    }
+
+    host->onDone(shared_from_this(), reusable);
+    req.mHandler(ec);
+}
+
+HttpArchiveFetcher::Host::Host(Application& app, std::string const& host,
+                               unsigned short port)
+    : mApp(app)
+    , mHostName(host)
+    , mPort(port)
+    , mConnectMeter(
+          app.getMetrics().NewMeter({"history", "http", "connect"}, "connection"))
+    , mRequestMeter(
+          app.getMetrics().NewMeter({"history", "http", "request"}, "request"))
+    , mFailureMeter(
+          app.getMetrics().NewMeter({"history", "http", "failure"}, "request"))
+{
+}
+
+HttpArchiveFetcher::Host::~Host()
+{
+    for (auto& c : mIdle)
+    {
+        c->close();
+    }
+    for (auto& c : mBusy)
+    {
+        c->close();
+    }
+}
+
+void
+HttpArchiveFetcher::Host::enqueue(FetchRequest&& req, bool front)
+{
+    if (front)
+    {
+        mQueue.emplace_front(std::move(req));
+    }
+    else
+    {
+        mQueue.emplace_back(std::move(req));
+    }
+    dispatch();
+}
+
+void
+HttpArchiveFetcher::Host::dispatch()
+{
+    size_t maxConnections =
+        std::max<size_t>(1, mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES);
+    while (!mQueue.empty())
+    {
+        std::shared_ptr<HttpArchiveConnection> conn;
+        if (!mIdle.empty())
+        {
+            conn = mIdle.back();
+            mIdle.pop_back();
+        }
+        else if (mBusy.size() < maxConnections)
+        {
+            conn = std::make_shared<HttpArchiveConnection>(
+                mApp.getClock().getIOService(), shared_from_this(),
+                std::chrono::seconds(mApp.getConfig().HTTP_ARCHIVE_TIMEOUT));
+        }
+        else
+        {
+            break;
+        }
+
+        FetchRequest req = std::move(mQueue.front());
+        mQueue.pop_front();
+        mBusy.push_back(conn);
+        conn->start(std::move(req));
+    }
+}
+
+void
+HttpArchiveFetcher::Host::onDone(std::shared_ptr<HttpArchiveConnection> conn,
+                                 bool reusable)
+{
+    mBusy.erase(std::remove(mBusy.begin(), mBusy.end(), conn), mBusy.end());
+    if (reusable)
+    {
+        mIdle.push_back(conn);
+    }
+    dispatch();
+}
+
+HttpArchiveFetcher::HttpArchiveFetcher(Application& app) : mApp(app)
+{
+}
+
+HttpArchiveFetcher::~HttpArchiveFetcher()
+{
+}
+
+bool
+HttpArchiveFetcher::parseUrl(std::string const& url, std::string& host,
+                             unsigned short& port, std::string& path)
+{
+    std::string const scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0)
+    {
+        return false;
+    }
+
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto hostPort = rest.substr(0, slash);
+    path = slash == std::string::npos ? "/" : rest.substr(slash);
+
+    auto colon = hostPort.find(':');
+    host = hostPort.substr(0, colon);
+    port = 80;
+    if (colon != std::string::npos)
+    {
+        try
+        {
+            auto p = std::stoul(hostPort.substr(colon + 1));
+            if (p == 0 || p > UINT16_MAX)
+            {
+                return false;
+            }
+            port = static_cast<unsigned short>(p);
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+    }
+    return !host.empty();
+}
+
+void
+HttpArchiveFetcher::fetch(std::string const& url, std::string const& localFile,
+                          Handler handler)
+{
+    std::string host, path;
+    unsigned short port;
+    if (!parseUrl(url, host, port, path))
+    {
+        throw std::invalid_argument(fmt::format("not an http url: {}", url));
+    }
+
+    auto& h = mHosts[fmt::format("{}:{}", host, port)];
+    if (!h)
+    {
+        h = std::make_shared<Host>(mApp, host, port);
+    }
+    h->mRequestMeter.Mark();
+
+    FetchRequest req;
+    req.mPath = path;
+    req.mLocalFile = localFile;
+    req.mHandler = handler;
+    req.mRetried = false;
+    h->enqueue(std::move(req), false);
+}
+}
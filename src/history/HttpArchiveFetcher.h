@@ -0,0 +1,59 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Native downloader for history archives served over plain http://, used
+ * instead of spawning the archive's get command for every file.
+ *
+ * Requests to the same host:port share a pool of persistent (keep-alive)
+ * connections, at most MAX_CONCURRENT_SUBPROCESSES of them, and queue when
+ * they are all busy; so a catchup no longer pays a process spawn and a TCP
+ * handshake per file. Response bodies are streamed to disk as they arrive.
+ *
+ * Failures (network errors, non-200 statuses, truncated bodies, steps taking
+ * longer than HTTP_ARCHIVE_TIMEOUT, response heads over 64KiB) are reported
+ * to the caller, which retries with backoff like for a failed get command.
+ * A request that fails on a reused connection before getting any response
+ * (the server closed it while idle) is transparently retried once on a
+ * fresh connection.
+ */
+class HttpArchiveFetcher
+{
+  public:
+    typedef std::function<void(asio::error_code const&)> Handler;
+
+    class Host;
+
+    explicit HttpArchiveFetcher(Application& app);
+    ~HttpArchiveFetcher();
+
+    // Downloads `url` (http://host[:port]/path) to `localFile`. The handler
+    // is called from the main thread once the file is complete or the
+    // download failed.
+    void fetch(std::string const& url, std::string const& localFile,
+               Handler handler);
+
+    // Splits an http:// url, returns false if it is not one.
+    static bool parseUrl(std::string const& url, std::string& host,
+                         unsigned short& port, std::string& path);
+
+  private:
+    Application& mApp;
+    std::map<std::string, std::shared_ptr<Host>> mHosts;
+};
+}
@@ -0,0 +1,292 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/HistoryArchive.h"
+#include "history/HttpArchiveFetcher.h"
+#include "historywork/GetRemoteFileWork.h"
+#include "lib/catch.hpp"
+#include "lib/http/server.hpp"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/test.h"
+#include "util/Fs.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "work/WorkManager.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace stellar;
+
+TEST_CASE("HttpArchiveFetcher url parsing", "[history][http]")
+{
+    std::string host, path;
+    unsigned short port;
+
+    REQUIRE(HttpArchiveFetcher::parseUrl("http://example.com", host, port,
+                                         path));
+    REQUIRE(host == "example.com");
+    REQUIRE(port == 80);
+    REQUIRE(path == "/");
+
+    REQUIRE(HttpArchiveFetcher::parseUrl("http://127.0.0.1:8080/a/b.xdr.gz",
+                                         host, port, path));
+    REQUIRE(host == "127.0.0.1");
+    REQUIRE(port == 8080);
+    REQUIRE(path == "/a/b.xdr.gz");
+
+    REQUIRE(!HttpArchiveFetcher::parseUrl("https://example.com/", host, port,
+                                          path));
+    REQUIRE(!HttpArchiveFetcher::parseUrl("http://:80/", host, port, path));
+    REQUIRE(!HttpArchiveFetcher::parseUrl("http://example.com:99999/", host,
+                                          port, path));
+}
+
+TEST_CASE("HttpArchiveFetcher downloads files", "[history][http]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 2;
+    Application::pointer app = Application::create(clock, cfg);
+
+    auto port = getTestConfig(1).HTTP_PORT;
+    http::server::server server(clock.getIOService(), "127.0.0.1", port, 8);
+
+    size_t const n = 6;
+    std::vector<std::string> contents;
+    for (size_t i = 0; i < n; ++i)
+    {
+        // large enough to span several reads
+        contents.emplace_back(std::string(100000 + i, 'a' + i));
+        auto content = contents.back();
+        server.addRoute(fmt::format("file-{}", i),
+                        [content](std::string const&, std::string& retStr) {
+                            retStr = content;
+                        });
+    }
+
+    TmpDir dir = app->getTmpDirManager().tmpDir("http-fetch");
+    HttpArchiveFetcher fetcher(*app);
+    auto base = fmt::format("http://127.0.0.1:{}/", port);
+
+    size_t completed = 0;
+    std::vector<asio::error_code> results(n + 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        fetcher.fetch(base + fmt::format("file-{}", i),
+                      dir.getName() + fmt::format("/file-{}", i),
+                      [&results, &completed, i](asio::error_code const& ec) {
+                          results[i] = ec;
+                          ++completed;
+                      });
+    }
+    fetcher.fetch(base + "missing", dir.getName() + "/missing",
+                  [&results, &completed](asio::error_code const& ec) {
+                      results[n] = ec;
+                      ++completed;
+                  });
+
+    while (completed < n + 1 && !clock.getIOService().stopped())
+    {
+        clock.crank(true);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        REQUIRE(!results[i]);
+        std::ifstream in(dir.getName() + fmt::format("/file-{}", i),
+                         std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        REQUIRE(ss.str() == contents[i]);
+    }
+    REQUIRE(results[n]);
+    REQUIRE(!fs::exists(dir.getName() + "/missing"));
+}
+
+TEST_CASE("GetRemoteFileWork fetches over http", "[history][http]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    auto port = getTestConfig(1).HTTP_PORT;
+    auto base = fmt::format("http://127.0.0.1:{}/", port);
+    cfg.HISTORY.clear();
+    cfg.HISTORY["http"] =
+        std::make_shared<HistoryArchive>("http", "", "", "", base);
+    Application::pointer app = Application::create(clock, cfg);
+
+    http::server::server server(clock.getIOService(), "127.0.0.1", port, 8);
+    std::string content(100000, 'x');
+    server.addRoute("file", [content](std::string const&, std::string& retStr) {
+        retStr = content;
+    });
+
+    auto& wm = app->getWorkManager();
+    auto crankTillDone = [&]() {
+        while (!wm.allChildrenDone() && !clock.getIOService().stopped())
+        {
+            clock.crank(true);
+        }
+    };
+    TmpDir dir = app->getTmpDirManager().tmpDir("http-work");
+
+    // the archive is picked from the configuration
+    auto local = dir.getName() + "/file";
+    auto get = wm.addWork<GetRemoteFileWork>("file", local);
+    wm.advanceChildren();
+    crankTillDone();
+    REQUIRE(get->getState() == Work::WORK_SUCCESS);
+    std::ifstream in(local, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    REQUIRE(ss.str() == content);
+
+    auto missing = wm.addWork<GetRemoteFileWork>(
+        "missing", dir.getName() + "/missing", nullptr, Work::RETRY_NEVER);
+    wm.advanceChildren();
+    crankTillDone();
+    REQUIRE(missing->getState() == Work::WORK_FAILURE_RAISE);
+}
+
+namespace
+{
+// Accepts connections on 127.0.0.1:port and sends the i-th one the i-th
+// response, written at once (before any request is read) and never followed
+// by anything else; an empty response leaves the connection stalled.
+class ScriptedServer
+{
+    asio::io_service& mIOService;
+    asio::ip::tcp::acceptor mAcceptor;
+    std::vector<std::string> mResponses;
+    std::vector<std::shared_ptr<asio::ip::tcp::socket>> mSockets;
+
+    void
+    accept()
+    {
+        auto socket = std::make_shared<asio::ip::tcp::socket>(mIOService);
+        mAcceptor.async_accept(
+            *socket, [this, socket](asio::error_code const& ec) {
+                if (ec)
+                {
+                    return;
+                }
+                auto i = mSockets.size();
+                mSockets.push_back(socket);
+                if (i < mResponses.size() && !mResponses[i].empty())
+                {
+                    asio::async_write(*socket, asio::buffer(mResponses[i]),
+                                      [](asio::error_code const&, size_t) {});
+                }
+                accept();
+            });
+    }
+
+  public:
+    ScriptedServer(asio::io_service& ioService, unsigned short port,
+                   std::vector<std::string> const& responses)
+        : mIOService(ioService)
+        , mAcceptor(ioService,
+                    asio::ip::tcp::endpoint(
+                        asio::ip::address::from_string("127.0.0.1"), port))
+        , mResponses(responses)
+    {
+        accept();
+    }
+
+    size_t
+    getConnections() const
+    {
+        return mSockets.size();
+    }
+};
+}
+
+TEST_CASE("HttpArchiveFetcher fails stalled and oversized responses",
+          "[history][http]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    auto port = getTestConfig(1).HTTP_PORT;
+    std::string response;
+    asio::error_code expected;
+
+    SECTION("no response")
+    {
+        cfg.HTTP_ARCHIVE_TIMEOUT = 1;
+        expected = asio::error::timed_out;
+    }
+    SECTION("stalled body")
+    {
+        cfg.HTTP_ARCHIVE_TIMEOUT = 1;
+        response = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\npartial";
+        expected = asio::error::timed_out;
+    }
+    SECTION("oversized head")
+    {
+        // fails on the size of the head, long before the timeout
+        cfg.HTTP_ARCHIVE_TIMEOUT = 600;
+        response = "HTTP/1.1 200 OK\r\nX-Padding: " +
+                   std::string(100 * 1024, 'a');
+        expected = asio::error::not_found;
+    }
+
+    Application::pointer app = Application::create(clock, cfg);
+    ScriptedServer server(clock.getIOService(), port, {response});
+    TmpDir dir = app->getTmpDirManager().tmpDir("http-stalled");
+    HttpArchiveFetcher fetcher(*app);
+
+    bool done = false;
+    asio::error_code result;
+    fetcher.fetch(fmt::format("http://127.0.0.1:{}/file", port),
+                  dir.getName() + "/file",
+                  [&done, &result](asio::error_code const& ec) {
+                      result = ec;
+                      done = true;
+                  });
+    while (!done && !clock.getIOService().stopped())
+    {
+        clock.crank(true);
+    }
+    REQUIRE(result == expected);
+    REQUIRE(!fs::exists(dir.getName() + "/file"));
+}
+
+TEST_CASE("GetRemoteFileWork retries a timed out http download",
+          "[history][http]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.HTTP_ARCHIVE_TIMEOUT = 1;
+    auto port = getTestConfig(1).HTTP_PORT;
+    auto base = fmt::format("http://127.0.0.1:{}/", port);
+    cfg.HISTORY.clear();
+    cfg.HISTORY["http"] =
+        std::make_shared<HistoryArchive>("http", "", "", "", base);
+    Application::pointer app = Application::create(clock, cfg);
+
+    // the first connection stalls, the second one gets the file
+    ScriptedServer server(
+        clock.getIOService(), port,
+        {"", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"});
+
+    auto& wm = app->getWorkManager();
+    TmpDir dir = app->getTmpDirManager().tmpDir("http-retry");
+    auto local = dir.getName() + "/file";
+    auto get = wm.addWork<GetRemoteFileWork>("file", local, nullptr,
+                                             Work::RETRY_ONCE);
+    wm.advanceChildren();
+    while (!wm.allChildrenDone() && !clock.getIOService().stopped())
+    {
+        clock.crank(true);
+    }
+    REQUIRE(get->getState() == Work::WORK_SUCCESS);
+    REQUIRE(server.getConnections() == 2);
+    std::ifstream in(local, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    REQUIRE(ss.str() == "hello");
+}
@@ -1,10 +1,15 @@
 #include "history/InferredQuorum.h"
 #include "crypto/SHA.h"
-#include "util/BitsetEnumerator.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 namespace stellar
 {
@@ -78,82 +83,539 @@ InferredQuorum::notePubKey(PublicKey const& pk)
     mPubKeys[pk]++;
 }
 
-static std::shared_ptr<BitsetEnumerator>
-makeQsetEnumerator(SCPQuorumSet const& qset,
-                   std::unordered_map<PublicKey, size_t> const& nodeNumbers)
+namespace
 {
-    std::vector<std::shared_ptr<BitsetEnumerator>> innerEnums;
-    for (auto const& v : qset.validators)
+
+// Set of node numbers, sized at runtime so that networks of any size can be
+// checked.
+class NodeSet
+{
+    std::vector<uint64_t> mWords;
+
+  public:
+    static size_t const npos = static_cast<size_t>(-1);
+
+    NodeSet()
     {
-        auto i = nodeNumbers.find(v);
-        assert(i != nodeNumbers.end());
-        innerEnums.push_back(ConstantEnumerator::bitNumber(i->second));
     }
-    for (auto const& s : qset.innerSets)
+
+    explicit NodeSet(size_t n) : mWords((n + 63) / 64, 0)
     {
-        innerEnums.push_back(makeQsetEnumerator(s, nodeNumbers));
     }
-    return std::make_shared<SelectionEnumerator>(
-        std::make_shared<PermutationEnumerator>(qset.threshold,
-                                                innerEnums.size()),
-        innerEnums);
-}
 
-static std::shared_ptr<BitsetEnumerator>
-makeSliceEnumerator(InferredQuorum const& iq, PublicKey const& pk,
-                    std::unordered_map<PublicKey, size_t> const& nodeNumbers)
-{
-    // Enumerating a slice is the cartesian product enumeration of a
-    // constant enumerator (for the node itself) and a selection enumerator
-    // that does n-of-k for its validators and subqsets.
-    std::vector<std::shared_ptr<BitsetEnumerator>> innerEnums;
+    void
+    set(size_t i)
+    {
+        mWords[i / 64] |= (1ULL << (i % 64));
+    }
 
-    auto i = nodeNumbers.find(pk);
-    assert(i != nodeNumbers.end());
-    innerEnums.push_back(ConstantEnumerator::bitNumber(i->second));
+    void
+    reset(size_t i)
+    {
+        mWords[i / 64] &= ~(1ULL << (i % 64));
+    }
 
-    auto qsh = iq.mQsetHashes.find(pk);
-    assert(qsh != iq.mQsetHashes.end());
+    bool
+    test(size_t i) const
+    {
+        return (mWords[i / 64] & (1ULL << (i % 64))) != 0;
+    }
 
-    auto qs = iq.mQsets.find(qsh->second);
-    assert(qs != iq.mQsets.end());
+    bool
+    empty() const
+    {
+        for (auto w : mWords)
+        {
+            if (w)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    innerEnums.push_back(makeQsetEnumerator(qs->second, nodeNumbers));
-    return std::make_shared<CartesianProductEnumerator>(innerEnums);
-}
+    size_t
+    count() const
+    {
+        size_t n = 0;
+        for (auto w : mWords)
+        {
+            for (; w; w &= w - 1)
+            {
+                ++n;
+            }
+        }
+        return n;
+    }
 
-static bool isQuorum(std::bitset<64> const& q, InferredQuorum const& iq,
-                     std::unordered_map<PublicKey, size_t> const& nodeNumbers,
-                     std::vector<PublicKey> const& revNodeNumbers)
-{
-    for (size_t i = 0; i < q.size(); ++i)
+    // Returns the first member >= i, or npos.
+    size_t
+    next(size_t i) const
     {
-        if (q.test(i))
+        for (size_t w = i / 64; w < mWords.size(); ++w)
         {
-            auto e = makeSliceEnumerator(iq, revNodeNumbers.at(i), nodeNumbers);
-            if (!e)
+            uint64_t bits = mWords[w];
+            if (w == i / 64)
+            {
+                bits &= ~0ULL << (i % 64);
+            }
+            for (size_t b = 0; bits; ++b, bits >>= 1)
+            {
+                if (bits & 1)
+                {
+                    return w * 64 + b;
+                }
+            }
+        }
+        return npos;
+    }
+
+    NodeSet
+    operator|(NodeSet const& other) const
+    {
+        NodeSet r(*this);
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            r.mWords[w] |= other.mWords[w];
+        }
+        return r;
+    }
+
+    NodeSet
+    operator-(NodeSet const& other) const
+    {
+        NodeSet r(*this);
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            r.mWords[w] &= ~other.mWords[w];
+        }
+        return r;
+    }
+
+    bool
+    operator==(NodeSet const& other) const
+    {
+        return mWords == other.mWords;
+    }
+
+    bool
+    isSubsetOf(NodeSet const& other) const
+    {
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            if (mWords[w] & ~other.mWords[w])
             {
                 return false;
             }
-            bool containsSliceForE = false;
-            while (*e)
+        }
+        return true;
+    }
+};
+
+size_t const NodeSet::npos;
+
+// SCPQuorumSet with the validators replaced by node numbers; validators we
+// have no qset for can never be part of a quorum and are left out (the
+// threshold is kept, so they still count as missing).
+struct NodeQset
+{
+    uint32_t mThreshold;
+    std::vector<size_t> mNodes;
+    std::vector<NodeQset> mInnerSets;
+};
+
+// Finds a pair of disjoint quorums, if any, by enumerating minimal quorums
+// instead of every subset of nodes:
+//
+//  - Every quorum contains a quorum inside a single strongly connected
+//    component of the "appears in the qset of" graph, so if two components
+//    contain a quorum the network is split; otherwise only the one
+//    component containing quorums needs searching.
+//
+//  - If two disjoint quorums exist, the smaller has at most half the nodes
+//    and contains a minimal quorum Q; then the complement of Q contains a
+//    quorum. So it is enough to enumerate the minimal quorums of at most
+//    half the component's size, and check each complement.
+//
+//  - The enumeration branches on including / excluding one node at a time,
+//    and prunes a branch as soon as its committed nodes can not all be part
+//    of a quorum drawn from the nodes still available, or already contain a
+//    quorum (extensions would not be minimal).
+//
+// The top of the search tree is split into independent subproblems that
+// are searched on all cores.
+class QuorumIntersectionChecker
+{
+    size_t mNumNodes;
+    std::vector<NodeQset> mQsets;
+    std::vector<std::vector<size_t>> mSuccessors;
+    std::vector<std::vector<size_t>> mPredecessors;
+
+    NodeSet mAllNodes;
+    size_t mMaxMinimalQuorumSize{0};
+    size_t mSplitDepth{0};
+
+    std::atomic<bool> mFound{false};
+    std::atomic<uint64_t> mSearchNodes{0};
+    std::atomic<uint64_t> mMinimalQuorums{0};
+    std::mutex mResultMutex;
+    std::pair<NodeSet, NodeSet> mResult;
+
+    struct Subproblem
+    {
+        NodeSet mCommitted;
+        NodeSet mRemaining;
+    };
+
+    static void
+    collectNodes(NodeQset const& qset, std::vector<size_t>& nodes)
+    {
+        nodes.insert(nodes.end(), qset.mNodes.begin(), qset.mNodes.end());
+        for (auto const& inner : qset.mInnerSets)
+        {
+            collectNodes(inner, nodes);
+        }
+    }
+
+    static bool
+    isSatisfied(NodeQset const& qset, NodeSet const& nodes)
+    {
+        uint32_t n = 0;
+        if (n >= qset.mThreshold)
+        {
+            return true;
+        }
+        for (auto v : qset.mNodes)
+        {
+            if (nodes.test(v) && ++n >= qset.mThreshold)
+            {
+                return true;
+            }
+        }
+        for (auto const& inner : qset.mInnerSets)
+        {
+            if (isSatisfied(inner, nodes) && ++n >= qset.mThreshold)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Largest quorum contained in `nodes` (empty if there is none): drops
+    // nodes whose qset is not satisfied until a fixpoint is reached.
+    NodeSet
+    contractToMaximalQuorum(NodeSet nodes) const
+    {
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t v = nodes.next(0); v != NodeSet::npos;
+                 v = nodes.next(v + 1))
             {
-                // If we find _any_ slice in e's slices that
-                // is covered by q, we're good.
-                if ((q | **e) == q)
+                if (!isSatisfied(mQsets[v], nodes))
                 {
-                    containsSliceForE = true;
-                    break;
+                    nodes.reset(v);
+                    changed = true;
                 }
-                ++(*e);
             }
-            if (!containsSliceForE)
+        }
+        return nodes;
+    }
+
+    bool
+    isQuorum(NodeSet const& nodes) const
+    {
+        return !nodes.empty() && contractToMaximalQuorum(nodes) == nodes;
+    }
+
+    bool
+    isMinimalQuorum(NodeSet const& quorum) const
+    {
+        for (size_t v = quorum.next(0); v != NodeSet::npos;
+             v = quorum.next(v + 1))
+        {
+            NodeSet smaller(quorum);
+            smaller.reset(v);
+            if (!contractToMaximalQuorum(smaller).empty())
             {
                 return false;
             }
         }
+        return true;
+    }
+
+    void
+    strongConnect(size_t v, size_t& index, std::vector<size_t>& indices,
+                  std::vector<size_t>& lowLinks, std::vector<bool>& onStack,
+                  std::vector<size_t>& stack,
+                  std::vector<NodeSet>& components) const
+    {
+        indices[v] = lowLinks[v] = index++;
+        stack.push_back(v);
+        onStack[v] = true;
+        for (auto w : mSuccessors[v])
+        {
+            if (indices[w] == NodeSet::npos)
+            {
+                strongConnect(w, index, indices, lowLinks, onStack, stack,
+                              components);
+                lowLinks[v] = std::min(lowLinks[v], lowLinks[w]);
+            }
+            else if (onStack[w])
+            {
+                lowLinks[v] = std::min(lowLinks[v], indices[w]);
+            }
+        }
+        if (lowLinks[v] == indices[v])
+        {
+            NodeSet component(mNumNodes);
+            size_t w;
+            do
+            {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                component.set(w);
+            } while (w != v);
+            components.push_back(component);
+        }
+    }
+
+    std::vector<NodeSet>
+    stronglyConnectedComponents() const
+    {
+        size_t index = 0;
+        std::vector<size_t> indices(mNumNodes, NodeSet::npos);
+        std::vector<size_t> lowLinks(mNumNodes, 0);
+        std::vector<bool> onStack(mNumNodes, false);
+        std::vector<size_t> stack;
+        std::vector<NodeSet> components;
+        for (size_t v = 0; v < mNumNodes; ++v)
+        {
+            if (indices[v] == NodeSet::npos)
+            {
+                strongConnect(v, index, indices, lowLinks, onStack, stack,
+                              components);
+            }
+        }
+        return components;
     }
-    return true;
+
+    // Branch on the node most depended upon by the committed nodes: it is
+    // the one most likely to complete their slices, or to prune the branch
+    // excluding it.
+    size_t
+    pickSplitNode(NodeSet const& committed, NodeSet const& remaining) const
+    {
+        size_t best = remaining.next(0);
+        size_t bestScore = 0;
+        bool anyCommitted = !committed.empty();
+        for (size_t v = best; v != NodeSet::npos; v = remaining.next(v + 1))
+        {
+            size_t score = 0;
+            for (auto u : mPredecessors[v])
+            {
+                if (!anyCommitted || committed.test(u))
+                {
+                    ++score;
+                }
+            }
+            if (score > bestScore)
+            {
+                best = v;
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    void
+    noteDisjointQuorums(NodeSet const& a, NodeSet const& b)
+    {
+        std::lock_guard<std::mutex> lock(mResultMutex);
+        if (!mFound.exchange(true))
+        {
+            mResult = std::make_pair(a, b);
+        }
+    }
+
+    void
+    search(NodeSet const& committed, NodeSet remaining, size_t depth,
+           std::vector<Subproblem>* subproblems)
+    {
+        if (mFound)
+        {
+            return;
+        }
+        ++mSearchNodes;
+
+        if (committed.count() > mMaxMinimalQuorumSize)
+        {
+            return;
+        }
+
+        // any quorum extending `committed` lies within the largest quorum
+        // of the nodes still available
+        auto available = contractToMaximalQuorum(committed | remaining);
+        if (!committed.isSubsetOf(available))
+        {
+            return;
+        }
+        remaining = available - committed;
+
+        if (!committed.empty())
+        {
+            auto inner = contractToMaximalQuorum(committed);
+            if (inner == committed)
+            {
+                if (isMinimalQuorum(committed))
+                {
+                    ++mMinimalQuorums;
+                    auto other =
+                        contractToMaximalQuorum(mAllNodes - committed);
+                    if (!other.empty())
+                    {
+                        noteDisjointQuorums(committed, other);
+                    }
+                }
+                return;
+            }
+            if (!inner.empty())
+            {
+                // found through the branch that commits only `inner`
+                return;
+            }
+        }
+
+        if (remaining.empty())
+        {
+            return;
+        }
+
+        if (subproblems && depth == mSplitDepth)
+        {
+            Subproblem p;
+            p.mCommitted = committed;
+            p.mRemaining = remaining;
+            subproblems->emplace_back(std::move(p));
+            return;
+        }
+
+        auto v = pickSplitNode(committed, remaining);
+        remaining.reset(v);
+        NodeSet with(committed);
+        with.set(v);
+        search(with, remaining, depth + 1, subproblems);
+        search(committed, remaining, depth + 1, subproblems);
+    }
+
+  public:
+    explicit QuorumIntersectionChecker(std::vector<NodeQset> const& qsets)
+        : mNumNodes(qsets.size())
+        , mQsets(qsets)
+        , mSuccessors(qsets.size())
+        , mPredecessors(qsets.size())
+        , mAllNodes(qsets.size())
+    {
+        for (size_t v = 0; v < mNumNodes; ++v)
+        {
+            mAllNodes.set(v);
+            collectNodes(mQsets[v], mSuccessors[v]);
+            std::sort(mSuccessors[v].begin(), mSuccessors[v].end());
+            mSuccessors[v].erase(
+                std::unique(mSuccessors[v].begin(), mSuccessors[v].end()),
+                mSuccessors[v].end());
+            for (auto w : mSuccessors[v])
+            {
+                mPredecessors[w].push_back(v);
+            }
+        }
+    }
+
+    uint64_t
+    getSearchNodes() const
+    {
+        return mSearchNodes;
+    }
+
+    uint64_t
+    getMinimalQuorums() const
+    {
+        return mMinimalQuorums;
+    }
+
+    // Returns true if all quorums intersect, otherwise false and a pair of
+    // disjoint quorums.
+    bool
+    check(std::pair<NodeSet, NodeSet>& disjoint)
+    {
+        std::vector<NodeSet> quorumComponents;
+        for (auto const& c : stronglyConnectedComponents())
+        {
+            auto q = contractToMaximalQuorum(c);
+            if (!q.empty())
+            {
+                quorumComponents.push_back(q);
+            }
+        }
+        CLOG(INFO, "History") << "Found " << quorumComponents.size()
+                              << " strongly connected components with quorums";
+        if (quorumComponents.size() > 1)
+        {
+            disjoint = std::make_pair(quorumComponents[0], quorumComponents[1]);
+            return false;
+        }
+        if (quorumComponents.empty())
+        {
+            return true;
+        }
+
+        auto const& searchSpace = quorumComponents[0];
+        mMaxMinimalQuorumSize = searchSpace.count() / 2;
+        CLOG(INFO, "History") << "Searching minimal quorums of at most "
+                              << mMaxMinimalQuorumSize << " of "
+                              << searchSpace.count() << " nodes";
+
+        size_t threads =
+            std::max<size_t>(1, std::thread::hardware_concurrency());
+        while ((1ULL << mSplitDepth) < threads * 16 &&
+               mSplitDepth < searchSpace.count())
+        {
+            ++mSplitDepth;
+        }
+
+        std::vector<Subproblem> subproblems;
+        search(NodeSet(mNumNodes), searchSpace, 0, &subproblems);
+
+        std::atomic<size_t> next{0};
+        auto worker = [this, &subproblems, &next]() {
+            for (size_t i = next++; i < subproblems.size(); i = next++)
+            {
+                search(subproblems[i].mCommitted, subproblems[i].mRemaining,
+                       mSplitDepth, nullptr);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < threads; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : pool)
+        {
+            t.join();
+        }
+
+        if (mFound)
+        {
+            disjoint = mResult;
+            return false;
+        }
+        return true;
+    }
+};
 }
 
 bool
@@ -167,57 +629,47 @@ InferredQuorum::checkQuorumIntersection(Config const& cfg) const
     // iff any two of its quorums share a node—i.e., for all quorums U1 and
     // U2, U1 ∩ U2 =/= ∅.
 
-    // Assign a bit-number to each node
+    // We only consider the nodes we _have_ qsets for, which might be
+    // significantly fewer than the total set of nodes; we can't really tell
+    // how nodes we don't have qsets for will behave in a network; we exclude
+    // them.
     std::unordered_map<PublicKey, size_t> nodeNumbers;
     std::vector<PublicKey> revNodeNumbers;
     for (auto const& n : mPubKeys)
     {
-        nodeNumbers.insert(std::make_pair(n.first, nodeNumbers.size()));
-        revNodeNumbers.push_back(n.first);
-    }
-
-    // We're (only) going to scan the powerset of the nodes we _have_ qsets
-    // for, which might be significantly fewer than the total set of nodes;
-    // we can't really tell how nodes we don't have qsets for will behave
-    // in a network; we exclude them.
-    std::unordered_set<size_t> nodesWithQsets;
-    std::vector<std::shared_ptr<BitsetEnumerator>> nodeEnumerators;
-    for (auto const& n : mQsetHashes)
-    {
-        assert(mQsets.find(n.second) != mQsets.end());
-        auto i = nodeNumbers.find(n.first);
-        assert(i != nodeNumbers.end());
-        nodesWithQsets.insert(i->second);
-    }
-    for (auto nwq : nodesWithQsets)
-    {
-        nodeEnumerators.push_back(ConstantEnumerator::bitNumber(nwq));
+        if (mQsetHashes.find(n.first) != mQsetHashes.end())
+        {
+            nodeNumbers.insert(std::make_pair(n.first, nodeNumbers.size()));
+            revNodeNumbers.push_back(n.first);
+        }
     }
 
-    // Build an enumerator for the powerset of the nodes we have qsets for;
-    // this will thus return _candidate_ quorums, each of which we'll check
-    // for quorum-ness.
-    SelectionEnumerator quorumCandidateEnumerator(
-        std::make_shared<PowersetEnumerator>(nodeEnumerators.size()),
-        nodeEnumerators);
-
-    assert(nodeEnumerators.size() < 64);
-    uint64_t lim = 1ULL << nodeEnumerators.size();
-    CLOG(INFO, "History") << "Scanning: " << lim
-                          << " possible node subsets (of "
-                          << nodeEnumerators.size() << " nodes with qsets)";
+    std::function<NodeQset(SCPQuorumSet const&)> convert =
+        [&](SCPQuorumSet const& qset) -> NodeQset {
+            NodeQset res;
+            res.mThreshold = qset.threshold;
+            for (auto const& v : qset.validators)
+            {
+                auto i = nodeNumbers.find(v);
+                if (i != nodeNumbers.end())
+                {
+                    res.mNodes.push_back(i->second);
+                }
+            }
+            for (auto const& inner : qset.innerSets)
+            {
+                res.mInnerSets.push_back(convert(inner));
+            }
+            return res;
+        };
 
-    // Enumerate all the quorums, de-duplicating into a hashset
-    std::unordered_set<uint64_t> allQuorums;
-    while (quorumCandidateEnumerator)
+    std::vector<NodeQset> qsets;
+    for (auto const& pk : revNodeNumbers)
     {
-        auto bv = *quorumCandidateEnumerator;
-        if (isQuorum(bv, *this, nodeNumbers, revNodeNumbers))
-        {
-            CLOG(INFO, "History") << "Quorum: " << bv;
-            allQuorums.insert(bv.to_ullong());
-        }
-        ++quorumCandidateEnumerator;
+        auto qsh = mQsetHashes.find(pk);
+        auto qs = mQsets.find(qsh->second);
+        assert(qs != mQsets.end());
+        qsets.push_back(convert(qs->second));
     }
 
     // Report what we found.
@@ -229,46 +681,52 @@ InferredQuorum::checkQuorumIntersection(Config const& cfg) const
                                      << cfg.toShortString(pk.first);
         }
     }
-    CLOG(INFO, "History") << "Found " << nodeNumbers.size() << " nodes total";
-    CLOG(INFO, "History") << "Found " << nodeEnumerators.size()
+    CLOG(INFO, "History") << "Found " << mPubKeys.size() << " nodes total";
+    CLOG(INFO, "History") << "Found " << revNodeNumbers.size()
                           << " nodes with qsets";
-    CLOG(INFO, "History") << "Found " << allQuorums.size() << " quorums";
 
-    bool allOk = true;
-    for (auto const& q : allQuorums)
-    {
-        for (auto const& v : allQuorums)
+    auto start = std::chrono::steady_clock::now();
+    QuorumIntersectionChecker checker(qsets);
+    std::pair<NodeSet, NodeSet> disjoint;
+    bool allOk = checker.check(disjoint);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    CLOG(INFO, "History") << "Examined " << checker.getSearchNodes()
+                          << " search nodes, " << checker.getMinimalQuorums()
+                          << " minimal quorums in " << elapsed.count() << "ms";
+
+    auto describe = [&](NodeSet const& nodes) -> std::string {
+        std::ostringstream out;
+        out << "{";
+        for (size_t v = nodes.next(0); v != NodeSet::npos;
+             v = nodes.next(v + 1))
         {
-            if (q != v)
-            {
-                if (!(q & v))
-                {
-                    allOk = false;
-                    CLOG(WARNING, "History")
-                        << "Warning: found pair of non-intersecting quorums";
-                    CLOG(WARNING, "History") << std::bitset<64>(q);
-                    CLOG(WARNING, "History") << "vs.";
-                    CLOG(WARNING, "History") << std::bitset<64>(v);
-                }
-            }
+            out << " " << cfg.toShortString(revNodeNumbers.at(v));
         }
-    }
+        out << " }";
+        return out.str();
+    };
 
     if (allOk)
     {
-        CLOG(INFO, "History") << "Network of " << nodeEnumerators.size()
+        CLOG(INFO, "History") << "Network of " << revNodeNumbers.size()
                               << " nodes enjoys quorum intersection: ";
     }
     else
     {
         CLOG(WARNING, "History")
-            << "Network of " << nodeEnumerators.size()
+            << "Warning: found pair of non-intersecting quorums";
+        CLOG(WARNING, "History") << describe(disjoint.first);
+        CLOG(WARNING, "History") << "vs.";
+        CLOG(WARNING, "History") << describe(disjoint.second);
+        CLOG(WARNING, "History")
+            << "Network of " << revNodeNumbers.size()
             << " nodes DOES NOT enjoy quorum intersection: ";
     }
-    for (auto n : nodesWithQsets)
+    for (auto const& pk : revNodeNumbers)
     {
         auto isAlias = false;
-        auto name = cfg.toStrKey(revNodeNumbers.at(n), isAlias);
+        auto name = cfg.toStrKey(pk, isAlias);
         if (allOk)
         {
             CLOG(INFO, "History") << "  \"" << (isAlias ? "$" : "") << name
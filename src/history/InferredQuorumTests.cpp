@@ -6,14 +6,56 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "lib/catch.hpp"
+#include "main/Application.h"
 #include "main/Config.h"
+#include "simulation/Topologies.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
+#include <chrono>
 #include <xdrpp/autocheck.h>
 
 using namespace stellar;
 
+static void
+noteNode(InferredQuorum& iq, PublicKey const& pk, SCPQuorumSet const& qset)
+{
+    iq.notePubKey(pk);
+    iq.noteQset(qset);
+    iq.noteQsetHash(pk, sha256(xdr::xdr_to_opaque(qset)));
+}
+
+// A core of `coreSize` nodes requiring `coreThreshold` of themselves, and
+// `nLeaves` leaves each requiring itself and the core.
+static void
+makeTieredNetwork(InferredQuorum& iq, std::string const& prefix,
+                  size_t coreSize, uint32_t coreThreshold, size_t nLeaves)
+{
+    SCPQuorumSet coreQset;
+    coreQset.threshold = coreThreshold;
+    for (size_t i = 0; i < coreSize; ++i)
+    {
+        coreQset.validators.push_back(
+            SecretKey::fromSeed(sha256(prefix + "_core_" + std::to_string(i)))
+                .getPublicKey());
+    }
+    for (auto const& pk : coreQset.validators)
+    {
+        noteNode(iq, pk, coreQset);
+    }
+    for (size_t i = 0; i < nLeaves; ++i)
+    {
+        auto pk =
+            SecretKey::fromSeed(sha256(prefix + "_leaf_" + std::to_string(i)))
+                .getPublicKey();
+        SCPQuorumSet leafQset;
+        leafQset.threshold = 2;
+        leafQset.validators.push_back(pk);
+        leafQset.innerSets.push_back(coreQset);
+        noteNode(iq, pk, leafQset);
+    }
+}
+
 TEST_CASE("InferredQuorum intersection", "[history][inferredquorum]")
 {
     InferredQuorum iq;
@@ -291,3 +333,75 @@ TEST_CASE("InferredQuorum non-intersection w/ subquorums",
     Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
     CHECK(!iq.checkQuorumIntersection(cfg));
 }
+
+TEST_CASE("InferredQuorum intersection of large networks",
+          "[history][inferredquorum]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
+
+    SECTION("one tiered network of more than 64 nodes")
+    {
+        InferredQuorum iq;
+        makeTieredNetwork(iq, "a", 7, 5, 200);
+        CHECK(iq.checkQuorumIntersection(cfg));
+    }
+
+    SECTION("core threshold too low")
+    {
+        InferredQuorum iq;
+        makeTieredNetwork(iq, "a", 7, 3, 200);
+        CHECK(!iq.checkQuorumIntersection(cfg));
+    }
+
+    SECTION("two separate networks")
+    {
+        InferredQuorum iq;
+        makeTieredNetwork(iq, "a", 4, 3, 50);
+        makeTieredNetwork(iq, "b", 4, 3, 50);
+        CHECK(!iq.checkQuorumIntersection(cfg));
+    }
+}
+
+TEST_CASE("InferredQuorum intersection benchmark",
+          "[history][inferredquorum][bench][hide]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
+
+    auto check = [&](std::string const& name, Simulation::pointer sim) {
+        InferredQuorum iq;
+        for (auto const& id : sim->getNodeIDs())
+        {
+            noteNode(iq, id, sim->getNode(id)->getConfig().QUORUM_SET);
+        }
+        auto start = std::chrono::steady_clock::now();
+        CHECK(iq.checkQuorumIntersection(cfg));
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        LOG(INFO) << name << ": " << sim->getNodeIDs().size() << " nodes in "
+                  << elapsed.count() << "ms";
+    };
+
+    for (int coreSize : {4, 7, 10})
+    {
+        for (int outer : {10, 50, 100})
+        {
+            check("hierarchicalQuorumSimplified(" + std::to_string(coreSize) +
+                      ", " + std::to_string(outer) + ")",
+                  Topologies::hierarchicalQuorumSimplified(
+                      coreSize, outer, Simulation::OVER_LOOPBACK, networkID));
+        }
+    }
+    for (int branches : {10, 50, 100})
+    {
+        check("hierarchicalQuorum(" + std::to_string(branches) + ")",
+              Topologies::hierarchicalQuorum(
+                  branches, Simulation::OVER_LOOPBACK, networkID));
+    }
+    for (int size : {10, 20, 30})
+    {
+        check("core(" + std::to_string(size) + ", 0.75)",
+              Topologies::core(size, 0.75, Simulation::OVER_LOOPBACK,
+                               networkID));
+    }
+}
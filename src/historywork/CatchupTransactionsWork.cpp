@@ -5,8 +5,8 @@
 #include "historywork/CatchupTransactionsWork.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
-#include "historywork/ApplyLedgerChainWork.h"
 #include "historywork/BatchDownloadWork.h"
+#include "historywork/DownloadApplyTxsWork.h"
 #include "historywork/VerifyLedgerChainWork.h"
 #include "main/Application.h"
 #include "util/Logging.h"
@@ -32,18 +32,14 @@ CatchupTransactionsWork::getStatus() const
 {
     if (mState == WORK_PENDING)
     {
-        if (mApplyWork)
+        if (mDownloadApplyWork)
         {
-            return mApplyWork->getStatus();
+            return mDownloadApplyWork->getStatus();
         }
         else if (mVerifyWork)
         {
             return mVerifyWork->getStatus();
         }
-        else if (mDownloadTransactionsWork)
-        {
-            return mDownloadTransactionsWork->getStatus();
-        }
         else if (mDownloadLedgersWork)
         {
             return mDownloadLedgersWork->getStatus();
@@ -56,9 +52,8 @@ void
 CatchupTransactionsWork::onReset()
 {
     mDownloadLedgersWork.reset();
-    mDownloadTransactionsWork.reset();
     mVerifyWork.reset();
-    mApplyWork.reset();
+    mDownloadApplyWork.reset();
 }
 
 Work::State
@@ -75,17 +70,10 @@ CatchupTransactionsWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 2: download and decompress the transactions.
-    if (!mDownloadTransactionsWork)
-    {
-        CLOG(INFO, "History") << "Catchup " << mCatchupTypeName
-                              << " downloading transactions";
-        mDownloadTransactionsWork = addWork<BatchDownloadWork>(
-            mFirstSeq, mLastSeq, HISTORY_FILE_TYPE_TRANSACTIONS, mDownloadDir);
-        return WORK_PENDING;
-    }
-
-    // Phase 3: verify the ledger chain.
+    // Phase 2: verify the ledger chain. Header files are small compared to
+    // transaction files, and the chain can only be trusted once its last
+    // ledger has been checked against the LedgerManager, so all of it is
+    // verified before anything gets applied.
     if (!mVerifyWork)
     {
         CLOG(INFO, "History") << "Catchup " << mCatchupTypeName
@@ -97,13 +85,13 @@ CatchupTransactionsWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 4: apply the transactions.
-    if (!mApplyWork)
+    // Phase 3: download the transactions and apply them as they arrive.
+    if (!mDownloadApplyWork)
     {
         CLOG(INFO, "History") << "Catchup " << mCatchupTypeName
-                              << " applying history";
-        mApplyWork = addWork<ApplyLedgerChainWork>(mDownloadDir, mFirstSeq,
-                                                   mLastSeq, mLastApplied);
+                              << " downloading and applying history";
+        mDownloadApplyWork = addWork<DownloadApplyTxsWork>(
+            mDownloadDir, mFirstSeq, mLastSeq, mLastApplied);
         return WORK_PENDING;
     }
 
@@ -32,9 +32,8 @@ class CatchupTransactionsWork : public Work
 
   private:
     std::shared_ptr<Work> mDownloadLedgersWork;
-    std::shared_ptr<Work> mDownloadTransactionsWork;
     std::shared_ptr<Work> mVerifyWork;
-    std::shared_ptr<Work> mApplyWork;
+    std::shared_ptr<Work> mDownloadApplyWork;
 
     TmpDir& mDownloadDir;
     uint32_t mFirstSeq;
@@ -22,6 +22,12 @@ CatchupWork::CatchupWork(Application& app, WorkParent& parent,
 {
 }
 
+Work::Priority
+CatchupWork::getPriority() const
+{
+    return WORK_PRIORITY_CRITICAL;
+}
+
 uint32_t
 CatchupWork::nextLedger() const
 {
@@ -26,5 +26,7 @@ class CatchupWork : public BucketDownloadWork
     CatchupWork(Application& app, WorkParent& parent, uint32_t initLedger,
                 std::string const& mode, bool manualCatchup);
     virtual void onReset() override;
+    // the node is out of consensus until catchup completes
+    Priority getPriority() const override;
 };
 }
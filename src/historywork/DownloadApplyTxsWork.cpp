@@ -0,0 +1,186 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/DownloadApplyTxsWork.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryManager.h"
+#include "historywork/ApplyLedgerChainWork.h"
+#include "historywork/GetAndUnzipRemoteFileWork.h"
+#include "historywork/Progress.h"
+#include "ledger/LedgerManager.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace stellar
+{
+
+DownloadApplyTxsWork::DownloadApplyTxsWork(
+    Application& app, WorkParent& parent, TmpDir const& downloadDir,
+    uint32_t first, uint32_t last, LedgerHeaderHistoryEntry& lastApplied)
+    : Work(app, parent,
+           fmt::format("download-apply-txs-{:08x}-{:08x}", first, last))
+    , mDownloadDir(downloadDir)
+    , mFirst(first)
+    , mLast(last)
+    , mLastApplied(lastApplied)
+    , mNextDownload(first)
+    , mNextApply(first)
+    , mDownloadCount(0)
+    , mApplyCount(0)
+{
+}
+
+std::string
+DownloadApplyTxsWork::getStatus() const
+{
+    if (mState == WORK_RUNNING || mState == WORK_PENDING)
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           mApp.getClock().now() - mStartTime)
+                           .count();
+        double seconds = std::max<double>(elapsed, 1) / 1000.0;
+        auto task = fmtProgress(mApp, "applying checkpoint", mFirst, mLast,
+                                mNextApply);
+        return fmt::format("{:s}, {:d} downloaded ahead ({:.2f} "
+                           "checkpoints/s downloaded, {:.2f} checkpoints/s "
+                           "applied)",
+                           task, mDownloaded.size(), mDownloadCount / seconds,
+                           mApplyCount / seconds);
+    }
+    return Work::getStatus();
+}
+
+uint32_t
+DownloadApplyTxsWork::getWindow() const
+{
+    // enough to keep every download slot busy while a checkpoint applies
+    return std::max<uint32_t>(
+        2, 2 * static_cast<uint32_t>(
+                   mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES));
+}
+
+void
+DownloadApplyTxsWork::addDownloadWorkers()
+{
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    auto windowEnd = mNextApply + getWindow() * freq;
+    while (mNextDownload <= mLast && mNextDownload < windowEnd &&
+           mDownloading.size() < mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES)
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mNextDownload);
+        if (fs::exists(ft.localPath_nogz()))
+        {
+            CLOG(DEBUG, "History") << "already have transactions for "
+                                   << "checkpoint " << mNextDownload;
+            mDownloaded.insert(mNextDownload);
+        }
+        else
+        {
+            CLOG(DEBUG, "History")
+                << "Downloading and unzipping transactions for checkpoint "
+                << mNextDownload;
+            auto getAndUnzip = addWork<GetAndUnzipRemoteFileWork>(ft);
+            assert(mDownloading.find(getAndUnzip->getUniqueName()) ==
+                   mDownloading.end());
+            mDownloading.insert(
+                std::make_pair(getAndUnzip->getUniqueName(), mNextDownload));
+        }
+        mNextDownload += freq;
+    }
+}
+
+void
+DownloadApplyTxsWork::maybeApplyNext()
+{
+    if (mApplyWork || mNextApply > mLast ||
+        mDownloaded.find(mNextApply) == mDownloaded.end())
+    {
+        return;
+    }
+    mApplyWork = addWork<ApplyLedgerChainWork>(mDownloadDir, mNextApply,
+                                               mNextApply, mLastApplied);
+}
+
+void
+DownloadApplyTxsWork::removeCheckpointFiles(uint32_t checkpoint) const
+{
+    // headers were verified and transactions applied, neither is read again
+    for (auto type : {HISTORY_FILE_TYPE_LEDGER, HISTORY_FILE_TYPE_TRANSACTIONS})
+    {
+        FileTransferInfo ft(mDownloadDir, type, checkpoint);
+        std::remove(ft.localPath_nogz().c_str());
+    }
+}
+
+void
+DownloadApplyTxsWork::onReset()
+{
+    // on retry, skip the checkpoints that were fully applied already: their
+    // files are gone
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    auto lcl = mApp.getLedgerManager().getLastClosedLedgerNum();
+    mNextApply = mFirst;
+    while (mNextApply <= lcl && mNextApply <= mLast)
+    {
+        mNextApply += freq;
+    }
+    mNextDownload = mNextApply;
+    mDownloading.clear();
+    mDownloaded.clear();
+    mApplyWork.reset();
+    clearChildren();
+
+    mStartTime = mApp.getClock().now();
+    mDownloadCount = 0;
+    mApplyCount = 0;
+
+    addDownloadWorkers();
+    maybeApplyNext();
+}
+
+void
+DownloadApplyTxsWork::notify(std::string const& childChanged)
+{
+    std::vector<std::string> done;
+    for (auto const& c : mChildren)
+    {
+        if (c.second->getState() == WORK_SUCCESS)
+        {
+            done.push_back(c.first);
+        }
+    }
+    for (auto const& d : done)
+    {
+        mChildren.erase(d);
+        if (mApplyWork && d == mApplyWork->getUniqueName())
+        {
+            CLOG(DEBUG, "History") << "Finished applying checkpoint "
+                                   << mNextApply;
+            mApplyWork.reset();
+            removeCheckpointFiles(mNextApply);
+            mDownloaded.erase(mNextApply);
+            mNextApply += mApp.getHistoryManager().getCheckpointFrequency();
+            ++mApplyCount;
+            continue;
+        }
+
+        auto i = mDownloading.find(d);
+        assert(i != mDownloading.end());
+        CLOG(DEBUG, "History") << "Finished download of transactions for "
+                               << "checkpoint " << i->second;
+        mDownloaded.insert(i->second);
+        mDownloading.erase(i);
+        ++mDownloadCount;
+    }
+
+    addDownloadWorkers();
+    maybeApplyNext();
+    mApp.getHistoryManager().logAndUpdateStatus(true);
+    advance();
+}
+}
@@ -0,0 +1,56 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "util/Timer.h"
+#include "work/Work.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <map>
+#include <set>
+
+namespace stellar
+{
+
+class TmpDir;
+
+class DownloadApplyTxsWork : public Work
+{
+    // Downloads the transaction files of a range of (already verified)
+    // checkpoints and replays them as a pipeline: checkpoint N is applied
+    // while checkpoints N+1..N+k are downloading and decompressing. The
+    // look-ahead window k bounds the number of files kept on disk; when apply
+    // falls behind, no new downloads are started until it catches up. Files
+    // of a checkpoint are removed once it has been applied.
+    TmpDir const& mDownloadDir;
+    uint32_t mFirst;
+    uint32_t mLast;
+    LedgerHeaderHistoryEntry& mLastApplied;
+
+    uint32_t mNextDownload;
+    uint32_t mNextApply;
+    std::map<std::string, uint32_t> mDownloading;
+    std::set<uint32_t> mDownloaded;
+    std::shared_ptr<Work> mApplyWork;
+
+    // per-stage throughput, reported in getStatus
+    VirtualClock::time_point mStartTime;
+    uint32_t mDownloadCount;
+    uint32_t mApplyCount;
+
+    uint32_t getWindow() const;
+    void addDownloadWorkers();
+    void maybeApplyNext();
+    void removeCheckpointFiles(uint32_t checkpoint) const;
+
+  public:
+    DownloadApplyTxsWork(Application& app, WorkParent& parent,
+                         TmpDir const& downloadDir, uint32_t first,
+                         uint32_t last, LedgerHeaderHistoryEntry& lastApplied);
+    std::string getStatus() const override;
+    void onReset() override;
+    void notify(std::string const& childChanged) override;
+};
+}
@@ -2,9 +2,11 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "historywork/GetRemoteFileWork.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
+#include "history/HttpArchiveFetcher.h"
 #include "main/Application.h"
 
 namespace stellar
@@ -25,14 +27,37 @@ GetRemoteFileWork::GetRemoteFileWork(
 void
 GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
 {
-    auto archive = mArchive;
-    if (!archive)
+    assert(mCurrentArchive);
+    assert(mCurrentArchive->hasGetCmd());
+    cmdLine = mCurrentArchive->getFileCmd(mRemote, mLocal);
+}
+
+std::string
+GetRemoteFileWork::getHelperCommand() const
+{
+    return mCurrentArchive->getHelperCmd();
+}
+
+void
+GetRemoteFileWork::onStart()
+{
+    mCurrentArchive = mArchive;
+    if (!mCurrentArchive)
+    {
+        mCurrentArchive =
+            mApp.getHistoryManager().selectRandomReadableHistoryArchive();
+    }
+    assert(mCurrentArchive);
+
+    if (mCurrentArchive->hasGetUrl())
+    {
+        mApp.getHistoryManager().getHttpArchiveFetcher().fetch(
+            mCurrentArchive->getFileUrl(mRemote), mLocal, callComplete());
+    }
+    else
     {
-        archive = mApp.getHistoryManager().selectRandomReadableHistoryArchive();
+        RunCommandWork::onStart();
     }
-    assert(archive);
-    assert(archive->hasGetCmd());
-    cmdLine = archive->getFileCmd(mRemote, mLocal);
 }
 
 void
@@ -16,7 +16,9 @@ class GetRemoteFileWork : public RunCommandWork
     std::string mRemote;
     std::string mLocal;
     std::shared_ptr<HistoryArchive const> mArchive;
+    std::shared_ptr<HistoryArchive const> mCurrentArchive;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    std::string getHelperCommand() const override;
 
   public:
     // Passing `nullptr` for the archive argument will cause the work to
@@ -27,5 +29,6 @@ class GetRemoteFileWork : public RunCommandWork
                       std::shared_ptr<HistoryArchive const> archive = nullptr,
                       size_t maxRetries = Work::RETRY_A_FEW);
     void onReset() override;
+    void onStart() override;
 };
 }
@@ -26,4 +26,10 @@ MakeRemoteDirWork::getCommand(std::string& cmdLine, std::string& outFile)
         cmdLine = mArchive->mkdirCmd(mDir);
     }
 }
+
+std::string
+MakeRemoteDirWork::getHelperCommand() const
+{
+    return mArchive->getHelperCmd();
+}
 }
@@ -16,6 +16,7 @@ class MakeRemoteDirWork : public RunCommandWork
     std::string mDir;
     std::shared_ptr<HistoryArchive const> mArchive;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    std::string getHelperCommand() const override;
 
   public:
     MakeRemoteDirWork(Application& app, WorkParent& parent,
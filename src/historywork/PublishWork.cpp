@@ -15,11 +15,14 @@
 namespace stellar
 {
 
-PublishWork::PublishWork(Application& app, WorkParent& parent,
-                         std::shared_ptr<StateSnapshot> snapshot)
+PublishWork::PublishWork(
+    Application& app, WorkParent& parent,
+    std::vector<std::shared_ptr<StateSnapshot>> const& snapshots)
     : Work(app, parent,
-           fmt::format("publish-{:08x}", snapshot->mLocalState.currentLedger))
-    , mSnapshot(snapshot)
+           fmt::format("publish-{:08x}-{:08x}",
+                       snapshots.front()->mLocalState.currentLedger,
+                       snapshots.back()->mLocalState.currentLedger))
+    , mSnapshots(snapshots)
 {
 }
 
@@ -57,17 +60,25 @@ PublishWork::onReset()
 Work::State
 PublishWork::onSuccess()
 {
-    // Phase 1: resolve futures in snapshot
+    // Phase 1: resolve futures in snapshots
     if (!mResolveSnapshotWork)
     {
-        mResolveSnapshotWork = addWork<ResolveSnapshotWork>(mSnapshot);
+        mResolveSnapshotWork = addWork<Work>("resolve-snapshots");
+        for (auto const& snap : mSnapshots)
+        {
+            mResolveSnapshotWork->addWork<ResolveSnapshotWork>(snap);
+        }
         return WORK_PENDING;
     }
 
     // Phase 2: write snapshot files
     if (!mWriteSnapshotWork)
     {
-        mWriteSnapshotWork = addWork<WriteSnapshotWork>(mSnapshot);
+        mWriteSnapshotWork = addWork<Work>("write-snapshots");
+        for (auto const& snap : mSnapshots)
+        {
+            mWriteSnapshotWork->addWork<WriteSnapshotWork>(snap);
+        }
         return WORK_PENDING;
     }
 
@@ -82,20 +93,27 @@ PublishWork::onSuccess()
             {
                 continue;
             }
-            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(arch, mSnapshot);
+            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(arch,
+                                                               mSnapshots);
         }
         return WORK_PENDING;
     }
 
-    mApp.getHistoryManager().historyPublished(
-        mSnapshot->mLocalState.currentLedger, true);
+    for (auto const& snap : mSnapshots)
+    {
+        mApp.getHistoryManager().historyPublished(
+            snap->mLocalState.currentLedger, true);
+    }
     return WORK_SUCCESS;
 }
 
 void
 PublishWork::onFailureRaise()
 {
-    mApp.getHistoryManager().historyPublished(
-        mSnapshot->mLocalState.currentLedger, false);
+    for (auto const& snap : mSnapshots)
+    {
+        mApp.getHistoryManager().historyPublished(
+            snap->mLocalState.currentLedger, false);
+    }
 }
 }
@@ -6,6 +6,8 @@
 
 #include "work/Work.h"
 
+#include <vector>
+
 namespace stellar
 {
 
@@ -13,7 +15,10 @@ struct StateSnapshot;
 
 class PublishWork : public Work
 {
-    std::shared_ptr<StateSnapshot> mSnapshot;
+    // Publishes a batch of queued checkpoints, oldest first, together: their
+    // snapshots are resolved and written in parallel, then each archive gets
+    // the union of their files in a single PutSnapshotFilesWork.
+    std::vector<std::shared_ptr<StateSnapshot>> mSnapshots;
 
     std::shared_ptr<Work> mResolveSnapshotWork;
     std::shared_ptr<Work> mWriteSnapshotWork;
@@ -21,7 +26,7 @@ class PublishWork : public Work
 
   public:
     PublishWork(Application& app, WorkParent& parent,
-                std::shared_ptr<StateSnapshot> snapshot);
+                std::vector<std::shared_ptr<StateSnapshot>> const& snapshots);
     std::string getStatus() const override;
     void onReset() override;
     void onFailureRaise() override;
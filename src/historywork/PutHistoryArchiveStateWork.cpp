@@ -6,6 +6,7 @@
 #include "history/HistoryArchive.h"
 #include "historywork/MakeRemoteDirWork.h"
 #include "historywork/PutRemoteFileWork.h"
+#include "lib/util/format.h"
 #include "util/Logging.h"
 
 namespace stellar
@@ -14,7 +15,8 @@ namespace stellar
 PutHistoryArchiveStateWork::PutHistoryArchiveStateWork(
     Application& app, WorkParent& parent, HistoryArchiveState const& state,
     std::shared_ptr<HistoryArchive const> archive)
-    : Work(app, parent, "put-history-archive-state")
+    : Work(app, parent, fmt::format("put-history-archive-state-{:08x}",
+                                    state.currentLedger))
     , mState(state)
     , mArchive(archive)
     , mLocalFilename(HistoryArchiveState::localName(app, archive->getName()))
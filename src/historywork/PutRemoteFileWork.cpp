@@ -25,4 +25,10 @@ PutRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
 {
     cmdLine = mArchive->putFileCmd(mLocal, mRemote);
 }
+
+std::string
+PutRemoteFileWork::getHelperCommand() const
+{
+    return mArchive->getHelperCmd();
+}
 }
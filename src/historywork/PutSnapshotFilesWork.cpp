@@ -13,16 +13,19 @@
 #include "historywork/PutRemoteFileWork.h"
 #include "main/Application.h"
 
+#include <set>
+
 namespace stellar
 {
 
 PutSnapshotFilesWork::PutSnapshotFilesWork(
     Application& app, WorkParent& parent,
     std::shared_ptr<HistoryArchive const> archive,
-    std::shared_ptr<StateSnapshot> snapshot)
+    std::vector<std::shared_ptr<StateSnapshot>> const& snapshots)
     : Work(app, parent, "put-snapshot-files")
     , mArchive(archive)
-    , mSnapshot(snapshot)
+    , mSnapshots(snapshots)
+    , mStatesPut(0)
 {
 }
 
@@ -31,9 +34,42 @@ PutSnapshotFilesWork::onReset()
 {
     clearChildren();
 
+    mFiles.clear();
     mGetHistoryArchiveStateWork.reset();
+    mPrepareFilesWork.reset();
     mPutFilesWork.reset();
-    mPutHistoryArchiveStateWork.reset();
+    mStatesPut = 0;
+}
+
+void
+PutSnapshotFilesWork::collectFiles()
+{
+    std::set<std::string> buckets;
+    for (auto const& snap : mSnapshots)
+    {
+        for (auto f :
+             {snap->mLedgerSnapFile, snap->mTransactionSnapFile,
+              snap->mTransactionResultSnapFile, snap->mSCPHistorySnapFile})
+        {
+            if (f && fs::exists(f->localPath_nogz()))
+            {
+                mFiles.push_back(f);
+            }
+        }
+        auto differing = snap->mLocalState.differingBuckets(mRemoteState);
+        buckets.insert(differing.begin(), differing.end());
+    }
+
+    for (auto const& hash : buckets)
+    {
+        auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+        assert(b);
+        auto f = std::make_shared<FileTransferInfo>(*b);
+        if (fs::exists(f->localPath_nogz()))
+        {
+            mFiles.push_back(f);
+        }
+    }
 }
 
 Work::State
@@ -47,44 +83,42 @@ PutSnapshotFilesWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 2: put all requisite data files
-    if (!mPutFilesWork)
+    // Phase 2: gzip all requisite data files and make their remote dirs
+    if (!mPrepareFilesWork)
     {
-        mPutFilesWork = addWork<Work>("put-files");
-
-        std::vector<std::shared_ptr<FileTransferInfo>> files = {
-            mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
-            mSnapshot->mTransactionResultSnapFile,
-            mSnapshot->mSCPHistorySnapFile};
-
-        std::vector<std::string> bucketsToSend =
-            mSnapshot->mLocalState.differingBuckets(mRemoteState);
-
-        for (auto const& hash : bucketsToSend)
-        {
-            auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
-            assert(b);
-            files.push_back(std::make_shared<FileTransferInfo>(*b));
-        }
-        for (auto f : files)
+        collectFiles();
+        mPrepareFilesWork = addWork<Work>("prepare-files");
+        std::set<std::string> dirs;
+        for (auto const& f : mFiles)
         {
-            if (f && fs::exists(f->localPath_nogz()))
+            mPrepareFilesWork->addWork<GzipFileWork>(f->localPath_nogz(),
+                                                     true);
+            if (dirs.insert(f->remoteDir()).second)
             {
-                auto put = mPutFilesWork->addWork<PutRemoteFileWork>(
-                    f->localPath_gz(), f->remoteName(), mArchive);
-                auto mkdir =
-                    put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
-                mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true);
+                mPrepareFilesWork->addWork<MakeRemoteDirWork>(f->remoteDir(),
+                                                              mArchive);
             }
         }
         return WORK_PENDING;
     }
 
-    // Phase 3: update remote history archive state
-    if (!mPutHistoryArchiveStateWork)
+    // Phase 3: put all requisite data files
+    if (!mPutFilesWork)
+    {
+        mPutFilesWork = addWork<Work>("put-files");
+        for (auto const& f : mFiles)
+        {
+            mPutFilesWork->addWork<PutRemoteFileWork>(
+                f->localPath_gz(), f->remoteName(), mArchive);
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 4: update remote history archive state, one snapshot at a time
+    if (mStatesPut < mSnapshots.size())
     {
-        mPutHistoryArchiveStateWork = addWork<PutHistoryArchiveStateWork>(
-            mSnapshot->mLocalState, mArchive);
+        addWork<PutHistoryArchiveStateWork>(
+            mSnapshots[mStatesPut++]->mLocalState, mArchive);
         return WORK_PENDING;
     }
 
@@ -7,25 +7,39 @@
 #include "history/HistoryArchive.h"
 #include "work/Work.h"
 
+#include <vector>
+
 namespace stellar
 {
 
 struct StateSnapshot;
 
+class FileTransferInfo;
+
 class PutSnapshotFilesWork : public Work
 {
+    // Uploads the files of a batch of snapshots to one archive. Buckets that
+    // several snapshots refer to are uploaded once, and every remote
+    // directory is made once, in parallel with gzipping the files, rather
+    // than once per file. The archive states are put last, oldest first, so
+    // the archive's well-known state never moves backwards.
     std::shared_ptr<HistoryArchive const> mArchive;
-    std::shared_ptr<StateSnapshot> mSnapshot;
+    std::vector<std::shared_ptr<StateSnapshot>> mSnapshots;
     HistoryArchiveState mRemoteState;
+    std::vector<std::shared_ptr<FileTransferInfo>> mFiles;
 
     std::shared_ptr<Work> mGetHistoryArchiveStateWork;
+    std::shared_ptr<Work> mPrepareFilesWork;
     std::shared_ptr<Work> mPutFilesWork;
-    std::shared_ptr<Work> mPutHistoryArchiveStateWork;
+    size_t mStatesPut;
+
+    void collectFiles();
 
   public:
-    PutSnapshotFilesWork(Application& app, WorkParent& parent,
-                         std::shared_ptr<HistoryArchive const> archive,
-                         std::shared_ptr<StateSnapshot> snapshot);
+    PutSnapshotFilesWork(
+        Application& app, WorkParent& parent,
+        std::shared_ptr<HistoryArchive const> archive,
+        std::vector<std::shared_ptr<StateSnapshot>> const& snapshots);
     void onReset() override;
     Work::State onSuccess() override;
 };
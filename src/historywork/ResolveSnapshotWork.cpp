@@ -5,6 +5,7 @@
 #include "historywork/ResolveSnapshotWork.h"
 #include "history/StateSnapshot.h"
 #include "ledger/LedgerManager.h"
+#include "lib/util/format.h"
 #include "main/Application.h"
 
 namespace stellar
@@ -13,7 +14,10 @@ namespace stellar
 ResolveSnapshotWork::ResolveSnapshotWork(
     Application& app, WorkParent& parent,
     std::shared_ptr<StateSnapshot> snapshot)
-    : Work(app, parent, "prepare-snapshot", Work::RETRY_FOREVER)
+    : Work(app, parent,
+           fmt::format("prepare-snapshot-{:08x}",
+                       snapshot->mLocalState.currentLedger),
+           Work::RETRY_FOREVER)
     , mSnapshot(snapshot)
 {
 }
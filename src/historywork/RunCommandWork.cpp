@@ -15,6 +15,12 @@ RunCommandWork::RunCommandWork(Application& app, WorkParent& parent,
 {
 }
 
+std::string
+RunCommandWork::getHelperCommand() const
+{
+    return "";
+}
+
 void
 RunCommandWork::onStart()
 {
@@ -22,7 +28,11 @@ RunCommandWork::onStart()
     getCommand(cmd, outfile);
     if (!cmd.empty())
     {
-        auto exit = mApp.getProcessManager().runProcess(cmd, outfile);
+        auto helper = getHelperCommand();
+        auto exit =
+            (helper.empty() || !outfile.empty())
+                ? mApp.getProcessManager().runProcess(cmd, outfile)
+                : mApp.getProcessManager().runOnHelper(helper, cmd);
         exit.async_wait(callComplete());
     }
     else
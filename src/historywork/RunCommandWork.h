@@ -18,6 +18,9 @@ namespace stellar
 class RunCommandWork : public Work
 {
     virtual void getCommand(std::string& cmdLine, std::string& outFile) = 0;
+    // If non-empty, commands without an output file are sent to persistent
+    // helper processes running this command line instead of being spawned.
+    virtual std::string getHelperCommand() const;
 
   public:
     RunCommandWork(Application& app, WorkParent& parent,
@@ -10,8 +10,6 @@
 #include "util/Fs.h"
 #include "util/Logging.h"
 
-#include <fstream>
-
 namespace stellar
 {
 
@@ -29,51 +27,35 @@ VerifyBucketWork::VerifyBucketWork(
 }
 
 void
-VerifyBucketWork::onStart()
+VerifyBucketWork::onRun()
 {
     std::string filename = mBucketFile;
     uint256 hash = mHash;
-    Application& app = this->mApp;
-    auto handler = callComplete();
-    app.getWorkerIOService().post([&app, filename, handler, hash]() {
-        auto hasher = SHA256::create();
-        asio::error_code ec;
-        char buf[4096];
+    scheduleOnExecutor([filename, hash]() -> CompleteResult {
+        uint256 vHash;
+        try
+        {
+            vHash = sha256File(filename);
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History") << "FAILED verifying hash for "
+                                     << filename << ": " << e.what();
+            return WORK_COMPLETE_FAILURE;
+        }
+        if (vHash == hash)
         {
-            // ensure that the stream gets its own scope to avoid race with
-            // main thread
-            std::ifstream in(filename, std::ifstream::binary);
-            while (in)
-            {
-                in.read(buf, sizeof(buf));
-                hasher->add(ByteSlice(buf, in.gcount()));
-            }
-            uint256 vHash = hasher->finish();
-            if (vHash == hash)
-            {
-                CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
-                                       << ") for " << filename;
-            }
-            else
-            {
-                CLOG(WARNING, "History") << "FAILED verifying hash for "
-                                         << filename;
-                CLOG(WARNING, "History") << "expected hash: " << binToHex(hash);
-                CLOG(WARNING, "History") << "computed hash: "
-                                         << binToHex(vHash);
-                ec = std::make_error_code(std::errc::io_error);
-            }
+            CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
+                                   << ") for " << filename;
+            return WORK_COMPLETE_OK;
         }
-        app.getClock().getIOService().post([ec, handler]() { handler(ec); });
+        CLOG(WARNING, "History") << "FAILED verifying hash for " << filename;
+        CLOG(WARNING, "History") << "expected hash: " << binToHex(hash);
+        CLOG(WARNING, "History") << "computed hash: " << binToHex(vHash);
+        return WORK_COMPLETE_FAILURE;
     });
 }
 
-void
-VerifyBucketWork::onRun()
-{
-    // Do nothing: we spawned the verifier in onStart().
-}
-
 Work::State
 VerifyBucketWork::onSuccess()
 {
@@ -23,7 +23,6 @@ class VerifyBucketWork : public Work
                      std::map<std::string, std::shared_ptr<Bucket>>& buckets,
                      std::string const& bucketFile, uint256 const& hash);
     void onRun() override;
-    void onStart() override;
     Work::State onSuccess() override;
 };
 }
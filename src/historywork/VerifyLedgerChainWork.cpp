@@ -2,15 +2,23 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "historywork/VerifyLedgerChainWork.h"
 #include "history/FileTransferInfo.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
-#include "historywork/Progress.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
+#include "lib/util/format.h"
 #include "main/Application.h"
 #include "util/XDRStream.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <atomic>
+#include <chrono>
+
 namespace stellar
 {
 
@@ -48,6 +56,114 @@ verifyLedgerHistoryLink(Hash const& prev, LedgerHeaderHistoryEntry const& curr)
     return HistoryManager::VERIFY_HASH_OK;
 }
 
+struct VerifyLedgerChainWork::CheckpointResult
+{
+    bool mOk{false};
+    // header at the first ledger the file must link to its predecessor
+    // (none when there is no previous state to connect up with)
+    bool mHasLink{false};
+    Hash mLinkPrevHash;
+    // last header of the file, whose seq is the checkpoint
+    Hash mLastHash;
+};
+
+struct VerifyLedgerChainWork::SharedState
+{
+    std::vector<CheckpointResult> mResults;
+    // full last headers of the first and last checkpoints
+    LedgerHeaderHistoryEntry mFirstCheckpointLast;
+    LedgerHeaderHistoryEntry mLastCheckpointLast;
+    std::atomic<uint32_t> mRemaining{0};
+    std::atomic<uint32_t> mVerified{0};
+    std::atomic<bool> mFailed{false};
+};
+
+// Checks one checkpoint file on its own. `linkSeq` is the first ledger that
+// has to be linked to a predecessor verified elsewhere (earlier headers in
+// the file are harmless prehistory), or 0 to start from the first header.
+static bool
+verifyCheckpointFile(std::string const& path, uint32_t checkpoint,
+                     uint32_t linkSeq,
+                     VerifyLedgerChainWork::CheckpointResult& result,
+                     LedgerHeaderHistoryEntry& last)
+{
+    XDRInputFileStream hdrIn;
+    hdrIn.open(path);
+
+    LedgerHeaderHistoryEntry prev;
+    LedgerHeaderHistoryEntry curr;
+    bool started = false;
+    while (hdrIn && hdrIn.readOne(curr))
+    {
+        if (!started)
+        {
+            if (curr.header.ledgerSeq < linkSeq)
+            {
+                // Harmless prehistory
+                continue;
+            }
+            if (linkSeq != 0 && curr.header.ledgerSeq != linkSeq)
+            {
+                CLOG(ERROR, "History")
+                    << "History chain overshot expected ledger seq "
+                    << linkSeq << ", got " << curr.header.ledgerSeq
+                    << " instead";
+                return false;
+            }
+            if (verifyLedgerHistoryEntry(curr) !=
+                HistoryManager::VERIFY_HASH_OK)
+            {
+                return false;
+            }
+            result.mHasLink = linkSeq != 0;
+            result.mLinkPrevHash = curr.header.previousLedgerHash;
+            started = true;
+            prev = curr;
+            continue;
+        }
+
+        uint32_t expectedSeq = prev.header.ledgerSeq + 1;
+        if (curr.header.ledgerSeq != expectedSeq)
+        {
+            CLOG(ERROR, "History")
+                << "History chain expected ledger seq " << expectedSeq
+                << ", got " << curr.header.ledgerSeq << " instead";
+            return false;
+        }
+        if (verifyLedgerHistoryLink(prev.hash, curr) !=
+            HistoryManager::VERIFY_HASH_OK)
+        {
+            return false;
+        }
+        prev = curr;
+    }
+
+    if (!started && linkSeq > checkpoint &&
+        curr.header.ledgerSeq == checkpoint)
+    {
+        // the whole checkpoint is prehistory: the chain continues from
+        // its last header
+        if (verifyLedgerHistoryEntry(curr) != HistoryManager::VERIFY_HASH_OK)
+        {
+            return false;
+        }
+        started = true;
+        prev = curr;
+    }
+
+    if (!started || prev.header.ledgerSeq != checkpoint)
+    {
+        CLOG(ERROR, "History") << "History chain did not end with "
+                               << checkpoint;
+        return false;
+    }
+
+    result.mLastHash = prev.hash;
+    last = prev;
+    result.mOk = true;
+    return true;
+}
+
 VerifyLedgerChainWork::VerifyLedgerChainWork(
     Application& app, WorkParent& parent, TmpDir const& downloadDir,
     uint32_t first, uint32_t last, bool manualCatchup,
@@ -56,21 +172,46 @@ VerifyLedgerChainWork::VerifyLedgerChainWork(
     : Work(app, parent, "verify-ledger-chain")
     , mDownloadDir(downloadDir)
     , mFirstSeq(first)
-    , mCurrSeq(first)
     , mLastSeq(last)
     , mManualCatchup(manualCatchup)
     , mFirstVerified(firstVerified)
     , mLastVerified(lastVerified)
+    , mVerifyCheckpoint(app.getMetrics().NewMeter(
+          {"history", "verify-ledger-chain", "checkpoint"}, "checkpoint"))
+    , mVerifyChain(app.getMetrics().NewTimer(
+          {"history", "verify-ledger-chain", "time"}))
+{
+}
+
+VerifyLedgerChainWork::~VerifyLedgerChainWork()
+{
+    if (mShared)
+    {
+        // let jobs still queued on the worker threads bail out early
+        mShared->mFailed = true;
+    }
+}
+
+uint32_t
+VerifyLedgerChainWork::getCheckpointCount() const
 {
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    return 1 + (mLastSeq - mFirstSeq) / freq;
 }
 
 std::string
 VerifyLedgerChainWork::getStatus() const
 {
-    if (mState == WORK_RUNNING)
+    if (mState == WORK_RUNNING && mShared)
     {
-        std::string task = "verifying checkpoint";
-        return fmtProgress(mApp, task, mFirstSeq, mLastSeq, mCurrSeq);
+        auto verified = mShared->mVerified.load();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           mApp.getClock().now() - mStartTime)
+                           .count();
+        double seconds = std::max<double>(elapsed, 1) / 1000.0;
+        return fmt::format("verifying checkpoints {:d}/{:d} ({:.2f} "
+                           "checkpoints/s)",
+                           verified, getCheckpointCount(), verified / seconds);
     }
     return Work::getStatus();
 }
@@ -91,115 +232,169 @@ VerifyLedgerChainWork::onReset()
     {
         mLastVerified = setLedger;
     }
-    mCurrSeq = mFirstSeq;
+    if (mShared)
+    {
+        mShared->mFailed = true;
+        mShared.reset();
+    }
 }
 
-HistoryManager::VerifyHashStatus
-VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
+void
+VerifyLedgerChainWork::onStart()
 {
-    FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mCurrSeq);
-    XDRInputFileStream hdrIn;
-    hdrIn.open(ft.localPath_nogz());
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    auto count = getCheckpointCount();
+    auto shared = std::make_shared<SharedState>();
+    shared->mResults.resize(count);
+    shared->mRemaining = count;
+    mShared = shared;
+    mStartTime = mApp.getClock().now();
 
-    LedgerHeaderHistoryEntry prev = mLastVerified;
-    LedgerHeaderHistoryEntry curr;
+    CLOG(DEBUG, "History") << "Verifying ledger headers of " << count
+                           << " checkpoints starting from ledger "
+                           << LedgerManager::ledgerAbbrev(mLastVerified);
 
-    CLOG(DEBUG, "History") << "Verifying ledger headers from "
-                           << ft.localPath_nogz() << " starting from ledger "
-                           << LedgerManager::ledgerAbbrev(prev);
-
-    while (hdrIn && hdrIn.readOne(curr))
+    Application& app = mApp;
+    auto& meter = mVerifyCheckpoint;
+    std::weak_ptr<VerifyLedgerChainWork> weak(
+        std::static_pointer_cast<VerifyLedgerChainWork>(shared_from_this()));
+    for (uint32_t i = 0; i < count; ++i)
     {
-
-        if (prev.header.ledgerSeq == 0)
+        uint32_t checkpoint = mFirstSeq + i * freq;
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                            checkpoint);
+        uint32_t linkSeq;
+        if (i == 0)
         {
-            // When we have no previous state to connect up with
-            // (eg. starting somewhere mid-chain like in CATCHUP_MINIMAL)
-            // we just accept the first chain entry we see. We will
-            // verify the chain continuously from here, and against the
-            // live network.
-            prev = curr;
-            continue;
+            auto prevSeq = mLastVerified.header.ledgerSeq;
+            linkSeq = prevSeq == 0 ? 0 : prevSeq + 1;
         }
-
-        uint32_t expectedSeq = prev.header.ledgerSeq + 1;
-        if (curr.header.ledgerSeq < expectedSeq)
+        else
         {
-            // Harmless prehistory
-            continue;
+            linkSeq = checkpoint - freq + 1;
         }
-        else if (curr.header.ledgerSeq > expectedSeq)
+        bool isFirst = i == 0;
+        bool isLast = i + 1 == count;
+        std::string path = ft.localPath_nogz();
+
+        app.getWorkerIOService().post([&app, &meter, weak, shared, i,
+                                       checkpoint, linkSeq, isFirst, isLast,
+                                       path]() {
+            if (!shared->mFailed)
+            {
+                LedgerHeaderHistoryEntry last;
+                bool ok = false;
+                try
+                {
+                    ok = verifyCheckpointFile(path, checkpoint, linkSeq,
+                                              shared->mResults[i], last);
+                }
+                catch (std::exception& e)
+                {
+                    CLOG(ERROR, "History") << "Failed reading " << path
+                                           << ": " << e.what();
+                }
+                if (ok)
+                {
+                    if (isFirst)
+                    {
+                        shared->mFirstCheckpointLast = last;
+                    }
+                    if (isLast)
+                    {
+                        shared->mLastCheckpointLast = last;
+                    }
+                    ++shared->mVerified;
+                    meter.Mark();
+                }
+                else
+                {
+                    shared->mFailed = true;
+                }
+            }
+            if (--shared->mRemaining == 0)
+            {
+                app.getClock().getIOService().post([weak, shared]() {
+                    auto self = weak.lock();
+                    // a reset may have started another round meanwhile
+                    if (!self || self->mShared != shared)
+                    {
+                        return;
+                    }
+                    self->complete(shared->mFailed ? WORK_COMPLETE_FATAL
+                                                   : WORK_COMPLETE_OK);
+                });
+            }
+        });
+    }
+}
+
+void
+VerifyLedgerChainWork::onRun()
+{
+    // Do nothing: we spawned the verifiers in onStart().
+}
+
+HistoryManager::VerifyHashStatus
+VerifyLedgerChainWork::verifyCheckpointLinks()
+{
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    auto const& results = mShared->mResults;
+
+    Hash prevHash = mLastVerified.hash;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        auto const& r = results[i];
+        assert(r.mOk);
+        if (r.mHasLink && r.mLinkPrevHash != prevHash)
         {
             CLOG(ERROR, "History")
-                << "History chain overshot expected ledger seq " << expectedSeq
-                << ", got " << curr.header.ledgerSeq << " instead";
+                << "Bad hash-chain: checkpoint " << (mFirstSeq + i * freq)
+                << " wants prev hash " << hexAbbrev(r.mLinkPrevHash)
+                << " but actual prev hash is " << hexAbbrev(prevHash);
             return HistoryManager::VERIFY_HASH_BAD;
         }
-        if (verifyLedgerHistoryLink(prev.hash, curr) !=
-            HistoryManager::VERIFY_HASH_OK)
-        {
-            return HistoryManager::VERIFY_HASH_BAD;
-        }
-        prev = curr;
+        prevHash = r.mLastHash;
     }
 
-    if (curr.header.ledgerSeq != mCurrSeq)
+    auto const& last = mShared->mLastCheckpointLast;
+    CLOG(INFO, "History") << "Verifying catchup candidate " << mLastSeq
+                          << " with LedgerManager";
+    auto status = mApp.getLedgerManager().verifyCatchupCandidate(last);
+    if ((status == HistoryManager::VERIFY_HASH_UNKNOWN_RECOVERABLE ||
+         status == HistoryManager::VERIFY_HASH_UNKNOWN_UNRECOVERABLE) &&
+        mManualCatchup)
     {
-        CLOG(ERROR, "History") << "History chain did not end with " << mCurrSeq;
-        return HistoryManager::VERIFY_HASH_BAD;
-    }
-
-    auto status = HistoryManager::VERIFY_HASH_OK;
-    if (mCurrSeq == mLastSeq)
-    {
-        CLOG(INFO, "History") << "Verifying catchup candidate " << mCurrSeq
-                              << " with LedgerManager";
-        status = mApp.getLedgerManager().verifyCatchupCandidate(curr);
-        if ((status == HistoryManager::VERIFY_HASH_UNKNOWN_RECOVERABLE ||
-             status == HistoryManager::VERIFY_HASH_UNKNOWN_UNRECOVERABLE) &&
-            mManualCatchup)
-        {
-            CLOG(WARNING, "History")
-                << "Accepting unknown-hash ledger due to manual catchup";
-            status = HistoryManager::VERIFY_HASH_OK;
-        }
+        CLOG(WARNING, "History")
+            << "Accepting unknown-hash ledger due to manual catchup";
+        status = HistoryManager::VERIFY_HASH_OK;
     }
 
     if (status == HistoryManager::VERIFY_HASH_OK)
     {
-        if (mCurrSeq == mFirstSeq)
-        {
-            mFirstVerified = curr;
-        }
-        mLastVerified = curr;
+        mFirstVerified = mShared->mFirstCheckpointLast;
+        mLastVerified = last;
     }
-
     return status;
 }
 
 Work::State
 VerifyLedgerChainWork::onSuccess()
 {
-    mApp.getHistoryManager().logAndUpdateStatus(true);
-
-    if (mCurrSeq > mLastSeq)
+    // This is in onSuccess rather than onRun, so we can force a FAILURE_RAISE.
+    HistoryManager::VerifyHashStatus status;
     {
-        throw std::runtime_error("Verification overshot target ledger");
+        auto timer = mVerifyChain.TimeScope();
+        status = verifyCheckpointLinks();
     }
+    mApp.getHistoryManager().logAndUpdateStatus(true);
 
-    // This is in onSuccess rather than onRun, so we can force a FAILURE_RAISE.
-    switch (verifyHistoryOfSingleCheckpoint())
+    switch (status)
     {
     case HistoryManager::VERIFY_HASH_OK:
-        if (mCurrSeq == mLastSeq)
-        {
-            CLOG(INFO, "History") << "History chain [" << mFirstSeq << ","
-                                  << mLastSeq << "] verified";
-            return WORK_SUCCESS;
-        }
-
-        mCurrSeq += mApp.getHistoryManager().getCheckpointFrequency();
-        return WORK_RUNNING;
+        CLOG(INFO, "History") << "History chain [" << mFirstSeq << ","
+                              << mLastSeq << "] verified";
+        return WORK_SUCCESS;
     case HistoryManager::VERIFY_HASH_UNKNOWN_RECOVERABLE:
         CLOG(WARNING, "History")
             << "Catchup material verification inconclusive, retrying";
@@ -5,25 +5,51 @@
 #pragma once
 
 #include "history/HistoryManager.h"
+#include "util/Timer.h"
 #include "work/Work.h"
 
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
 namespace stellar
 {
 
 class TmpDir;
 struct LedgerHeaderHistoryEntry;
 
+// Verifies the downloaded ledger-header files of [firstSeq, lastSeq].
+//
+// Each checkpoint file is checked on its own on the worker threads: every
+// header hashes to its claimed hash, headers are contiguous and each one
+// links to its predecessor in the file. Once all are done, the links
+// between adjacent checkpoints (and to the last verified ledger) are
+// checked in order on the main thread, then the last header is checked
+// against the LedgerManager.
 class VerifyLedgerChainWork : public Work
 {
+  public:
+    struct CheckpointResult;
+    struct SharedState;
+
+  private:
     TmpDir const& mDownloadDir;
     uint32_t mFirstSeq;
-    uint32_t mCurrSeq;
     uint32_t mLastSeq;
     bool mManualCatchup;
     LedgerHeaderHistoryEntry& mFirstVerified;
     LedgerHeaderHistoryEntry& mLastVerified;
 
-    HistoryManager::VerifyHashStatus verifyHistoryOfSingleCheckpoint();
+    std::shared_ptr<SharedState> mShared;
+    VirtualClock::time_point mStartTime;
+
+    medida::Meter& mVerifyCheckpoint;
+    medida::Timer& mVerifyChain;
+
+    uint32_t getCheckpointCount() const;
+    HistoryManager::VerifyHashStatus verifyCheckpointLinks();
 
   public:
     VerifyLedgerChainWork(Application& app, WorkParent& parent,
@@ -31,8 +57,11 @@ class VerifyLedgerChainWork : public Work
                           uint32_t lastSeq, bool manualCatchup,
                           LedgerHeaderHistoryEntry& firstVerified,
                           LedgerHeaderHistoryEntry& lastVerified);
+    ~VerifyLedgerChainWork();
     std::string getStatus() const override;
     void onReset() override;
+    void onStart() override;
+    void onRun() override;
     Work::State onSuccess() override;
 };
 }
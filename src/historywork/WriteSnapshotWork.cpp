@@ -7,6 +7,7 @@
 #include "history/StateSnapshot.h"
 #include "historywork/Progress.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "lib/util/format.h"
 #include "main/Application.h"
 #include "util/XDRStream.h"
 
@@ -15,7 +16,10 @@ namespace stellar
 
 WriteSnapshotWork::WriteSnapshotWork(Application& app, WorkParent& parent,
                                      std::shared_ptr<StateSnapshot> snapshot)
-    : Work(app, parent, "write-snapshot", Work::RETRY_A_LOT)
+    : Work(app, parent,
+           fmt::format("write-snapshot-{:08x}",
+                       snapshot->mLocalState.currentLedger),
+           Work::RETRY_A_LOT)
     , mSnapshot(snapshot)
 {
 }
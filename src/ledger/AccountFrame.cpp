@@ -14,6 +14,7 @@
 #include "util/basen.h"
 #include "util/types.h"
 #include <algorithm>
+#include <set>
 
 using namespace soci;
 using namespace std;
@@ -223,18 +224,22 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 
     std::string actIDStrKey = KeyUtils::toStrKey(accountID);
 
-    std::string publicKey, inflationDest, creditAuthKey;
-    std::string homeDomain, thresholds;
-    soci::indicator inflationDestInd;
+    std::string inflationDest, homeDomain, thresholds, signerKey;
+    soci::indicator inflationDestInd, signerKeyInd, signerWeightInd;
+    uint32_t signerWeight;
 
     AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
     AccountEntry& account = res->getAccount();
 
-    auto prep =
-        db.getPreparedStatement("SELECT balance, seqnum, numsubentries, "
-                                "inflationdest, homedomain, thresholds, "
-                                "flags, lastmodified "
-                                "FROM accounts WHERE accountid=:v1");
+    // signers are loaded with the account in a single statement: the join
+    // returns one row per signer, or a single row with NULL signer columns
+    // when the account has no signers
+    auto prep = db.getPreparedStatement(
+        "SELECT a.balance, a.seqnum, a.numsubentries, a.inflationdest, "
+        "a.homedomain, a.thresholds, a.flags, a.lastmodified, "
+        "s.publickey, s.weight "
+        "FROM accounts a LEFT OUTER JOIN signers s "
+        "ON a.accountid = s.accountid WHERE a.accountid=:v1");
     auto& st = prep.statement();
     st.exchange(into(account.balance));
     st.exchange(into(account.seqNum));
@@ -244,6 +249,8 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     st.exchange(into(thresholds));
     st.exchange(into(account.flags));
     st.exchange(into(res->getLastModified()));
+    st.exchange(into(signerKey, signerKeyInd));
+    st.exchange(into(signerWeight, signerWeightInd));
     st.exchange(use(actIDStrKey));
     st.define_and_bind();
     {
@@ -257,32 +264,187 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
         return nullptr;
     }
 
-    account.homeDomain = homeDomain;
+    res->setFromDBFields(homeDomain, thresholds, inflationDestInd == soci::i_ok,
+                         inflationDest);
 
-    bn::decode_b64(thresholds.begin(), thresholds.end(),
-                   res->mAccountEntry.thresholds.begin());
+    account.signers.clear();
+    while (st.got_data())
+    {
+        if (signerKeyInd == soci::i_ok)
+        {
+            assert(signerWeightInd == soci::i_ok);
+            Signer signer;
+            signer.key = KeyUtils::fromStrKey<SignerKey>(signerKey);
+            signer.weight = signerWeight;
+            account.signers.push_back(signer);
+        }
+        st.fetch();
+    }
 
-    if (inflationDestInd == soci::i_ok)
+    res->finishLoad(db);
+    return res;
+}
+
+void
+AccountFrame::prefetchAccounts(std::vector<AccountID> const& accountIDs,
+                               Database& db)
+{
+    // keep the IN lists small enough for both backends to plan efficiently
+    size_t const batchSize = 256;
+
+    std::vector<std::string> toLoad;
+    std::set<AccountID> seen;
+    for (auto const& accountID : accountIDs)
     {
-        account.inflationDest.activate() =
-            KeyUtils::fromStrKey<PublicKey>(inflationDest);
+        if (!seen.insert(accountID).second)
+        {
+            continue;
+        }
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = accountID;
+        if (!cachedEntryExists(key, db))
+        {
+            toLoad.emplace_back(KeyUtils::toStrKey(accountID));
+        }
     }
 
-    account.signers.clear();
+    for (size_t begin = 0; begin < toLoad.size(); begin += batchSize)
+    {
+        size_t end = std::min(begin + batchSize, toLoad.size());
+
+        // strkeys only contain base32 characters, so they can be inlined
+        // in the query text safely
+        std::string inList;
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (!inList.empty())
+            {
+                inList += ", ";
+            }
+            inList += "'" + toLoad[i] + "'";
+        }
+
+        std::map<std::string, AccountFrame::pointer> loaded;
+        std::string withSigners;
+        {
+            std::string actIDStrKey, inflationDest, homeDomain, thresholds;
+            soci::indicator inflationDestInd;
+            AccountEntry row;
+            uint32 lastModified;
+
+            soci::statement st =
+                (db.getSession().prepare
+                     << "SELECT accountid, balance, seqnum, numsubentries, "
+                        "inflationdest, homedomain, thresholds, flags, "
+                        "lastmodified FROM accounts WHERE accountid IN (" +
+                            inList + ")",
+                 into(actIDStrKey), into(row.balance), into(row.seqNum),
+                 into(row.numSubEntries), into(inflationDest, inflationDestInd),
+                 into(homeDomain), into(thresholds), into(row.flags),
+                 into(lastModified));
+            {
+                auto timer = db.getSelectTimer("account");
+                st.execute(true);
+            }
+            while (st.got_data())
+            {
+                auto res = make_shared<AccountFrame>(
+                    KeyUtils::fromStrKey<PublicKey>(actIDStrKey));
+                AccountEntry& account = res->getAccount();
+                account.balance = row.balance;
+                account.seqNum = row.seqNum;
+                account.numSubEntries = row.numSubEntries;
+                account.flags = row.flags;
+                res->getLastModified() = lastModified;
+                res->setFromDBFields(homeDomain, thresholds,
+                                     inflationDestInd == soci::i_ok,
+                                     inflationDest);
+                account.signers.clear();
+
+                if (account.numSubEntries != 0)
+                {
+                    if (!withSigners.empty())
+                    {
+                        withSigners += ", ";
+                    }
+                    withSigners += "'" + actIDStrKey + "'";
+                }
+                loaded.emplace(actIDStrKey, res);
+                st.fetch();
+            }
+        }
+
+        if (!withSigners.empty())
+        {
+            std::string actIDStrKey, pubKey;
+            Signer signer;
+
+            soci::statement st =
+                (db.getSession().prepare << "SELECT accountid, publickey, "
+                                            "weight FROM signers WHERE "
+                                            "accountid IN (" +
+                                                withSigners + ")",
+                 into(actIDStrKey), into(pubKey), into(signer.weight));
+            {
+                auto timer = db.getSelectTimer("signer");
+                st.execute(true);
+            }
+            while (st.got_data())
+            {
+                auto it = loaded.find(actIDStrKey);
+                assert(it != loaded.end());
+                signer.key = KeyUtils::fromStrKey<SignerKey>(pubKey);
+                it->second->getAccount().signers.push_back(signer);
+                st.fetch();
+            }
+        }
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto it = loaded.find(toLoad[i]);
+            if (it == loaded.end())
+            {
+                LedgerKey key;
+                key.type(ACCOUNT);
+                key.account().accountID =
+                    KeyUtils::fromStrKey<PublicKey>(toLoad[i]);
+                putCachedEntry(key, nullptr, db);
+            }
+            else
+            {
+                it->second->finishLoad(db);
+            }
+        }
+    }
+}
+
+void
+AccountFrame::setFromDBFields(std::string const& homeDomain,
+                              std::string const& thresholds,
+                              bool hasInflationDest,
+                              std::string const& inflationDest)
+{
+    mAccountEntry.homeDomain = homeDomain;
 
-    if (account.numSubEntries != 0)
+    bn::decode_b64(thresholds.begin(), thresholds.end(),
+                   mAccountEntry.thresholds.begin());
+
+    if (hasInflationDest)
     {
-        auto signers = loadSigners(db, actIDStrKey);
-        account.signers.insert(account.signers.begin(), signers.begin(),
-                               signers.end());
+        mAccountEntry.inflationDest.activate() =
+            KeyUtils::fromStrKey<PublicKey>(inflationDest);
     }
+}
 
-    res->normalize();
-    res->mUpdateSigners = false;
-    assert(res->isValid());
-    res->mKeyCalculated = false;
-    res->putCachedEntry(db);
-    return res;
+void
+AccountFrame::finishLoad(Database& db)
+{
+    normalize();
+    mUpdateSigners = false;
+    assert(isValid());
+    mKeyCalculated = false;
+    putCachedEntry(db);
 }
 
 std::vector<Signer>
@@ -37,6 +37,10 @@ class AccountFrame : public EntryFrame
 
     static std::vector<Signer> loadSigners(Database& db,
                                            std::string const& actIDStrKey);
+    void setFromDBFields(std::string const& homeDomain,
+                         std::string const& thresholds, bool hasInflationDest,
+                         std::string const& inflationDest);
+    void finishLoad(Database& db);
     void applySigners(Database& db, bool insert);
 
   public:
@@ -126,6 +130,13 @@ class AccountFrame : public EntryFrame
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
 
+    // loads the given accounts and their signers into the entry cache using
+    // a few batched queries, so that subsequent calls to loadAccount for
+    // these accounts do not hit the database. Accounts already present in the
+    // cache are skipped, missing accounts are cached as non existent.
+    static void prefetchAccounts(std::vector<AccountID> const& accountIDs,
+                                 Database& db);
+
     // compare signers, ignores weight
     static bool signerCompare(Signer const& s1, Signer const& s2);
 
@@ -12,6 +12,8 @@
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
@@ -272,5 +274,66 @@ TEST_CASE("Ledger Entry tests", "[ledgerentry]")
 
         app->getLedgerManager().checkDbState();
     }
+
+    SECTION("prefetch accounts")
+    {
+        LedgerHeader lh;
+        LedgerDelta delta(lh, db, false);
+
+        std::vector<AccountID> ids;
+        std::unordered_map<AccountID, AccountEntry> accountsMap;
+        for (int i = 0; i < 300; i++)
+        {
+            LedgerEntry l;
+            l.data.type(ACCOUNT);
+            l.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+            auto const& a = l.data.account();
+            if (accountsMap.insert(std::make_pair(a.accountID, a)).second)
+            {
+                ids.emplace_back(a.accountID);
+                auto af = std::make_shared<AccountFrame>(l);
+                af->storeAdd(delta, db);
+            }
+        }
+        // an account that is not in the database
+        auto missing = LedgerTestUtils::generateValidAccountEntry(5).accountID;
+        ids.emplace_back(missing);
+
+        db.getEntryCache().clear();
+
+        auto& accountSelect =
+            app->getMetrics().NewTimer({"database", "select", "account"});
+        auto& signerSelect =
+            app->getMetrics().NewTimer({"database", "select", "signer"});
+        auto accountsBefore = accountSelect.count();
+        auto signersBefore = signerSelect.count();
+
+        AccountFrame::prefetchAccounts(ids, db);
+
+        // a few batched queries instead of one per account (and signers)
+        REQUIRE(accountSelect.count() - accountsBefore == 2);
+        REQUIRE(signerSelect.count() - signersBefore <= 2);
+
+        accountsBefore = accountSelect.count();
+        signersBefore = signerSelect.count();
+        for (auto const& a : accountsMap)
+        {
+            auto fromDb = AccountFrame::loadAccount(a.first, db);
+            REQUIRE(fromDb);
+            REQUIRE(fromDb->getAccount() == a.second);
+        }
+        REQUIRE(AccountFrame::loadAccount(missing, db) == nullptr);
+        REQUIRE(accountSelect.count() == accountsBefore);
+        REQUIRE(signerSelect.count() == signersBefore);
+
+        // single account loads fetch signers within the same statement
+        db.getEntryCache().clear();
+        for (auto const& a : accountsMap)
+        {
+            AccountFrame::loadAccount(a.first, db);
+        }
+        REQUIRE(accountSelect.count() - accountsBefore == accountsMap.size());
+        REQUIRE(signerSelect.count() == signersBefore);
+    }
 }
 }
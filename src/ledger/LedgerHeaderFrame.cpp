@@ -8,6 +8,7 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
 #include "util/format.h"
@@ -196,12 +197,16 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
 
     assert(begin <= end);
 
-    soci::statement st =
-        (sess.prepare << "SELECT data FROM ledgerheaders "
-                         "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
-                         "BY ledgerseq ASC",
-         into(headerEncoded), use(begin), use(end));
-
+    auto prep = db.getPreparedStatement(
+        "SELECT data FROM ledgerheaders "
+        "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
+        "BY ledgerseq ASC",
+        sess);
+    auto& st = prep.statement();
+    st.exchange(into(headerEncoded));
+    st.exchange(use(begin));
+    st.exchange(use(end));
+    st.define_and_bind();
     st.execute(true);
     while (st.got_data())
     {
@@ -218,11 +223,12 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
     return n;
 }
 
-void
-LedgerHeaderFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq)
+size_t
+LedgerHeaderFrame::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                    uint32_t count)
 {
-    db.getSession() << "DELETE FROM ledgerheaders WHERE ledgerseq <= "
-                    << ledgerSeq;
+    return deleteOldEntriesHelper(sess, ledgerSeq, count, "ledgerheaders",
+                                  "ledgerseq");
 }
 
 void
@@ -54,7 +54,10 @@ class LedgerHeaderFrame
                                             uint32_t ledgerCount,
                                             XDROutputFileStream& headersOut);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq);
+    // deletes the headers of the `count` oldest ledgers <= ledgerSeq,
+    // returns the number of rows deleted
+    static size_t deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                   uint32_t count);
 
     static void dropAll(Database& db);
     static const char* kSQLCreateStatement;
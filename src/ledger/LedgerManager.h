@@ -8,6 +8,11 @@
 #include "history/HistoryManager.h"
 #include <memory>
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 
@@ -168,8 +173,12 @@ class LedgerManager
     // permit testing.
     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
-    // deletes old entries stored in the database
-    virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq) = 0;
+    // deletes the entries stored in the database for the `count` oldest
+    // ledgers <= ledgerSeq, returns the number of rows deleted (0 once
+    // there is nothing left to delete). Can be called from a worker thread
+    // with a session from the connection pool.
+    virtual size_t deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                    uint32_t count) = 0;
 
     // checks the database for inconsistencies between objects
     virtual void checkDbState() = 0;
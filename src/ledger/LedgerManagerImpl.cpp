@@ -7,6 +7,7 @@
 #include "DebitFrame.h"
 #include "OfferFrame.h"
 #include "TrustFrame.h"
+#include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
@@ -21,14 +22,17 @@
 #include "invariant/Invariants.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/TxApplyStages.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "transactions/SignatureChecker.h"
 #include "util/Logging.h"
 #include "util/format.h"
 #include "util/make_unique.h"
 
 #include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
@@ -36,6 +40,7 @@
 #include "xdrpp/types.h"
 
 #include <chrono>
+#include <numeric>
 #include <sstream>
 
 /*
@@ -106,6 +111,29 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
     , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mLedgerClosePrefetch(
+          app.getMetrics().NewTimer({"ledger", "close", "prefetch"}))
+    , mLedgerCloseFees(app.getMetrics().NewTimer({"ledger", "close", "fees"}))
+    , mLedgerCloseApply(
+          app.getMetrics().NewTimer({"ledger", "close", "apply"}))
+    , mLedgerCloseInvariants(
+          app.getMetrics().NewTimer({"ledger", "close", "invariants"}))
+    , mLedgerCloseBuckets(
+          app.getMetrics().NewTimer({"ledger", "close", "buckets"}))
+    , mLedgerCloseHeader(
+          app.getMetrics().NewTimer({"ledger", "close", "header"}))
+    , mLedgerCloseHAS(app.getMetrics().NewTimer({"ledger", "close", "has"}))
+    , mLedgerCloseHASLevels(
+          app.getMetrics().NewMeter({"ledger", "close", "has-levels"}, "level"))
+    , mLedgerCloseCommit(
+          app.getMetrics().NewTimer({"ledger", "close", "commit"}))
+    , mLedgerClosePublish(
+          app.getMetrics().NewTimer({"ledger", "close", "publish"}))
+    , mLedgerCloseBucketGC(
+          app.getMetrics().NewTimer({"ledger", "close", "bucket-gc"}))
+    , mApplyStages(app.getMetrics().NewHistogram({"ledger", "apply", "stages"}))
+    , mApplyStageWidth(
+          app.getMetrics().NewHistogram({"ledger", "apply", "stage-width"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -117,6 +145,9 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mBucketGCScheduled(false)
+    , mMergeStateSaveDue(false)
+    , mBucketGCTimer(app)
     , mState(LM_BOOTING_STATE)
 
 {
@@ -221,10 +252,7 @@ LedgerManagerImpl::loadLastKnownLedger(
 
         if (handler)
         {
-            string hasString = mApp.getPersistentState().getState(
-                PersistentState::kHistoryArchiveState);
-            HistoryArchiveState has;
-            has.fromString(hasString);
+            auto has = loadBucketListState();
 
             auto continuation = [this, handler,
                                  has](asio::error_code const& ec) {
@@ -719,13 +747,42 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // sorted such that sequence numbers are respected
     vector<TransactionFramePtr> txs = ledgerData.getTxSet()->sortForApply();
 
-    // first, charge fees
-    processFeesSeqNums(txs, ledgerDelta);
+    // group transactions that do not conflict with one another
+    TxApplyStages stages(txs);
+
+    {
+        auto timer = mLedgerClosePrefetch.TimeScope();
+
+        // load all accounts the transactions touch in bulk instead of one by
+        // one
+        std::vector<AccountID> accountIDs(stages.getAccounts().begin(),
+                                          stages.getAccounts().end());
+        AccountFrame::prefetchAccounts(accountIDs, getDatabase());
+
+        // verify the signatures of the whole set up front, in parallel, so
+        // that signature checks during apply hit the verify cache
+        std::vector<SignatureToVerify> sigs;
+        for (auto const& tx : txs)
+        {
+            tx->collectSignaturesToVerify(getDatabase(), sigs);
+        }
+        SignatureChecker::verifyBatch(mApp, std::move(sigs));
+    }
+
+    {
+        auto timer = mLedgerCloseFees.TimeScope();
+
+        // first, charge fees
+        processFeesSeqNums(txs, ledgerDelta);
+    }
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
 
-    applyTransactions(txs, ledgerDelta, txResultSet);
+    {
+        auto timer = mLedgerCloseApply.TimeScope();
+        applyTransactions(txs, stages, ledgerDelta, txResultSet);
+    }
 
     ledgerDelta.getHeader().txSetResultHash =
         sha256(xdr::xdr_to_opaque(txResultSet));
@@ -766,7 +823,10 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         }
     }
 
-    mApp.getInvariants().check(ledgerData.getTxSet(), ledgerDelta);
+    {
+        auto timer = mLedgerCloseInvariants.TimeScope();
+        mApp.getInvariants().check(ledgerData.getTxSet(), ledgerDelta);
+    }
 
     ledgerDelta.commit();
     ledgerClosed(ledgerDelta);
@@ -787,32 +847,73 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     //    bucket refcounts are incremented for the duration of the publish).
     //
     // 4. GC unreferenced buckets. Only do this once publishes are in progress.
+    //    Nothing in the next ledger close depends on it, so it is deferred
+    //    until after the current event (and SCP work queued behind it).
 
     // step 1
     auto& hm = mApp.getHistoryManager();
-    hm.maybeQueueHistoryCheckpoint();
+    {
+        auto timer = mLedgerCloseCommit.TimeScope();
+        hm.maybeQueueHistoryCheckpoint();
 
-    // step 2
-    mApp.getDatabase().clearPreparedStatementCache();
-    txscope.commit();
+        // step 2
+        txscope.commit();
+    }
 
     // step 3
-    hm.publishQueuedHistory();
-    hm.logAndUpdateStatus(true);
+    {
+        auto timer = mLedgerClosePublish.TimeScope();
+        hm.publishQueuedHistory();
+        hm.logAndUpdateStatus(true);
+    }
 
     // step 4
-    if (getState() != LM_CATCHING_UP_STATE)
+    scheduleBucketGC();
+}
+
+void
+LedgerManagerImpl::scheduleBucketGC()
+{
+    auto lcl = getLastClosedLedgerNum();
+    if (mApp.getHistoryManager().nextCheckpointLedger(lcl + 1) == lcl + 1)
     {
-        mApp.getBucketManager().forgetUnreferencedBuckets();
+        mMergeStateSaveDue = true;
     }
+
+    if (mBucketGCScheduled)
+    {
+        return;
+    }
+    mBucketGCScheduled = true;
+    mBucketGCTimer.expires_from_now(std::chrono::seconds(0));
+    mBucketGCTimer.async_wait(
+        [this]() {
+            mBucketGCScheduled = false;
+            if (getState() == LM_CATCHING_UP_STATE)
+            {
+                return;
+            }
+            auto& bm = mApp.getBucketManager();
+            {
+                auto timer = mLedgerCloseBucketGC.TimeScope();
+                bm.forgetUnreferencedBuckets();
+            }
+            if (mMergeStateSaveDue)
+            {
+                bm.saveMergeState();
+                mMergeStateSaveDue = false;
+            }
+        },
+        &VirtualTimer::onFailureNoop);
 }
 
-void
-LedgerManagerImpl::deleteOldEntries(Database& db, uint32_t ledgerSeq)
+size_t
+LedgerManagerImpl::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                    uint32_t count)
 {
-    LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq);
-    TransactionFrame::deleteOldEntries(db, ledgerSeq);
-    Herder::deleteOldEntries(db, ledgerSeq);
+    return LedgerHeaderFrame::deleteOldEntries(sess, ledgerSeq, count) +
+           TransactionFrame::deleteOldEntries(sess, ledgerSeq, count) +
+           Herder::deleteOldEntries(sess, ledgerSeq, count);
 }
 
 void
@@ -936,21 +1037,41 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
 
 void
 LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
+                                     TxApplyStages const& stages,
                                      LedgerDelta& ledgerDelta,
                                      TransactionResultSet& txResultSet)
 {
     CLOG(DEBUG, "Tx") << "applyTransactions: ledger = "
                       << mCurrentLedger->mHeader.ledgerSeq;
-    int index = 0;
-    for (auto tx : txs)
+
+    mApplyStages.Update(stages.getStages().size());
+    mApplyStageWidth.Update(stages.getMaxWidth());
+
+    // transactions are applied one after the other on the close session,
+    // never concurrently; reordering them by stage is only done to check
+    // that stages are independent
+    std::vector<size_t> order;
+    if (mApp.getConfig().ARTIFICIALLY_APPLY_BY_STAGE_FOR_TESTING)
+    {
+        order = stages.getApplyOrder();
+    }
+    else
+    {
+        order.resize(txs.size());
+        std::iota(order.begin(), order.end(), 0);
+    }
+
+    std::vector<TransactionMeta> metas(txs.size());
+    for (auto i : order)
     {
+        auto tx = txs[i];
         auto txTime = mTransactionApply.TimeScope();
         LedgerDelta delta(ledgerDelta);
-        TransactionMeta tm;
+        TransactionMeta& tm = metas[i];
         try
         {
             CLOG(DEBUG, "Tx")
-                << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
+                << " tx#" << i << " = " << hexAbbrev(tx->getFullHash())
                 << " txseq=" << tx->getSeqNum() << " (@ "
                 << mApp.getConfig().toShortString(tx->getSourceID()) << ")";
 
@@ -979,7 +1100,12 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
             CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
             tx->getResult().result.code(txINTERNAL_ERROR);
         }
-        tx->storeTransaction(*this, tm, ++index, txResultSet);
+    }
+
+    int index = 0;
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        txs[i]->storeTransaction(*this, metas[i], ++index, txResultSet);
     }
 }
 
@@ -987,35 +1113,119 @@ void
 LedgerManagerImpl::ledgerClosed(LedgerDelta const& delta)
 {
     delta.markMeters(mApp);
-    mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
-                                     delta.getLiveEntries(),
-                                     delta.getDeadEntries());
 
-    mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
+    // the bucket list hash is part of the header, so the bucket list must be
+    // updated before the header can be stored
+    {
+        auto timer = mLedgerCloseBuckets.TimeScope();
+        mApp.getBucketManager().addBatch(
+            mApp, mCurrentLedger->mHeader.ledgerSeq, delta.getLiveEntries(),
+            delta.getDeadEntries());
 
-    mCurrentLedger->storeInsert(*this);
+        mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
+    }
 
-    mApp.getPersistentState().setState(PersistentState::kLastClosedLedger,
-                                       binToHex(mCurrentLedger->getHash()));
+    {
+        auto timer = mLedgerCloseHeader.TimeScope();
+        mCurrentLedger->storeInsert(*this);
 
-    // Store the current HAS in the database; this is really just to checkpoint
-    // the bucketlist so we can survive a restart and re-attach to the buckets.
-    HistoryArchiveState has(mCurrentLedger->mHeader.ledgerSeq,
-                            mApp.getBucketManager().getBucketList());
+        mApp.getPersistentState().setState(
+            PersistentState::kLastClosedLedger,
+            binToHex(mCurrentLedger->getHash()));
+    }
 
-    // We almost always want to try to resolve completed merges to single
-    // buckets, as it makes restarts less fragile: fewer saved/restored shadows,
-    // fewer buckets for the user to accidentally delete from their buckets
-    // dir. But we support the option of not-doing so, only for the sake of
-    // testing. Note: this is nonblocking in any case.
-    if (!mApp.getConfig().ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING)
     {
-        has.resolveAnyReadyFutures();
-    }
+        auto timer = mLedgerCloseHAS.TimeScope();
+
+        // Store the current HAS in the database; this is really just to
+        // checkpoint the bucketlist so we can survive a restart and re-attach
+        // to the buckets.
+        HistoryArchiveState has(mCurrentLedger->mHeader.ledgerSeq,
+                                mApp.getBucketManager().getBucketList());
+
+        // We almost always want to try to resolve completed merges to single
+        // buckets, as it makes restarts less fragile: fewer saved/restored
+        // shadows, fewer buckets for the user to accidentally delete from
+        // their buckets dir. But we support the option of not-doing so, only
+        // for the sake of testing. Note: this is nonblocking in any case.
+        if (!mApp.getConfig().ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING)
+        {
+            has.resolveAnyReadyFutures();
+        }
 
-    mApp.getPersistentState().setState(PersistentState::kHistoryArchiveState,
-                                       has.toString());
+        storeBucketListState(has);
+    }
 
     advanceLedgerPointers();
 }
+
+void
+LedgerManagerImpl::storeBucketListState(HistoryArchiveState const& has)
+{
+    auto& ps = mApp.getPersistentState();
+    mStoredBucketListLevels.resize(has.currentBuckets.size());
+    for (size_t i = 0; i < has.currentBuckets.size(); ++i)
+    {
+        auto level =
+            HistoryArchiveState::levelToBinaryString(has.currentBuckets[i]);
+        if (level != mStoredBucketListLevels[i])
+        {
+            ps.setBucketListLevel(static_cast<uint32_t>(i), level);
+            mStoredBucketListLevels[i] = level;
+            mLedgerCloseHASLevels.Mark();
+        }
+    }
+
+    // Keep the JSON state, which other tools may read, reasonably fresh.
+    auto& hm = mApp.getHistoryManager();
+    if (hm.nextCheckpointLedger(has.currentLedger + 1) == has.currentLedger + 1)
+    {
+        ps.setState(PersistentState::kHistoryArchiveState, has.toString());
+    }
+}
+
+HistoryArchiveState
+LedgerManagerImpl::loadBucketListState()
+{
+    auto& ps = mApp.getPersistentState();
+    auto lcl = mCurrentLedger->mHeader.ledgerSeq;
+
+    // A JSON state at least as recent as the last closed ledger (written at a
+    // checkpoint, or set explicitly) takes precedence over the levels.
+    HistoryArchiveState has;
+    string hasString = ps.getState(PersistentState::kHistoryArchiveState);
+    if (!hasString.empty())
+    {
+        has.fromString(hasString);
+        if (has.currentLedger >= lcl)
+        {
+            return has;
+        }
+    }
+
+    std::vector<std::string> levels;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        levels.emplace_back(ps.getBucketListLevel(i));
+        if (levels.back().empty())
+        {
+            // stored by a version persisting only the JSON state
+            if (hasString.empty())
+            {
+                throw std::runtime_error("No bucket list state in the DB");
+            }
+            return has;
+        }
+    }
+
+    has.currentLedger = lcl;
+    has.currentBuckets.clear();
+    for (auto const& level : levels)
+    {
+        has.currentBuckets.emplace_back(
+            HistoryArchiveState::levelFromBinaryString(level));
+    }
+    mStoredBucketListLevels = levels;
+    return has;
+}
 }
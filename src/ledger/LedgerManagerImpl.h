@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 #include "util/asio.h"
 
+#include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
 #include "ledger/SyncingLedgerChain.h"
 #include "ledger/LedgerHeaderFrame.h"
@@ -25,6 +26,8 @@ namespace medida
 {
 class Timer;
 class Counter;
+class Histogram;
+class Meter;
 }
 
 namespace stellar
@@ -32,6 +35,7 @@ namespace stellar
 class Application;
 class Database;
 class LedgerDelta;
+class TxApplyStages;
 
 class LedgerManagerImpl : public LedgerManager
 {
@@ -41,6 +45,22 @@ class LedgerManagerImpl : public LedgerManager
     Application& mApp;
     medida::Timer& mTransactionApply;
     medida::Timer& mLedgerClose;
+
+    // stages of closeLedger, in order
+    medida::Timer& mLedgerClosePrefetch;
+    medida::Timer& mLedgerCloseFees;
+    medida::Timer& mLedgerCloseApply;
+    medida::Timer& mLedgerCloseInvariants;
+    medida::Timer& mLedgerCloseBuckets;
+    medida::Timer& mLedgerCloseHeader;
+    medida::Timer& mLedgerCloseHAS;
+    medida::Meter& mLedgerCloseHASLevels;
+    medida::Timer& mLedgerCloseCommit;
+    medida::Timer& mLedgerClosePublish;
+    medida::Timer& mLedgerCloseBucketGC;
+
+    medida::Histogram& mApplyStages;
+    medida::Histogram& mApplyStageWidth;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mLedgerStateCurrent;
@@ -59,12 +79,30 @@ class LedgerManagerImpl : public LedgerManager
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
                             LedgerDelta& delta);
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
+                           TxApplyStages const& stages,
                            LedgerDelta& ledgerDelta,
                            TransactionResultSet& txResultSet);
 
     void ledgerClosed(LedgerDelta const& delta);
     void advanceLedgerPointers();
 
+    // The BucketList is persisted level by level, in binary, and a level is
+    // only written when its encoding changes; the JSON state is only written
+    // at checkpoints.
+    void storeBucketListState(HistoryArchiveState const& has);
+    HistoryArchiveState loadBucketListState();
+    // encodings of the levels as currently stored
+    std::vector<std::string> mStoredBucketListLevels;
+
+    // Bucket GC does not need to happen before the next ledger can close;
+    // it runs from the main io_service once the current event is done. The
+    // timer is cancelled when the LedgerManager goes away. The pass following
+    // a checkpoint also saves the merge state of the BucketManager.
+    void scheduleBucketGC();
+    bool mBucketGCScheduled;
+    bool mMergeStateSaveDue;
+    VirtualTimer mBucketGCTimer;
+
     State mState;
 
   public:
@@ -102,7 +140,8 @@ class LedgerManagerImpl : public LedgerManager
     HistoryManager::VerifyHashStatus
     verifyCatchupCandidate(LedgerHeaderHistoryEntry const&) const override;
     void closeLedger(LedgerCloseData const& ledgerData) override;
-    void deleteOldEntries(Database& db, uint32_t ledgerSeq) override;
+    size_t deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                            uint32_t count) override;
     void checkDbState() override;
 };
 }
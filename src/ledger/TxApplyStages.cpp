@@ -0,0 +1,214 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/TxApplyStages.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <map>
+
+namespace stellar
+{
+
+using xdr::operator<;
+using xdr::operator==;
+
+static void
+addIssuer(TxFootprint& fp, Asset const& asset)
+{
+    if (asset.type() != ASSET_TYPE_NATIVE)
+    {
+        fp.mReads.insert(getIssuer(asset));
+    }
+}
+
+TxFootprint
+TxFootprint::forTransaction(TransactionFrame const& tx)
+{
+    TxFootprint fp;
+    auto const& txEnv = tx.getEnvelope().tx;
+
+    // sequence number, fees and one time signers
+    fp.mWrites.insert(txEnv.sourceAccount);
+
+    for (auto const& op : txEnv.operations)
+    {
+        auto const& source =
+            op.sourceAccount ? *op.sourceAccount : txEnv.sourceAccount;
+        fp.mWrites.insert(source);
+
+        switch (op.body.type())
+        {
+        case CREATE_ACCOUNT:
+            fp.mWrites.insert(op.body.createAccountOp().destination);
+            break;
+        case PAYMENT:
+        {
+            auto const& payment = op.body.paymentOp();
+            fp.mWrites.insert(payment.destination);
+            addIssuer(fp, payment.asset);
+        }
+        break;
+        case PATH_PAYMENT:
+        {
+            auto const& payment = op.body.pathPaymentOp();
+            if (!payment.path.empty() ||
+                !(payment.sendAsset == payment.destAsset))
+            {
+                // crosses the order book
+                fp.mSerial = true;
+            }
+            fp.mWrites.insert(payment.destination);
+            addIssuer(fp, payment.sendAsset);
+            addIssuer(fp, payment.destAsset);
+        }
+        break;
+        case MANAGE_OFFER:
+        case CREATE_PASSIVE_OFFER:
+            // crosses the order book and allocates offer ids from the header
+            fp.mSerial = true;
+            break;
+        case SET_OPTIONS:
+        {
+            auto const& setOptions = op.body.setOptionsOp();
+            if (setOptions.inflationDest)
+            {
+                fp.mReads.insert(*setOptions.inflationDest);
+            }
+        }
+        break;
+        case CHANGE_TRUST:
+            addIssuer(fp, op.body.changeTrustOp().line);
+            break;
+        case ALLOW_TRUST:
+            fp.mWrites.insert(op.body.allowTrustOp().trustor);
+            break;
+        case ACCOUNT_MERGE:
+            fp.mWrites.insert(op.body.destination());
+            break;
+        case INFLATION:
+            // pays out to any account and updates the fee pool
+            fp.mSerial = true;
+            break;
+        case MANAGE_DATA:
+            break;
+        case MANAGE_DEBIT:
+        {
+            auto const& manageDebit = op.body.manageDebitOp();
+            fp.mReads.insert(manageDebit.debitor);
+            addIssuer(fp, manageDebit.asset);
+        }
+        break;
+        case DIRECT_DEBIT:
+        {
+            auto const& directDebit = op.body.directDebitOp();
+            fp.mWrites.insert(directDebit.owner);
+            fp.mWrites.insert(directDebit.payWithDebit.destination);
+            addIssuer(fp, directDebit.payWithDebit.asset);
+        }
+        break;
+        default:
+            fp.mSerial = true;
+            break;
+        }
+    }
+
+    // an account both read and written only needs to be tracked as written
+    for (auto const& w : fp.mWrites)
+    {
+        fp.mReads.erase(w);
+    }
+    return fp;
+}
+
+TxApplyStages::TxApplyStages(std::vector<TransactionFramePtr> const& txs)
+{
+    // stage of the last transaction that read (resp. wrote) each account
+    std::map<AccountID, size_t> lastRead;
+    std::map<AccountID, size_t> lastWrite;
+
+    // no transaction can be moved before this stage (the stage following
+    // the last serial transaction)
+    size_t barrier = 0;
+
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        auto fp = TxFootprint::forTransaction(*txs[i]);
+
+        size_t stage = barrier;
+        if (fp.mSerial)
+        {
+            stage = std::max(stage, mStages.size());
+        }
+        else
+        {
+            for (auto const& r : fp.mReads)
+            {
+                auto it = lastWrite.find(r);
+                if (it != lastWrite.end())
+                {
+                    stage = std::max(stage, it->second + 1);
+                }
+            }
+            for (auto const& w : fp.mWrites)
+            {
+                auto it = lastWrite.find(w);
+                if (it != lastWrite.end())
+                {
+                    stage = std::max(stage, it->second + 1);
+                }
+                it = lastRead.find(w);
+                if (it != lastRead.end())
+                {
+                    stage = std::max(stage, it->second + 1);
+                }
+            }
+        }
+
+        if (stage == mStages.size())
+        {
+            mStages.emplace_back();
+        }
+        mStages[stage].emplace_back(i);
+
+        if (fp.mSerial)
+        {
+            barrier = stage + 1;
+        }
+        for (auto const& r : fp.mReads)
+        {
+            auto& s = lastRead[r];
+            s = std::max(s, stage);
+            mAccounts.insert(r);
+        }
+        for (auto const& w : fp.mWrites)
+        {
+            lastWrite[w] = stage;
+            mAccounts.insert(w);
+        }
+    }
+}
+
+std::vector<size_t>
+TxApplyStages::getApplyOrder() const
+{
+    std::vector<size_t> res;
+    for (auto const& stage : mStages)
+    {
+        res.insert(res.end(), stage.begin(), stage.end());
+    }
+    return res;
+}
+
+size_t
+TxApplyStages::getMaxWidth() const
+{
+    size_t res = 0;
+    for (auto const& stage : mStages)
+    {
+        res = std::max(res, stage.size());
+    }
+    return res;
+}
+}
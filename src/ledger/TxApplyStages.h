@@ -0,0 +1,76 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/TransactionFrame.h"
+
+#include <set>
+#include <vector>
+
+/*
+Groups the transactions of a ledger (in apply order) into stages of
+transactions that do not conflict with one another.
+
+The footprint of a transaction is derived from its operations at account
+granularity: an account is written if the account itself or any of its
+sub entries (trust lines, offers, data, debits) may be modified, and read if
+it is only loaded (asset issuers, inflation destinations...). Operations whose
+effects cannot be bounded that way (order book crossing, inflation) make the
+transaction serial: it gets a stage of its own, ordered against everything.
+
+Transactions within a stage can be applied in any order with the same
+results as the sequential order; stages must be applied one after the other.
+
+Nothing is applied concurrently though: fee processing leaves its changes
+uncommitted in the single transaction of the ledger close, and the entry cache
+is not thread safe. The stages are only used to prefetch every account a
+ledger touches, to measure the parallelism available (ledger.apply.stages and
+ledger.apply.stage-width), and to apply in stage order under
+ARTIFICIALLY_APPLY_BY_STAGE_FOR_TESTING.
+*/
+
+namespace stellar
+{
+
+struct TxFootprint
+{
+    std::set<AccountID> mReads;
+    std::set<AccountID> mWrites;
+    bool mSerial{false};
+
+    static TxFootprint forTransaction(TransactionFrame const& tx);
+};
+
+class TxApplyStages
+{
+    std::vector<std::vector<size_t>> mStages;
+    std::set<AccountID> mAccounts;
+
+  public:
+    // txs must be in apply order (as returned by TxSetFrame::sortForApply)
+    explicit TxApplyStages(std::vector<TransactionFramePtr> const& txs);
+
+    // each stage holds indices into the transaction vector, in increasing
+    // order
+    std::vector<std::vector<size_t>> const&
+    getStages() const
+    {
+        return mStages;
+    }
+
+    // every account read or written by the transactions
+    std::set<AccountID> const&
+    getAccounts() const
+    {
+        return mAccounts;
+    }
+
+    // all indices, stage after stage
+    std::vector<size_t> getApplyOrder() const;
+
+    // size of the largest stage
+    size_t getMaxWidth() const;
+};
+}
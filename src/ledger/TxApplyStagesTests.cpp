@@ -0,0 +1,82 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/TxApplyStages.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Timer.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("transaction apply stages", "[ledger][applystages]")
+{
+    Config const& cfg = getTestConfig();
+
+    VirtualClock clock;
+    ApplicationEditableVersion app{clock, cfg};
+    app.start();
+
+    auto a = getAccount("a");
+    auto b = getAccount("b");
+    auto c = getAccount("c");
+    auto d = getAccount("d");
+    auto e = getAccount("e");
+
+    auto paymentTx = [&](SecretKey const& from, PublicKey const& to,
+                         SequenceNumber seq) {
+        return transactionFromOperations(app, from, seq, {payment(to, 100)});
+    };
+
+    SECTION("disjoint payments share a stage")
+    {
+        std::vector<TransactionFramePtr> txs = {paymentTx(a, b.getPublicKey(), 1),
+                                                paymentTx(c, d.getPublicKey(), 1)};
+        TxApplyStages stages(txs);
+        REQUIRE(stages.getStages().size() == 1);
+        REQUIRE(stages.getMaxWidth() == 2);
+        REQUIRE(stages.getAccounts().size() == 4);
+    }
+
+    SECTION("conflicting payments are ordered")
+    {
+        std::vector<TransactionFramePtr> txs = {
+            paymentTx(a, b.getPublicKey(), 1), paymentTx(c, d.getPublicKey(), 1),
+            paymentTx(b, e.getPublicKey(), 1), paymentTx(a, c.getPublicKey(), 2)};
+        TxApplyStages stages(txs);
+        REQUIRE(stages.getStages() ==
+                std::vector<std::vector<size_t>>{{0, 1}, {2, 3}});
+        REQUIRE(stages.getApplyOrder() == std::vector<size_t>{0, 1, 2, 3});
+    }
+
+    SECTION("issuer is read")
+    {
+        auto usd = makeAsset(e, "USD");
+        std::vector<TransactionFramePtr> txs = {
+            transactionFromOperations(app, a, 1,
+                                      {payment(b.getPublicKey(), usd, 10)}),
+            transactionFromOperations(app, c, 1,
+                                      {payment(d.getPublicKey(), usd, 10)}),
+            paymentTx(e, a.getPublicKey(), 1)};
+        TxApplyStages stages(txs);
+        REQUIRE(stages.getStages() ==
+                std::vector<std::vector<size_t>>{{0, 1}, {2}});
+    }
+
+    SECTION("offers are serial")
+    {
+        auto usd = makeAsset(e, "USD");
+        std::vector<TransactionFramePtr> txs = {
+            paymentTx(a, b.getPublicKey(), 1),
+            transactionFromOperations(
+                app, c, 1,
+                {manageOffer(0, usd, Asset{}, Price{1, 1}, 100)}),
+            paymentTx(d, e.getPublicKey(), 1)};
+        TxApplyStages stages(txs);
+        REQUIRE(stages.getStages() ==
+                std::vector<std::vector<size_t>>{{0}, {1}, {2}});
+    }
+}
@@ -38,6 +38,7 @@ class CommandHandler;
 class WorkManager;
 class BanManager;
 class StatusManager;
+class Maintainer;
 
 /*
  * State of a single instance of the stellar-core application.
@@ -193,6 +194,7 @@ class Application
     virtual WorkManager& getWorkManager() = 0;
     virtual BanManager& getBanManager() = 0;
     virtual StatusManager& getStatusManager() = 0;
+    virtual Maintainer& getMaintainer() = 0;
 
     // Get the worker IO service, served by background threads. Work posted to
     // this io_service will execute in parallel with the calling thread, so use
@@ -230,8 +232,9 @@ class Application
     // Run a consistency check between the database and the bucketlist.
     virtual void checkDB() = 0;
 
-    // perform maintenance tasks
-    virtual void maintenance() = 0;
+    // perform maintenance tasks (asynchronously, see Maintainer), returns
+    // false if maintenance is already in progress
+    virtual bool maintenance() = 0;
 
     // Execute any administrative commands written in the Config.COMMANDS
     // variable of the config file. This permits scripting certain actions to
@@ -23,7 +23,7 @@
 #include "invariant/TotalCoinsEqualsBalancesPlusFeePool.h"
 #include "ledger/LedgerManager.h"
 #include "main/CommandHandler.h"
-#include "main/ExternalQueue.h"
+#include "main/Maintainer.h"
 #include "main/NtpSynchronizationChecker.h"
 #include "medida/counter.h"
 #include "medida/meter.h"
@@ -105,6 +105,7 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     mWorkManager = WorkManager::create(*this);
     mBanManager = BanManager::create(*this);
     mStatusManager = make_unique<StatusManager>();
+    mMaintainer = make_unique<Maintainer>(*this);
 
     if (!cfg.NTP_SERVER.empty())
     {
@@ -218,6 +219,10 @@ ApplicationImpl::~ApplicationImpl()
     {
         mProcessManager->shutdown();
     }
+    if (mWorkManager)
+    {
+        mWorkManager->shutdown();
+    }
     reportCfgMetrics();
     shutdownMainIOService();
     joinAllThreads();
@@ -282,6 +287,7 @@ ApplicationImpl::start()
             {
                 maintenance();
             }
+            mMaintainer->start();
             mOverlayManager->start();
             auto npub = mHistoryManager->publishQueuedHistory();
             if (npub != 0)
@@ -426,12 +432,11 @@ ApplicationImpl::checkDB()
     });
 }
 
-void
+bool
 ApplicationImpl::maintenance()
 {
     LOG(INFO) << "Performing maintenance";
-    ExternalQueue ps(*this);
-    ps.process();
+    return mMaintainer->performMaintenance();
 }
 
 void
@@ -634,6 +639,12 @@ ApplicationImpl::getStatusManager()
     return *mStatusManager;
 }
 
+Maintainer&
+ApplicationImpl::getMaintainer()
+{
+    return *mMaintainer;
+}
+
 asio::io_service&
 ApplicationImpl::getWorkerIOService()
 {
@@ -30,6 +30,7 @@ class CommandHandler;
 class Database;
 class LoadGenerator;
 class NtpSynchronizationChecker;
+class Maintainer;
 
 class ApplicationImpl : public Application
 {
@@ -63,6 +64,7 @@ class ApplicationImpl : public Application
     virtual WorkManager& getWorkManager() override;
     virtual BanManager& getBanManager() override;
     virtual StatusManager& getStatusManager() override;
+    virtual Maintainer& getMaintainer() override;
 
     virtual asio::io_service& getWorkerIOService() override;
 
@@ -89,7 +91,7 @@ class ApplicationImpl : public Application
 
     virtual void checkDB() override;
 
-    virtual void maintenance() override;
+    virtual bool maintenance() override;
 
     virtual void applyCfgCommands() override;
 
@@ -137,6 +139,7 @@ class ApplicationImpl : public Application
     std::unique_ptr<BanManager> mBanManager;
     std::shared_ptr<NtpSynchronizationChecker> mNtpSynchronizationChecker;
     std::unique_ptr<StatusManager> mStatusManager;
+    std::unique_ptr<Maintainer> mMaintainer;
 
     std::vector<std::thread> mWorkerThreads;
 
@@ -4,6 +4,7 @@
 
 #include "main/CommandHandler.h"
 #include "StellarCoreVersion.h"
+#include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "herder/Herder.h"
@@ -68,6 +69,8 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
 
     mServer->addRoute("bans", std::bind(&CommandHandler::bans, this, _1, _2));
+    mServer->addRoute("bucketstats",
+                      std::bind(&CommandHandler::bucketStats, this, _1, _2));
     mServer->addRoute("catchup",
                       std::bind(&CommandHandler::catchup, this, _1, _2));
     mServer->addRoute("checkdb",
@@ -232,6 +235,10 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
     retStr +=
         "<p><h1> /bans</h1>"
         "list current active bans"
+        "</p><p><h1> /bucketstats</h1>"
+        "returns the shape of the bucket list in JSON format: for each level, "
+        "the size and contents by entry type of its buckets and the state of "
+        "its merge"
         "</p><p><h1> /catchup?ledger=NNN[&mode=MODE]</h1>"
         "triggers the instance to catch up to ledger NNN from history; "
         "mode is either 'minimal' (the default, if omitted) or 'complete'."
@@ -295,7 +302,8 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "endpoint."
         "</p><p><h1> /maintenance[?queue=true]</h1> Performs maintenance tasks "
         "on the instance."
-        "<ul><li><i>queue</i> performs deletion of queue data.See setcursor "
+        "<ul><li><i>queue</i> starts deleting queue data, a chunk of "
+        "MAINTENANCE_LEDGERS_PER_CHUNK ledgers at a time. See setcursor "
         "for more information</li></ul>"
         "</p><p><h1> "
         "/unban?node=NODE_ID</h1>"
@@ -467,6 +475,14 @@ CommandHandler::metrics(std::string const& params, std::string& retStr)
     retStr = jr.Report();
 }
 
+void
+CommandHandler::bucketStats(std::string const& params, std::string& retStr)
+{
+    Json::Value root;
+    mApp.getBucketManager().dumpStats(root);
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -943,8 +959,8 @@ CommandHandler::maintenance(std::string const& params, std::string& retStr)
     http::server::server::parseParams(params, map);
     if (map["queue"] == "true")
     {
-        mApp.maintenance();
-        retStr = "Done";
+        retStr = mApp.maintenance() ? "Started"
+                                    : "Maintenance already in progress";
     }
     else
     {
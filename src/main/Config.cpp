@@ -3,11 +3,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "main/Config.h"
 #include "StellarCoreVersion.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "history/HistoryArchive.h"
+#include "history/HttpArchiveFetcher.h"
 #include "scp/LocalNode.h"
 #include "util/Logging.h"
 #include "util/types.h"
@@ -39,19 +41,24 @@ Config::Config() : NODE_SEED(SecretKey::random())
     CATCHUP_COMPLETE = false;
     CATCHUP_RECENT = 0;
     MAINTENANCE_ON_STARTUP = true;
+    AUTOMATIC_MAINTENANCE_PERIOD = 0;
+    MAINTENANCE_LEDGERS_PER_CHUNK = 50;
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
     ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = false;
+    ARTIFICIALLY_APPLY_BY_STAGE_FOR_TESTING = false;
     ALLOW_LOCALHOST_FOR_TESTING = false;
     FAILURE_SAFETY = -1;
     UNSAFE_QUORUM = false;
 
     LOG_FILE_PATH = "stellar-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
     BUCKET_DIR_PATH = "buckets";
+    BUCKET_MERGE_CHECKPOINT_BYTES = 64 * 1024 * 1024;
 
     DESIRED_BASE_FEE = 100;
     DESIRED_MAX_TX_PER_LEDGER = 50;
+    TX_REBROADCAST_BYTES_PER_LEDGER = 1024 * 1024;
 
     HTTP_PORT = DEFAULT_PEER_PORT + 1;
     PUBLIC_HTTP_PORT = false;
@@ -64,6 +71,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MINIMUM_IDLE_PERCENT = 0;
 
     MAX_CONCURRENT_SUBPROCESSES = 16;
+    HTTP_ARCHIVE_TIMEOUT = 30;
     NODE_IS_VALIDATOR = false;
 
     DATABASE = SecretValue{"sqlite3://:memory:"};
@@ -251,6 +259,21 @@ Config::load(std::string const& filename)
                 }
                 DESIRED_MAX_TX_PER_LEDGER = (uint32_t)f;
             }
+            else if (item.first == "TX_REBROADCAST_BYTES_PER_LEDGER")
+            {
+                if (!item.second->as<int64_t>())
+                {
+                    throw std::invalid_argument(
+                        "invalid TX_REBROADCAST_BYTES_PER_LEDGER");
+                }
+                int64_t f = item.second->as<int64_t>()->value();
+                if (f < 0 || f >= UINT32_MAX)
+                {
+                    throw std::invalid_argument(
+                        "invalid TX_REBROADCAST_BYTES_PER_LEDGER");
+                }
+                TX_REBROADCAST_BYTES_PER_LEDGER = (uint32_t)f;
+            }
             else if (item.first == "FAILURE_SAFETY")
             {
                 if (!item.second->as<int64_t>())
@@ -301,6 +324,36 @@ Config::load(std::string const& filename)
                 }
                 CATCHUP_RECENT = r;
             }
+            else if (item.first == "AUTOMATIC_MAINTENANCE_PERIOD")
+            {
+                if (!item.second->as<int64_t>())
+                {
+                    throw std::invalid_argument(
+                        "invalid AUTOMATIC_MAINTENANCE_PERIOD");
+                }
+                int64_t f = item.second->as<int64_t>()->value();
+                if (f < 0 || f >= UINT32_MAX)
+                {
+                    throw std::invalid_argument(
+                        "invalid AUTOMATIC_MAINTENANCE_PERIOD");
+                }
+                AUTOMATIC_MAINTENANCE_PERIOD = (uint32_t)f;
+            }
+            else if (item.first == "MAINTENANCE_LEDGERS_PER_CHUNK")
+            {
+                if (!item.second->as<int64_t>())
+                {
+                    throw std::invalid_argument(
+                        "invalid MAINTENANCE_LEDGERS_PER_CHUNK");
+                }
+                int64_t f = item.second->as<int64_t>()->value();
+                if (f <= 0 || f >= UINT32_MAX)
+                {
+                    throw std::invalid_argument(
+                        "invalid MAINTENANCE_LEDGERS_PER_CHUNK");
+                }
+                MAINTENANCE_LEDGERS_PER_CHUNK = (uint32_t)f;
+            }
             else if (item.first == "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING")
             {
                 if (!item.second->as<bool>())
@@ -375,6 +428,17 @@ Config::load(std::string const& filename)
                 }
                 BUCKET_DIR_PATH = item.second->as<std::string>()->value();
             }
+            else if (item.first == "BUCKET_MERGE_CHECKPOINT_BYTES")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() < 0)
+                {
+                    throw std::invalid_argument(
+                        "invalid BUCKET_MERGE_CHECKPOINT_BYTES");
+                }
+                BUCKET_MERGE_CHECKPOINT_BYTES =
+                    (uint64_t)item.second->as<int64_t>()->value();
+            }
             else if (item.first == "NODE_NAMES")
             {
                 if (!item.second->is_array())
@@ -505,6 +569,19 @@ Config::load(std::string const& filename)
                 MAX_CONCURRENT_SUBPROCESSES =
                     (size_t)item.second->as<int64_t>()->value();
             }
+            else if (item.first == "HTTP_ARCHIVE_TIMEOUT")
+            {
+                if (!item.second->as<int64_t>())
+                {
+                    throw std::invalid_argument("invalid HTTP_ARCHIVE_TIMEOUT");
+                }
+                int64_t f = item.second->as<int64_t>()->value();
+                if (f <= 0 || f >= UINT32_MAX)
+                {
+                    throw std::invalid_argument("invalid HTTP_ARCHIVE_TIMEOUT");
+                }
+                HTTP_ARCHIVE_TIMEOUT = (uint32_t)f;
+            }
             else if (item.first == "MINIMUM_IDLE_PERCENT")
             {
                 if (!item.second->as<int64_t>() ||
@@ -530,13 +607,27 @@ Config::load(std::string const& filename)
                             throw std::invalid_argument(
                                 "malformed HISTORY config block");
                         }
-                        std::string get, put, mkdir;
+                        std::string get, put, mkdir, url, helper;
                         for (auto const& c : *tab)
                         {
                             if (c.first == "get")
                             {
                                 get = c.second->as<std::string>()->value();
                             }
+                            else if (c.first == "url")
+                            {
+                                url = c.second->as<std::string>()->value();
+                                std::string host, path;
+                                unsigned short port;
+                                if (!HttpArchiveFetcher::parseUrl(url, host,
+                                                                  port, path))
+                                {
+                                    throw std::invalid_argument(
+                                        "invalid url '" + url +
+                                        "' within [HISTORY." + archive.first +
+                                        "], only http:// is supported");
+                                }
+                            }
                             else if (c.first == "put")
                             {
                                 put = c.second->as<std::string>()->value();
@@ -545,6 +636,10 @@ Config::load(std::string const& filename)
                             {
                                 mkdir = c.second->as<std::string>()->value();
                             }
+                            else if (c.first == "helper")
+                            {
+                                helper = c.second->as<std::string>()->value();
+                            }
                             else
                             {
                                 std::string err(
@@ -556,8 +651,8 @@ Config::load(std::string const& filename)
                             }
                         }
                         HISTORY[archive.first] =
-                            std::make_shared<HistoryArchive>(archive.first, get,
-                                                             put, mkdir);
+                            std::make_shared<HistoryArchive>(
+                                archive.first, get, put, mkdir, url, helper);
                     }
                 }
                 else
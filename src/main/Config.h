@@ -80,6 +80,14 @@ class Config : public std::enable_shared_from_this<Config>
     // Enables or disables automatic maintenance on startup
     bool MAINTENANCE_ON_STARTUP;
 
+    // Interval in seconds between automatic maintenance runs, 0 only runs it
+    // on startup and through the `maintenance` command.
+    uint32_t AUTOMATIC_MAINTENANCE_PERIOD;
+
+    // Maintenance deletes old history this many ledgers at a time, yielding
+    // to the rest of the application between two chunks.
+    uint32_t MAINTENANCE_LEDGERS_PER_CHUNK;
+
     // A config parameter that enables synthetic load generation on demand,
     // using the `generateload` runtime command (see CommandHandler.cpp). This
     // option only exists for stress-testing and should not be enabled in
@@ -101,6 +109,12 @@ class Config : public std::enable_shared_from_this<Config>
     // and should be false in all normal cases.
     bool ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING;
 
+    // A config parameter that applies the transactions of a ledger stage by
+    // stage (see TxApplyStages) instead of in transaction set order; this
+    // option exists only to check that transactions within a stage are
+    // independent, and should be false in all normal cases.
+    bool ARTIFICIALLY_APPLY_BY_STAGE_FOR_TESTING;
+
     // A config to allow connections to localhost
     // this should only be enabled when testing as it's a security issue
     bool ALLOW_LOCALHOST_FOR_TESTING;
@@ -127,9 +141,15 @@ class Config : public std::enable_shared_from_this<Config>
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
     std::string BUCKET_DIR_PATH;
+    // bytes of output between two checkpoints of a bucket merge, from which
+    // it resumes after a restart, 0 disables checkpointing
+    uint64_t BUCKET_MERGE_CHECKPOINT_BYTES;
     uint32_t DESIRED_BASE_FEE;     // in stroops
     uint32_t DESIRED_BASE_RESERVE; // in stroops
     uint32_t DESIRED_MAX_TX_PER_LEDGER;
+    // bytes of pending transactions rebroadcast to the peers that don't
+    // have them after each ledger close, 0 disables rebroadcast
+    uint32_t TX_REBROADCAST_BYTES_PER_LEDGER;
     unsigned short HTTP_PORT; // what port to listen for commands
     bool PUBLIC_HTTP_PORT;    // if you accept commands from not localhost
     int HTTP_MAX_CLIENT;      // maximum number of http clients, i.e backlog
@@ -159,6 +179,8 @@ class Config : public std::enable_shared_from_this<Config>
 
     // process-management config
     size_t MAX_CONCURRENT_SUBPROCESSES;
+    // seconds a step of an http:// archive download may take
+    uint32_t HTTP_ARCHIVE_TIMEOUT;
 
     // SCP config
     SecretKey NODE_SEED;
@@ -94,8 +94,8 @@ ExternalQueue::deleteCursor(std::string const& resid)
     st.execute(true);
 }
 
-void
-ExternalQueue::process()
+uint32_t
+ExternalQueue::getDeletableLedger()
 {
     auto& db = mApp.getDatabase();
     int m;
@@ -137,8 +137,7 @@ ExternalQueue::process()
     CLOG(INFO, "History") << "Trimming history <= ledger " << cmin
                           << " (rmin=" << rmin << ", qmin=" << qmin
                           << ", lmin=" << lmin << ")";
-
-    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin);
+    return cmin;
 }
 
 void
@@ -26,8 +26,9 @@ class ExternalQueue
     // deletes the subscription for the resource
     void deleteCursor(std::string const& resid);
 
-    // safely delete data
-    void process();
+    // the highest ledger whose history can be safely deleted: neither the
+    // subscribers nor history publication need it anymore
+    uint32_t getDeletableLedger();
 
   private:
     void checkID(std::string const& resid);
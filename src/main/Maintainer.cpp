@@ -0,0 +1,151 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/Maintainer.h"
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/ExternalQueue.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "util/Logging.h"
+
+namespace stellar
+{
+
+Maintainer::Maintainer(Application& app)
+    : mApp(app)
+    , mTimer(app)
+    , mRunning(false)
+    , mDeleteUpTo(0)
+    , mRowsDeleted(0)
+    , mRowsDeletedMeter(
+          app.getMetrics().NewMeter({"maintenance", "prune", "rows"}, "row"))
+    , mChunkTime(app.getMetrics().NewTimer({"maintenance", "prune", "chunk"}))
+{
+}
+
+void
+Maintainer::start()
+{
+    if (mApp.getConfig().AUTOMATIC_MAINTENANCE_PERIOD > 0)
+    {
+        scheduleMaintenance();
+    }
+}
+
+void
+Maintainer::scheduleMaintenance()
+{
+    mTimer.expires_from_now(
+        std::chrono::seconds(mApp.getConfig().AUTOMATIC_MAINTENANCE_PERIOD));
+    mTimer.async_wait(
+        [this]() {
+            performMaintenance();
+            scheduleMaintenance();
+        },
+        &VirtualTimer::onFailureNoop);
+}
+
+bool
+Maintainer::performMaintenance()
+{
+    if (mRunning)
+    {
+        CLOG(INFO, "History") << "Maintenance already in progress, up to "
+                              << "ledger " << mDeleteUpTo;
+        return false;
+    }
+
+    ExternalQueue ps(mApp);
+    mDeleteUpTo = ps.getDeletableLedger();
+    mRowsDeleted = 0;
+    mRunning = true;
+    deleteChunk();
+    return true;
+}
+
+void
+Maintainer::deleteChunk()
+{
+    auto ledgerSeq = mDeleteUpTo;
+    auto count = mApp.getConfig().MAINTENANCE_LEDGERS_PER_CHUNK;
+    auto& db = mApp.getDatabase();
+    // sqlite only lets one connection write at a time: a pool session would
+    // fail as soon as ledger close holds the lock, so stay on the main one
+    bool usePool = db.canUsePool() && !db.isSqlite();
+
+    auto work = [this, ledgerSeq, count, usePool]() {
+        auto& db = mApp.getDatabase();
+        size_t rows = 0;
+        std::string error;
+        try
+        {
+            auto timer = mChunkTime.TimeScope();
+            if (usePool)
+            {
+                soci::session sess(db.getPool());
+                rows = mApp.getLedgerManager().deleteOldEntries(
+                    sess, ledgerSeq, count);
+            }
+            else
+            {
+                rows = mApp.getLedgerManager().deleteOldEntries(
+                    db.getSession(), ledgerSeq, count);
+            }
+        }
+        catch (std::exception& e)
+        {
+            error = e.what();
+        }
+        mApp.getClock().getIOService().post([this, rows, error]() {
+            if (error.empty())
+            {
+                chunkDeleted(rows);
+            }
+            else
+            {
+                chunkFailed(error);
+            }
+        });
+    };
+
+    if (usePool)
+    {
+        mApp.getWorkerIOService().post(work);
+    }
+    else
+    {
+        mApp.getClock().getIOService().post(work);
+    }
+}
+
+void
+Maintainer::chunkDeleted(size_t rows)
+{
+    mRowsDeletedMeter.Mark(rows);
+    mRowsDeleted += rows;
+
+    if (rows != 0 && !mApp.isStopping())
+    {
+        deleteChunk();
+        return;
+    }
+
+    CLOG(INFO, "History") << "Trimmed " << mRowsDeleted
+                          << " rows of history <= ledger " << mDeleteUpTo;
+    mRunning = false;
+}
+
+void
+Maintainer::chunkFailed(std::string const& error)
+{
+    CLOG(ERROR, "History") << "Failed to trim history <= ledger "
+                           << mDeleteUpTo << " after " << mRowsDeleted
+                           << " rows: " << error;
+    mRunning = false;
+}
+}
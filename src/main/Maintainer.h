@@ -0,0 +1,72 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Timer.h"
+
+#include <cstdint>
+#include <string>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Deletes the history stored in the database (ledger headers, transactions,
+ * SCP messages) that is no longer needed, up to the ledger given by
+ * ExternalQueue.
+ *
+ * Rather than issuing one unbounded DELETE per table, which after a long gap
+ * stalls ledger close for as long as it takes to delete millions of rows,
+ * history is deleted MAINTENANCE_LEDGERS_PER_CHUNK ledgers at a time and
+ * every chunk is a separate event on the main loop. When the database has a
+ * connection pool and is not sqlite (where the worker's connection would fail
+ * while ledger close holds the write lock), chunks run on a worker thread
+ * instead. A chunk that fails stops maintenance until the next run.
+ *
+ * Maintenance runs on startup, when requested by the `maintenance` command
+ * and every AUTOMATIC_MAINTENANCE_PERIOD seconds, if set.
+ */
+class Maintainer
+{
+  public:
+    explicit Maintainer(Application& app);
+
+    // starts periodic maintenance, if configured
+    void start();
+
+    // starts deleting what can be, returns false if maintenance is already
+    // running
+    bool performMaintenance();
+
+    bool
+    isRunning() const
+    {
+        return mRunning;
+    }
+
+  private:
+    Application& mApp;
+    VirtualTimer mTimer;
+    bool mRunning;
+    uint32_t mDeleteUpTo;
+    size_t mRowsDeleted;
+
+    medida::Meter& mRowsDeletedMeter;
+    medida::Timer& mChunkTime;
+
+    void scheduleMaintenance();
+    void deleteChunk();
+    void chunkDeleted(size_t rows);
+    void chunkFailed(std::string const& error);
+};
+}
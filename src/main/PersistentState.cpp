@@ -48,9 +48,31 @@ PersistentState::getStoreStateName(PersistentState::Entry n)
 string
 PersistentState::getState(PersistentState::Entry entry)
 {
-    string res;
+    return getStateByName(getStoreStateName(entry));
+}
+
+void
+PersistentState::setState(PersistentState::Entry entry, string const& value)
+{
+    setStateByName(getStoreStateName(entry), value);
+}
 
-    string sn(getStoreStateName(entry));
+string
+PersistentState::getBucketListLevel(uint32_t level)
+{
+    return getStateByName("bucketlistlevel" + to_string(level));
+}
+
+void
+PersistentState::setBucketListLevel(uint32_t level, string const& value)
+{
+    setStateByName("bucketlistlevel" + to_string(level), value);
+}
+
+string
+PersistentState::getStateByName(string const& sn)
+{
+    string res;
 
     auto& db = mApp.getDatabase();
     auto prep = db.getPreparedStatement(
@@ -73,9 +95,8 @@ PersistentState::getState(PersistentState::Entry entry)
 }
 
 void
-PersistentState::setState(PersistentState::Entry entry, string const& value)
+PersistentState::setStateByName(string const& sn, string const& value)
 {
-    string sn(getStoreStateName(entry));
     auto prep = mApp.getDatabase().getPreparedStatement(
         "UPDATE storestate SET state = :v WHERE statename = :n;");
 
@@ -88,7 +109,7 @@ PersistentState::setState(PersistentState::Entry entry, string const& value)
         st.execute(true);
     }
 
-    if (st.get_affected_rows() != 1 && getState(entry).empty())
+    if (st.get_affected_rows() != 1 && getStateByName(sn).empty())
     {
         auto timer = mApp.getDatabase().getInsertTimer("state");
         auto prep2 = mApp.getDatabase().getPreparedStatement(
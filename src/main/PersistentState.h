@@ -33,10 +33,19 @@ class PersistentState
 
     void setState(Entry stateName, std::string const& value);
 
+    // Level `level` of the BucketList as of the last closed ledger, in the
+    // encoding of HistoryArchiveState::levelToBinaryString.
+    std::string getBucketListLevel(uint32_t level);
+
+    void setBucketListLevel(uint32_t level, std::string const& value);
+
   private:
     static std::string kSQLCreateStatement;
     static std::string mapping[kLastEntry];
 
+    std::string getStateByName(std::string const& sn);
+    void setStateByName(std::string const& sn, std::string const& value);
+
     Application& mApp;
 };
 }
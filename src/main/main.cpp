@@ -18,6 +18,7 @@
 #include "main/PersistentState.h"
 #include "main/dumpxdr.h"
 #include "main/fuzz.h"
+#include "main/replay.h"
 #include "test/test.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
@@ -56,6 +57,9 @@ enum opttag
     OPT_NEWDB,
     OPT_NEWHIST,
     OPT_PRINTTXN,
+    OPT_REPLAY,
+    OPT_REPLAYRANGE,
+    OPT_REPLAYREPORT,
     OPT_SEC2PUB,
     OPT_SIGNTXN,
     OPT_NETID,
@@ -88,6 +92,9 @@ static const struct option stellar_core_options[] = {
     {"metric", required_argument, nullptr, OPT_METRIC},
     {"newdb", no_argument, nullptr, OPT_NEWDB},
     {"newhist", required_argument, nullptr, OPT_NEWHIST},
+    {"replay", required_argument, nullptr, OPT_REPLAY},
+    {"replay-range", required_argument, nullptr, OPT_REPLAYRANGE},
+    {"replay-report", required_argument, nullptr, OPT_REPLAYREPORT},
     {"test", no_argument, nullptr, OPT_TEST},
     {"version", no_argument, nullptr, OPT_VERSION},
     {nullptr, 0, nullptr, 0}};
@@ -131,6 +138,14 @@ usage(int err = 1)
           "      --newhist ARCH     Initialize the named history archive ARCH\n"
           "      --printtxn FILE    Pretty-print one transaction envelope,"
           " then quit\n"
+          "      --replay DIR       Benchmark ledger apply: replay a range of "
+          "a local\n"
+          "                         history archive in DIR offline (resets "
+          "the DB)\n"
+          "      --replay-range FIRST:LAST Ledgers to replay (rounded to "
+          "checkpoints)\n"
+          "      --replay-report FILE Write the JSON report to FILE instead "
+          "of stdout\n"
           "      --signtxn FILE     Add signature to transaction envelope,"
           " then quit\n"
           "                         (Key is read from stdin or terminal, as"
@@ -469,6 +484,10 @@ main(int argc, char* const* argv)
     std::string loadXdrBucket = "";
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
+    std::string replayDir;
+    std::string replayReport;
+    uint32_t replayFirst = 0;
+    uint32_t replayLast = 0;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "c:", stellar_core_options,
@@ -553,6 +572,35 @@ main(int argc, char* const* argv)
         case OPT_NEWHIST:
             newHistories.push_back(std::string(optarg));
             break;
+        case OPT_REPLAY:
+            replayDir = std::string(optarg);
+            break;
+        case OPT_REPLAYRANGE:
+        {
+            std::string range(optarg);
+            auto sep = range.find(':');
+            try
+            {
+                if (sep == std::string::npos)
+                {
+                    throw std::invalid_argument(range);
+                }
+                replayFirst =
+                    static_cast<uint32_t>(std::stoul(range.substr(0, sep)));
+                replayLast =
+                    static_cast<uint32_t>(std::stoul(range.substr(sep + 1)));
+            }
+            catch (std::exception&)
+            {
+                std::cerr << "Invalid --replay-range " << range
+                          << ", expected FIRST:LAST" << std::endl;
+                return 1;
+            }
+            break;
+        }
+        case OPT_REPLAYREPORT:
+            replayReport = std::string(optarg);
+            break;
         case OPT_TEST:
         {
             rest.push_back(*argv);
@@ -602,6 +650,13 @@ main(int argc, char* const* argv)
 
         cfg.REPORT_METRICS = metrics;
 
+        if (!replayDir.empty())
+        {
+            setNoListen(cfg);
+            return replay(cfg, replayDir, replayFirst, replayLast,
+                          replayReport);
+        }
+
         if (forceSCP || newDB || getOfflineInfo || !loadXdrBucket.empty() ||
             inferQuorum || graphQuorum || checkQuorum || catchupComplete)
         {
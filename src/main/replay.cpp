@@ -0,0 +1,251 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "main/replay.h"
+#include "history/CatchupManager.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
+#include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+/**
+ * Offline replay benchmark.
+ *
+ * Points the node at a single local history archive, resets the database,
+ * catches up to the checkpoint preceding the requested range from buckets
+ * (CATCHUP_MINIMAL, unless the range starts in the first checkpoint) and
+ * then replays the range through the regular CATCHUP_COMPLETE pipeline.
+ * The range is widened to checkpoints: it starts after the checkpoint
+ * preceding FIRST and ends with the checkpoint including LAST. Nothing is
+ * waited on but the work itself: there is no overlay, herder or checkpoint
+ * probing, and the clock runs virtual time.
+ *
+ * The I/O loop is stepped one handler at a time so that the metrics can be
+ * sampled after every ledger close, giving per-ledger figures:
+ *
+ *  - close_ms: ledger.ledger.close, the whole closeLedger call;
+ *  - txs: transactions applied (ledger.transaction.apply count);
+ *  - sql_ms: time in all database.* timers since the previous ledger;
+ *  - buckets_ms: ledger.close.buckets plus bucket.batch.add and
+ *    bucket.snap.merge since the previous ledger. Merges running in the
+ *    background on worker threads are not included.
+ */
+
+namespace stellar
+{
+
+namespace
+{
+
+struct Sample
+{
+    double mCloseMs{0};
+    int64_t mTxs{0};
+    double mSqlMs{0};
+    double mBucketsMs{0};
+};
+
+double
+timerSum(medida::Timer& t)
+{
+    return t.count() * t.mean();
+}
+
+Sample
+sampleMetrics(Application& app)
+{
+    auto& metrics = app.getMetrics();
+    Sample s;
+    s.mCloseMs = timerSum(metrics.NewTimer({"ledger", "ledger", "close"}));
+    s.mTxs = metrics.NewTimer({"ledger", "transaction", "apply"}).count();
+    s.mBucketsMs = timerSum(metrics.NewTimer({"ledger", "close", "buckets"})) +
+                   timerSum(metrics.NewTimer({"bucket", "batch", "add"})) +
+                   timerSum(metrics.NewTimer({"bucket", "snap", "merge"}));
+    for (auto const& kv : metrics.GetAllMetrics())
+    {
+        if (kv.first.domain() != "database")
+        {
+            continue;
+        }
+        auto timer = std::dynamic_pointer_cast<medida::Timer>(kv.second);
+        if (timer)
+        {
+            s.mSqlMs += timerSum(*timer);
+        }
+    }
+    return s;
+}
+}
+
+int
+replay(Config cfg, std::string const& archiveDir, uint32_t first,
+       uint32_t last, std::string const& reportFile)
+{
+    if (!fs::exists(archiveDir))
+    {
+        LOG(FATAL) << "History archive directory " << archiveDir
+                   << " not found";
+        return 1;
+    }
+    if (first < 2 || last < first)
+    {
+        LOG(FATAL) << "Invalid replay range " << first << "-" << last;
+        return 1;
+    }
+
+    cfg.HISTORY.clear();
+    cfg.HISTORY["replay"] = std::make_shared<HistoryArchive>(
+        "replay", "cp " + archiveDir + "/{0} {1}", "", "");
+    // minimal catchup straight to its target checkpoint
+    cfg.CATCHUP_RECENT = 0;
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg, true);
+    auto& hm = app->getHistoryManager();
+    auto& lm = app->getLedgerManager();
+    auto& io = clock.getIOService();
+
+    // catchup only ever targets checkpoints: start from the one preceding
+    // FIRST (if FIRST is not in the first checkpoint) and go on to the one
+    // including LAST
+    uint32_t freq = hm.getCheckpointFrequency();
+    uint32_t lastCheckpoint = hm.nextCheckpointLedger(last + 1) - 1;
+    uint32_t firstReplayed = 2;
+    if (first / freq > 1)
+    {
+        uint32_t firstCheckpoint = (first / freq) * freq - 1;
+        LOG(INFO) << "Catching up to ledger " << firstCheckpoint
+                  << " from buckets";
+        lm.startCatchUp(firstCheckpoint + 1, CatchupManager::CATCHUP_MINIMAL,
+                        true);
+        while (lm.getState() == LedgerManager::LM_CATCHING_UP_STATE &&
+               !io.stopped())
+        {
+            clock.crank(true);
+        }
+        if (!lm.isSynced())
+        {
+            LOG(FATAL) << "Catchup to ledger " << firstCheckpoint
+                       << " failed";
+            return 1;
+        }
+        firstReplayed = firstCheckpoint + 1;
+    }
+    if (firstReplayed > lastCheckpoint)
+    {
+        LOG(FATAL) << "Nothing to replay in " << first << "-" << last;
+        return 1;
+    }
+
+    LOG(INFO) << "Replaying ledgers [" << firstReplayed << ", "
+              << lastCheckpoint << "] from " << archiveDir;
+    lm.startCatchUp(lastCheckpoint + 1, CatchupManager::CATCHUP_COMPLETE,
+                    true);
+
+    Json::Value ledgers(Json::arrayValue);
+    Sample total;
+    double maxCloseMs = 0;
+    auto prev = sampleMetrics(*app);
+    auto prevSeq = lm.getLastClosedLedgerNum();
+    auto startTime = std::chrono::steady_clock::now();
+    bool started = false;
+
+    while (lm.getState() == LedgerManager::LM_CATCHING_UP_STATE &&
+           !io.stopped())
+    {
+        if (io.poll_one() == 0)
+        {
+            clock.crank(true);
+        }
+
+        auto seq = lm.getLastClosedLedgerNum();
+        if (seq == prevSeq)
+        {
+            continue;
+        }
+        auto curr = sampleMetrics(*app);
+        if (seq == prevSeq + 1)
+        {
+            if (!started)
+            {
+                startTime = std::chrono::steady_clock::now();
+                started = true;
+            }
+            Json::Value l;
+            l["ledger"] = seq;
+            l["close_ms"] = curr.mCloseMs - prev.mCloseMs;
+            l["txs"] = static_cast<Json::Int64>(curr.mTxs - prev.mTxs);
+            l["sql_ms"] = curr.mSqlMs - prev.mSqlMs;
+            l["buckets_ms"] = curr.mBucketsMs - prev.mBucketsMs;
+            ledgers.append(l);
+
+            maxCloseMs = std::max(maxCloseMs, curr.mCloseMs - prev.mCloseMs);
+            total.mCloseMs += curr.mCloseMs - prev.mCloseMs;
+            total.mTxs += curr.mTxs - prev.mTxs;
+            total.mSqlMs += curr.mSqlMs - prev.mSqlMs;
+            total.mBucketsMs += curr.mBucketsMs - prev.mBucketsMs;
+        }
+        prev = curr;
+        prevSeq = seq;
+    }
+
+    if (!lm.isSynced())
+    {
+        LOG(FATAL) << "Replay failed at ledger "
+                   << lm.getLastClosedLedgerNum();
+        return 1;
+    }
+
+    auto wallSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - startTime)
+                           .count();
+    auto n = ledgers.size();
+
+    Json::Value report;
+    report["first"] = firstReplayed;
+    report["last"] = lastCheckpoint;
+    report["ledgers"] = ledgers;
+    auto& summary = report["summary"];
+    summary["ledgers"] = n;
+    summary["txs"] = static_cast<Json::Int64>(total.mTxs);
+    summary["wall_seconds"] = wallSeconds;
+    summary["ledgers_per_second"] = wallSeconds > 0 ? n / wallSeconds : 0.0;
+    summary["txs_per_second"] =
+        wallSeconds > 0 ? total.mTxs / wallSeconds : 0.0;
+    summary["close_ms"] = total.mCloseMs;
+    summary["close_ms_mean"] = n > 0 ? total.mCloseMs / n : 0.0;
+    summary["close_ms_max"] = maxCloseMs;
+    summary["sql_ms"] = total.mSqlMs;
+    summary["buckets_ms"] = total.mBucketsMs;
+
+    Json::StyledWriter writer;
+    if (reportFile.empty())
+    {
+        std::cout << writer.write(report);
+    }
+    else
+    {
+        std::ofstream out(reportFile);
+        out << writer.write(report);
+        LOG(INFO) << "Wrote replay report to " << reportFile;
+    }
+    LOG(INFO) << "Replayed " << n << " ledgers, " << total.mTxs << " txs in "
+              << wallSeconds << "s";
+    return 0;
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <string>
+
+namespace stellar
+{
+
+class Config;
+
+// Replays ledgers [first, last] from the history archive in local directory
+// `archiveDir`, as fast as possible and without overlay or herder, and
+// writes a JSON timing report to `reportFile` (stdout if empty). Resets the
+// configured database. Returns the process exit code.
+int replay(Config cfg, std::string const& archiveDir, uint32_t first,
+           uint32_t last, std::string const& reportFile);
+}
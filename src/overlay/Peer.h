@@ -257,12 +257,7 @@ class Peer : public std::enable_shared_from_this<Peer>,
     }
 
     virtual void
-    readHeaderHandler(asio::error_code const& error, size_t bytes_transferred)
-    {
-    }
-
-    virtual void
-    readBodyHandler(asio::error_code const& error, size_t bytes_transferred)
+    readHandler(asio::error_code const& error, size_t bytes_transferred)
     {
     }
 
@@ -6,6 +6,7 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "overlay/LoadManager.h"
@@ -16,6 +17,8 @@
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
 
+#include <cstring>
+
 using namespace soci;
 
 namespace stellar
@@ -29,7 +32,10 @@ using namespace std;
 
 TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
                  std::shared_ptr<TCPPeer::SocketType> socket)
-    : Peer(app, role), mSocket(socket)
+    : Peer(app, role)
+    , mSocket(socket)
+    , mMessagesPerRead(
+          app.getMetrics().NewHistogram({"overlay", "read", "messages"}))
 {
 }
 
@@ -226,35 +232,42 @@ TCPPeer::startRead()
 
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
-    assert(self->mIncomingHeader.size() == 0);
+    if (mReadBuffer.empty())
+    {
+        mReadBuffer.resize(READ_BUFFER_SIZE);
+    }
+    assert(mReadEnd < mReadBuffer.size());
 
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay") << "TCPPeer::startRead to " << self->toString();
 
-    self->mIncomingHeader.resize(4);
-    asio::async_read(*(self->mSocket.get()),
-                     asio::buffer(self->mIncomingHeader),
-                     [self](asio::error_code ec, std::size_t length) {
-                         if (Logging::logTrace("Overlay"))
-                             CLOG(TRACE, "Overlay")
-                                 << "TCPPeer::startRead calledback " << ec
-                                 << " length:" << length;
-                         self->readHeaderHandler(ec, length);
-                     });
+    // Reads bypass the socket's buffering layer (only used for writes) so
+    // that bytes are copied once, from the kernel into mReadBuffer.
+    mSocket->next_layer().async_read_some(
+        asio::buffer(mReadBuffer.data() + mReadEnd,
+                     mReadBuffer.size() - mReadEnd),
+        [self](asio::error_code ec, std::size_t length) {
+            if (Logging::logTrace("Overlay"))
+                CLOG(TRACE, "Overlay") << "TCPPeer::startRead calledback "
+                                       << ec << " length:" << length;
+            self->readHandler(ec, length);
+        });
 }
 
 int
-TCPPeer::getIncomingMsgLength()
+TCPPeer::getIncomingMsgLength(uint8_t const* header)
 {
-    int length = mIncomingHeader[0];
+    int length = header[0];
     length &= 0x7f; // clear the XDR 'continuation' bit
     length <<= 8;
-    length |= mIncomingHeader[1];
+    length |= header[1];
     length <<= 8;
-    length |= mIncomingHeader[2];
+    length |= header[2];
     length <<= 8;
-    length |= mIncomingHeader[3];
-    if (length <= 0 ||
+    length |= header[3];
+    // XDR messages are a multiple of 4 bytes long, which also keeps every
+    // message in mReadBuffer aligned for decoding in place
+    if (length <= 0 || (length % 4) != 0 ||
         (!isAuthenticated() && (length > MAX_UNAUTH_MESSAGE_SIZE)) ||
         length > MAX_MESSAGE_SIZE)
     {
@@ -275,28 +288,17 @@ TCPPeer::connected()
 }
 
 void
-TCPPeer::readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred)
+TCPPeer::readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred)
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readHeaderHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
 
     if (!error)
     {
         receivedBytes(bytes_transferred, false);
-        int length = getIncomingMsgLength();
-        if (length != 0)
-        {
-            mIncomingBody.resize(length);
-            auto self = static_pointer_cast<TCPPeer>(shared_from_this());
-            asio::async_read(*mSocket.get(), asio::buffer(mIncomingBody),
-                             [self](asio::error_code ec, std::size_t length) {
-                                 self->readBodyHandler(ec, length);
-                             });
-        }
+        mReadEnd += bytes_transferred;
+        mMessagesPerRead.Update(recvBufferedMessages());
+        startRead();
     }
     else
     {
@@ -305,57 +307,71 @@ TCPPeer::readHeaderHandler(asio::error_code const& error,
             // Only emit a warning if we have an error while connected;
             // errors during shutdown or connection are common/expected.
             mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readHeaderHandler error: " << error.message() << " :"
-                << toString();
+            CLOG(ERROR, "Overlay") << "readHandler error: " << error.message()
+                                   << " :" << toString();
         }
         drop();
     }
 }
 
-void
-TCPPeer::readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred)
+size_t
+TCPPeer::recvBufferedMessages()
 {
-    assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readBodyHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
-
-    if (!error)
+    size_t messages = 0;
+    size_t needed = 4;
+    while (!shouldAbort() && mReadEnd - mReadStart >= 4)
     {
-        receivedBytes(bytes_transferred, true);
-        recvMessage();
-        mIncomingHeader.clear();
-        startRead();
+        auto header = mReadBuffer.data() + mReadStart;
+        int length = getIncomingMsgLength(header);
+        if (length == 0)
+        {
+            return messages;
+        }
+        needed = 4 + static_cast<size_t>(length);
+        if (mReadEnd - mReadStart < needed)
+        {
+            break;
+        }
+        receivedBytes(0, true);
+        recvMessage(header + 4, length);
+        mReadStart += needed;
+        needed = 4;
+        ++messages;
     }
-    else
+
+    if (mReadStart == mReadEnd)
     {
-        if (isConnected())
+        mReadStart = mReadEnd = 0;
+        if (mReadBuffer.size() > READ_BUFFER_SIZE)
         {
-            // Only emit a warning if we have an error while connected;
-            // errors during shutdown or connection are common/expected.
-            mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readBodyHandler error: " << error.message() << " :"
-                << toString();
+            // done with an oversized message
+            mReadBuffer.resize(READ_BUFFER_SIZE);
+            mReadBuffer.shrink_to_fit();
         }
-        drop();
     }
+    else if (mReadStart != 0)
+    {
+        std::memmove(mReadBuffer.data(), mReadBuffer.data() + mReadStart,
+                     mReadEnd - mReadStart);
+        mReadEnd -= mReadStart;
+        mReadStart = 0;
+    }
+    if (needed > mReadBuffer.size())
+    {
+        mReadBuffer.resize(needed);
+    }
+    return messages;
 }
 
 void
-TCPPeer::recvMessage()
+TCPPeer::recvMessage(uint8_t const* data, size_t length)
 {
     assertThreadIsMain();
     try
     {
-        xdr::xdr_get g(mIncomingBody.data(),
-                       mIncomingBody.data() + mIncomingBody.size());
-        AuthenticatedMessage am;
-        xdr::xdr_argpack_archive(g, am);
-        Peer::recvMessage(am);
+        xdr::xdr_get g(data, data + length);
+        xdr::xdr_argpack_archive(g, mIncomingMessage);
+        Peer::recvMessage(mIncomingMessage);
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -10,6 +10,7 @@
 
 namespace medida
 {
+class Histogram;
 class Meter;
 }
 
@@ -18,6 +19,7 @@ namespace stellar
 
 static auto const MAX_UNAUTH_MESSAGE_SIZE = 0x1000;
 static auto const MAX_MESSAGE_SIZE = 0x1000000;
+static size_t const READ_BUFFER_SIZE = 0x40000;
 
 // Peer that communicates via a TCP socket.
 class TCPPeer : public Peer
@@ -28,27 +30,38 @@ class TCPPeer : public Peer
   private:
     std::string mIP;
     std::shared_ptr<SocketType> mSocket;
-    std::vector<uint8_t> mIncomingHeader;
-    std::vector<uint8_t> mIncomingBody;
+
+    // Inbound bytes are read straight from the socket into the free tail of
+    // mReadBuffer, as much as is available per read, and every complete
+    // message in [mReadStart, mReadEnd) is then decoded in place into
+    // mIncomingMessage, which is reused from one message to the next. An
+    // incomplete message left over is moved to the front of the buffer; the
+    // buffer only grows while a message larger than it is being received.
+    std::vector<uint8_t> mReadBuffer;
+    size_t mReadStart{0};
+    size_t mReadEnd{0};
+    AuthenticatedMessage mIncomingMessage;
+    medida::Histogram& mMessagesPerRead;
 
     std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
     bool mWriting{false};
 
-    void recvMessage();
+    void recvMessage(uint8_t const* data, size_t length);
+    size_t recvBufferedMessages();
     void sendMessage(xdr::msg_ptr&& xdrBytes) override;
 
     void messageSender();
 
-    int getIncomingMsgLength();
+    int getIncomingMsgLength(uint8_t const* header);
     virtual void connected() override;
     void startRead();
 
     void writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred) override;
-    void readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred) override;
-    void readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred) override;
+    void readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred) override;
+
+    friend class TCPPeerTests;
 
   public:
     typedef std::shared_ptr<TCPPeer> pointer;
@@ -3,15 +3,21 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "TCPPeer.h"
+#include "crypto/SHA.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerDoor.h"
 #include "simulation/Simulation.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "xdrpp/marshal.h"
 
 namespace stellar
 {
@@ -50,6 +56,148 @@ TEST_CASE("TCPPeer can communicate", "[overlay]")
     REQUIRE(p1);
     REQUIRE(p0->isAuthenticated());
     REQUIRE(p1->isAuthenticated());
+
+    // all messages received were framed out of the peers' read buffers
+    auto& perRead =
+        n0->getMetrics().NewHistogram({"overlay", "read", "messages"});
+    auto& messages =
+        n0->getMetrics().NewMeter({"overlay", "message", "read"}, "message");
+    REQUIRE(perRead.count() > 0);
+    REQUIRE(perRead.sum() == messages.count());
     s->stopAllNodes();
 }
+
+class TCPPeerTests
+{
+  protected:
+    VirtualClock clock;
+    Application::pointer app;
+    TCPPeer::pointer peer;
+    medida::Timer& recvDontHave;
+
+    TCPPeerTests()
+        : app(Application::create(clock, getTestConfig()))
+        , peer(std::make_shared<TCPPeer>(
+              *app, Peer::REMOTE_CALLED_US,
+              std::make_shared<TCPPeer::SocketType>(clock.getIOService())))
+        , recvDontHave(
+              app->getMetrics().NewTimer({"overlay", "recv", "dont-have"}))
+    {
+        // skip the handshake: frames are authenticated with the peer's
+        // (default) receive key, and bytes are handed to the read buffer
+        // directly instead of coming off the socket
+        peer->mState = Peer::GOT_AUTH;
+        peer->mReadBuffer.resize(READ_BUFFER_SIZE);
+    }
+
+    // a complete DONT_HAVE message, length header included
+    std::vector<uint8_t>
+    frame(uint64_t sequence)
+    {
+        StellarMessage msg;
+        msg.type(DONT_HAVE);
+        msg.dontHave().type = TX_SET;
+        msg.dontHave().reqHash = sha256(std::to_string(sequence));
+
+        AuthenticatedMessage amsg;
+        amsg.v0().message = msg;
+        amsg.v0().sequence = sequence;
+        amsg.v0().mac = hmacSha256(peer->mRecvMacKey,
+                                   xdr::xdr_to_opaque(sequence, msg));
+        auto bytes = xdr::xdr_to_msg(amsg);
+        return std::vector<uint8_t>(bytes->raw_data(),
+                                    bytes->raw_data() + bytes->raw_size());
+    }
+
+    // what one read completion would do with bytes; returns the number of
+    // messages framed
+    size_t
+    receive(std::vector<uint8_t> const& bytes)
+    {
+        REQUIRE(peer->mReadEnd + bytes.size() <= peer->mReadBuffer.size());
+        std::copy(bytes.begin(), bytes.end(),
+                  peer->mReadBuffer.begin() + peer->mReadEnd);
+        peer->mReadEnd += bytes.size();
+        return peer->recvBufferedMessages();
+    }
+
+    size_t
+    buffered() const
+    {
+        return peer->mReadEnd - peer->mReadStart;
+    }
+
+    Peer::PeerState
+    state() const
+    {
+        return peer->mState;
+    }
+};
+
+static std::vector<uint8_t>
+concat(std::vector<uint8_t> a, std::vector<uint8_t> const& b)
+{
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+TEST_CASE_METHOD(TCPPeerTests, "TCPPeer frames messages from its read buffer",
+                 "[overlay]")
+{
+    auto f0 = frame(0);
+    auto f1 = frame(1);
+    auto f2 = frame(2);
+
+    SECTION("several messages in one read")
+    {
+        REQUIRE(receive(concat(concat(f0, f1), f2)) == 3);
+        REQUIRE(recvDontHave.count() == 3);
+        REQUIRE(buffered() == 0);
+    }
+
+    SECTION("header split across reads")
+    {
+        REQUIRE(receive({f0.begin(), f0.begin() + 2}) == 0);
+        REQUIRE(buffered() == 2);
+        REQUIRE(receive({f0.begin() + 2, f0.end()}) == 1);
+        REQUIRE(recvDontHave.count() == 1);
+        REQUIRE(buffered() == 0);
+    }
+
+    SECTION("body split across reads")
+    {
+        auto half = f0.begin() + f0.size() / 2;
+        REQUIRE(receive({f0.begin(), half}) == 0);
+        REQUIRE(receive({half, f0.end()}) == 1);
+        REQUIRE(recvDontHave.count() == 1);
+        REQUIRE(buffered() == 0);
+    }
+
+    SECTION("partial message after complete ones")
+    {
+        auto half = f2.begin() + f2.size() / 2;
+        REQUIRE(receive(concat(concat(f0, f1), {f2.begin(), half})) == 2);
+        // the leftover was moved to the front of the buffer
+        REQUIRE(buffered() == f2.size() / 2);
+        REQUIRE(receive({half, f2.end()}) == 1);
+        REQUIRE(recvDontHave.count() == 3);
+        REQUIRE(buffered() == 0);
+    }
+
+    REQUIRE(state() == Peer::GOT_AUTH);
+}
+
+TEST_CASE_METHOD(TCPPeerTests,
+                 "TCPPeer rejects lengths that are not a multiple of 4",
+                 "[overlay]")
+{
+    std::vector<uint8_t> bytes = {0x80, 0, 0, 6, 0, 0, 0, 0, 0, 0};
+    REQUIRE(receive(bytes) == 0);
+    REQUIRE(state() == Peer::CLOSING);
+    REQUIRE(recvDontHave.count() == 0);
+
+    // let the shutdown posted by drop() run while the app is still around
+    while (clock.crank(false) > 0)
+        ;
+}
 }
@@ -23,6 +23,12 @@ class RealTimer;
  * No facilities exist for reading or writing to the subprocess I/O ports. This
  * is strictly for "run a command, wait to see if it worked"; a glorified
  * asynchronous version of system().
+ *
+ * Commands can also be run on persistent helper processes instead of a
+ * fresh subprocess each (see runOnHelper), for commands whose startup cost
+ * dominates their runtime. A helper reads one command line per line on its
+ * stdin, runs it however it likes, and writes the command's exit status as
+ * a decimal number on one line to its stdout (and nothing else there).
  */
 
 // Wrap a platform-specific Impl strategy that monitors process-exits in a
@@ -51,6 +57,13 @@ class ProcessManager : public std::enable_shared_from_this<ProcessManager>,
     static std::shared_ptr<ProcessManager> create(Application& app);
     virtual ProcessExitEvent runProcess(std::string const& cmdLine,
                                         std::string outputFile = "") = 0;
+    // Sends `cmdLine` to an idle helper process running `helperCmdLine`,
+    // starting one if all are busy and fewer than MAX_CONCURRENT_SUBPROCESSES
+    // run, otherwise queueing it. A helper that dies or misbehaves fails its
+    // current command and is replaced on demand. On Windows the command is
+    // run as a normal subprocess.
+    virtual ProcessExitEvent runOnHelper(std::string const& helperCmdLine,
+                                         std::string const& cmdLine) = 0;
     virtual size_t getNumRunningProcesses() = 0;
     virtual bool isShutdown() const = 0;
     virtual void shutdown() = 0;
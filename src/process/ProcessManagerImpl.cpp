@@ -17,9 +17,12 @@
 #include "util/Timer.h"
 
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iterator>
 #include <mutex>
@@ -62,6 +65,7 @@ class ProcessExitEvent::Impl
     std::string mCmdLine;
     std::string mOutFile;
     bool mRunning{false};
+    std::chrono::steady_clock::time_point mStartTime;
 #ifdef _WIN32
     asio::windows::object_handle mProcessHandle;
 #endif
@@ -110,6 +114,15 @@ ProcessManagerImpl::shutdown()
             pending->cancel(ec);
         }
         mPendingImpls.clear();
+        for (auto& queue : mHelperQueues)
+        {
+            for (auto& pending : queue.second)
+            {
+                pending->cancel(ec);
+            }
+        }
+        mHelperQueues.clear();
+        shutdownHelpers(ec);
 
         // Cancel all running.
         std::lock_guard<std::recursive_mutex> guard(
@@ -137,6 +150,39 @@ ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
     , mSigChild(mIOService)
+    , mSpawnTime(app.getMetrics().NewTimer({"process", "spawn", "time"}))
+    , mRunTime(app.getMetrics().NewTimer({"process", "run", "time"}))
+    , mHelperRunTime(app.getMetrics().NewTimer({"process", "helper", "time"}))
+    , mHelperStart(
+          app.getMetrics().NewMeter({"process", "helper", "start"}, "process"))
+{
+}
+
+// Helpers are not supported on windows, commands run as subprocesses.
+class ProcessManagerImpl::Helper
+{
+  public:
+    std::shared_ptr<ProcessExitEvent::Impl> mCurrent;
+    void
+    close()
+    {
+    }
+};
+
+ProcessExitEvent
+ProcessManagerImpl::runOnHelper(std::string const& helperCmdLine,
+                                std::string const& cmdLine)
+{
+    return runProcess(cmdLine);
+}
+
+void
+ProcessManagerImpl::maybeRunOnHelpers(std::string const& helperCmdLine)
+{
+}
+
+void
+ProcessManagerImpl::helperFinished(std::shared_ptr<Helper> helper, bool alive)
 {
 }
 
@@ -193,6 +239,7 @@ ProcessExitEvent::Impl::run()
         }
     }
 
+    auto spawnTime = mProcManagerImpl->mSpawnTime.TimeScope();
     if (!CreateProcess(NULL,    // No module name (use command line)
                        cmd,     // Command line
                        nullptr, // Process handle not inheritable
@@ -208,6 +255,8 @@ ProcessExitEvent::Impl::run()
         CLOG(ERROR, "Process") << "CreateProcess() failed: " << GetLastError();
         throw std::runtime_error("CreateProcess() failed");
     }
+    spawnTime.Stop();
+    mStartTime = std::chrono::steady_clock::now();
     CloseHandle(si.hStdOutput);
     CloseHandle(pi.hThread); // we don't need this handle
     pi.hThread = INVALID_HANDLE_VALUE;
@@ -228,6 +277,9 @@ ProcessExitEvent::Impl::run()
                 ProcessManagerImpl::gImplsMutex);
             --ProcessManagerImpl::gNumProcessesActive;
         }
+        sf->mProcManagerImpl->mRunTime.Update(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - sf->mStartTime));
 
         // Fire off any new processes we've made room for before we
         // trigger the callback.
@@ -255,13 +307,21 @@ ProcessExitEvent::Impl::run()
 
 #else
 
+#include <fcntl.h>
+#include <signal.h>
 #include <spawn.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
     , mSigChild(mIOService, SIGCHLD)
+    , mSpawnTime(app.getMetrics().NewTimer({"process", "spawn", "time"}))
+    , mRunTime(app.getMetrics().NewTimer({"process", "run", "time"}))
+    , mHelperRunTime(app.getMetrics().NewTimer({"process", "helper", "time"}))
+    , mHelperStart(
+          app.getMetrics().NewMeter({"process", "helper", "start"}, "process"))
 {
     std::lock_guard<std::recursive_mutex> guard(gImplsMutex);
     startSignalWait();
@@ -353,6 +413,9 @@ ProcessManagerImpl::handleSignalWait()
 
             --gNumProcessesActive;
             gImpls.erase(pair);
+            mRunTime.Update(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - impl->mStartTime));
 
             // Fire off any new processes we've made room for before we
             // trigger the callback.
@@ -421,9 +484,14 @@ ProcessExitEvent::Impl::run()
         }
     }
 
-    err = posix_spawnp(&pid, argv[0], mOutFile.empty() ? nullptr : &fileActions,
-                       nullptr, // posix_spawnattr_t*
-                       argv.data(), env);
+    {
+        auto spawnTime = mProcManagerImpl->mSpawnTime.TimeScope();
+        err = posix_spawnp(&pid, argv[0],
+                           mOutFile.empty() ? nullptr : &fileActions,
+                           nullptr, // posix_spawnattr_t*
+                           argv.data(), env);
+    }
+    mStartTime = std::chrono::steady_clock::now();
     if (err)
     {
         CLOG(ERROR, "Process") << "posix_spawn() failed: " << strerror(err);
@@ -446,6 +514,279 @@ ProcessExitEvent::Impl::run()
     mRunning = true;
 }
 
+class ProcessManagerImpl::Helper
+    : public std::enable_shared_from_this<ProcessManagerImpl::Helper>
+{
+    std::weak_ptr<ProcessManagerImpl> mProcManagerImpl;
+    int mPid{0};
+    asio::posix::stream_descriptor mIn;
+    asio::posix::stream_descriptor mOut;
+    asio::streambuf mReply;
+    std::string mRequest;
+    std::chrono::steady_clock::time_point mStartTime;
+
+    void finish(asio::error_code const& ec, bool alive);
+
+  public:
+    std::string const mHelperCmdLine;
+    std::shared_ptr<ProcessExitEvent::Impl> mCurrent;
+
+    Helper(std::shared_ptr<ProcessManagerImpl> pm,
+           std::string const& helperCmdLine)
+        : mProcManagerImpl(pm)
+        , mIn(pm->mIOService)
+        , mOut(pm->mIOService)
+        , mHelperCmdLine(helperCmdLine)
+    {
+    }
+
+    void start();
+    void run(std::shared_ptr<ProcessExitEvent::Impl> impl);
+    void close();
+};
+
+void
+ProcessManagerImpl::Helper::start()
+{
+    // A helper that dies while we write to it must fail its command, not
+    // take us down with SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    int in[2], out[2];
+    if (pipe(in) != 0)
+    {
+        throw std::runtime_error("pipe() failed");
+    }
+    if (pipe(out) != 0)
+    {
+        ::close(in[0]);
+        ::close(in[1]);
+        throw std::runtime_error("pipe() failed");
+    }
+    // Only the copies dup'ed onto the helper's stdin and stdout survive
+    // exec; in particular no other subprocess inherits the write end of a
+    // helper's stdin, which would keep the helper from seeing EOF.
+    for (int fd : {in[0], in[1], out[0], out[1]})
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    std::vector<std::string> args = split(mHelperCmdLine);
+    std::vector<char*> argv;
+    for (auto& a : args)
+    {
+        argv.push_back((char*)a.data());
+    }
+    argv.push_back(nullptr);
+    char* env[1] = {nullptr};
+
+    posix_spawn_file_actions_t fileActions;
+    int err = posix_spawn_file_actions_init(&fileActions);
+    if (!err)
+    {
+        err = posix_spawn_file_actions_adddup2(&fileActions, in[0], 0);
+    }
+    if (!err)
+    {
+        err = posix_spawn_file_actions_adddup2(&fileActions, out[1], 1);
+    }
+    if (!err)
+    {
+        err = posix_spawnp(&mPid, argv[0], &fileActions, nullptr,
+                           argv.data(), env);
+    }
+    posix_spawn_file_actions_destroy(&fileActions);
+    ::close(in[0]);
+    ::close(out[1]);
+    if (err)
+    {
+        ::close(in[1]);
+        ::close(out[0]);
+        CLOG(ERROR, "Process") << "posix_spawn() failed: " << strerror(err);
+        throw std::runtime_error("posix_spawn() failed");
+    }
+    mIn.assign(in[1]);
+    mOut.assign(out[0]);
+    CLOG(DEBUG, "Process") << "started helper " << mPid << ": "
+                           << mHelperCmdLine;
+}
+
+void
+ProcessManagerImpl::Helper::run(std::shared_ptr<ProcessExitEvent::Impl> impl)
+{
+    assert(!mCurrent);
+    CLOG(DEBUG, "Process") << "Running on helper " << mPid << ": "
+                           << impl->mCmdLine;
+    mCurrent = impl;
+    mStartTime = std::chrono::steady_clock::now();
+    mRequest = impl->mCmdLine + "\n";
+
+    auto self = shared_from_this();
+    asio::async_write(mIn, asio::buffer(mRequest),
+                      [self](asio::error_code ec, size_t) {
+                          if (ec)
+                          {
+                              self->finish(ec, false);
+                          }
+                      });
+    asio::async_read_until(
+        mOut, mReply, '\n', [self](asio::error_code ec, size_t) {
+            if (ec)
+            {
+                self->finish(ec, false);
+                return;
+            }
+            std::istream in(&self->mReply);
+            std::string line;
+            std::getline(in, line);
+            int status;
+            try
+            {
+                status = std::stoi(line);
+            }
+            catch (std::exception&)
+            {
+                CLOG(ERROR, "Process") << "helper " << self->mPid
+                                       << " replied '" << line
+                                       << "' instead of an exit status";
+                self->finish(asio::error_code(1, asio::system_category()),
+                             false);
+                return;
+            }
+            if (status != 0 && self->mCurrent)
+            {
+                CLOG(WARNING, "Process") << "command exited " << status
+                                         << " on helper " << self->mPid
+                                         << ": " << self->mCurrent->mCmdLine;
+            }
+            self->finish(status == 0 ? asio::error_code()
+                                     : asio::error_code(
+                                           status, asio::system_category()),
+                         true);
+        });
+}
+
+void
+ProcessManagerImpl::Helper::finish(asio::error_code const& ec, bool alive)
+{
+    // both the write and the read may fail for the same command
+    if (!mCurrent)
+    {
+        return;
+    }
+    auto impl = mCurrent;
+    mCurrent.reset();
+
+    auto pm = mProcManagerImpl.lock();
+    if (!pm || pm->isShutdown())
+    {
+        return;
+    }
+    pm->mHelperRunTime.Update(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - mStartTime));
+    if (!alive)
+    {
+        CLOG(WARNING, "Process") << "helper " << mPid << " failed ("
+                                 << ec.message() << "), stopping it: "
+                                 << mHelperCmdLine;
+        close();
+        kill(mPid, SIGTERM);
+    }
+    pm->helperFinished(shared_from_this(), alive);
+    impl->cancel(ec);
+}
+
+void
+ProcessManagerImpl::Helper::close()
+{
+    // the helper exits on EOF and is reaped by handleSignalWait
+    asio::error_code ec;
+    mIn.close(ec);
+    mOut.close(ec);
+}
+
+ProcessExitEvent
+ProcessManagerImpl::runOnHelper(std::string const& helperCmdLine,
+                                std::string const& cmdLine)
+{
+    ProcessExitEvent pe(mIOService);
+    std::shared_ptr<ProcessManagerImpl> self =
+        std::static_pointer_cast<ProcessManagerImpl>(shared_from_this());
+    pe.mImpl = std::make_shared<ProcessExitEvent::Impl>(pe.mTimer, pe.mEc,
+                                                        cmdLine, "", self);
+    mHelperQueues[helperCmdLine].push_back(pe.mImpl);
+    maybeRunOnHelpers(helperCmdLine);
+    return pe;
+}
+
+void
+ProcessManagerImpl::maybeRunOnHelpers(std::string const& helperCmdLine)
+{
+    if (mIsShutdown)
+    {
+        return;
+    }
+    auto& queue = mHelperQueues[helperCmdLine];
+    auto& helpers = mHelpers[helperCmdLine];
+    while (!queue.empty())
+    {
+        std::shared_ptr<Helper> helper;
+        for (auto const& h : helpers)
+        {
+            if (!h->mCurrent)
+            {
+                helper = h;
+                break;
+            }
+        }
+        if (!helper)
+        {
+            if (helpers.size() >= mMaxProcesses)
+            {
+                break;
+            }
+            helper = std::make_shared<Helper>(
+                std::static_pointer_cast<ProcessManagerImpl>(
+                    shared_from_this()),
+                helperCmdLine);
+            try
+            {
+                auto spawnTime = mSpawnTime.TimeScope();
+                helper->start();
+            }
+            catch (std::runtime_error& e)
+            {
+                CLOG(ERROR, "Process") << "Error starting helper: "
+                                       << e.what();
+                CLOG(ERROR, "Process") << "When running: "
+                                       << queue.front()->mCmdLine;
+                queue.front()->cancel(
+                    asio::error_code(1, asio::system_category()));
+                queue.pop_front();
+                continue;
+            }
+            mHelperStart.Mark();
+            helpers.push_back(helper);
+        }
+        auto impl = queue.front();
+        queue.pop_front();
+        helper->run(impl);
+    }
+}
+
+void
+ProcessManagerImpl::helperFinished(std::shared_ptr<Helper> helper, bool alive)
+{
+    if (!alive)
+    {
+        auto& helpers = mHelpers[helper->mHelperCmdLine];
+        helpers.erase(std::remove(helpers.begin(), helpers.end(), helper),
+                      helpers.end());
+    }
+    maybeRunOnHelpers(helper->mHelperCmdLine);
+}
+
 #endif
 
 ProcessExitEvent
@@ -489,6 +830,26 @@ ProcessManagerImpl::maybeRunPendingProcesses()
     }
 }
 
+void
+ProcessManagerImpl::shutdownHelpers(asio::error_code const& ec)
+{
+    // Closing their stdin tells the helpers to exit; the commands they are
+    // running are cancelled.
+    for (auto& helpers : mHelpers)
+    {
+        for (auto& helper : helpers.second)
+        {
+            if (helper->mCurrent)
+            {
+                helper->mCurrent->cancel(ec);
+                helper->mCurrent.reset();
+            }
+            helper->close();
+        }
+    }
+    mHelpers.clear();
+}
+
 ProcessExitEvent::ProcessExitEvent(asio::io_service& io_service)
     : mTimer(std::make_shared<RealTimer>(io_service))
     , mImpl(nullptr)
@@ -6,11 +6,15 @@
 
 #include "process/ProcessManager.h"
 #include <deque>
+#include <map>
 #include <mutex>
+#include <vector>
 
 namespace medida
 {
 class Counter;
+class Meter;
+class Timer;
 }
 
 namespace stellar
@@ -39,12 +43,31 @@ class ProcessManagerImpl : public ProcessManager
     void startSignalWait();
     void handleSignalWait();
 
+    // Persistent helper processes and the commands waiting for one, by
+    // helper command line. POSIX only.
+    class Helper;
+    std::map<std::string, std::vector<std::shared_ptr<Helper>>> mHelpers;
+    std::map<std::string, std::deque<std::shared_ptr<ProcessExitEvent::Impl>>>
+        mHelperQueues;
+    void maybeRunOnHelpers(std::string const& helperCmdLine);
+    void helperFinished(std::shared_ptr<Helper> helper, bool alive);
+    void shutdownHelpers(asio::error_code const& ec);
+
+    // time spent starting processes (subprocesses and helpers), versus the
+    // time commands take once started
+    medida::Timer& mSpawnTime;
+    medida::Timer& mRunTime;
+    medida::Timer& mHelperRunTime;
+    medida::Meter& mHelperStart;
+
     friend class ProcessExitEvent::Impl;
 
   public:
     ProcessManagerImpl(Application& app);
     ProcessExitEvent runProcess(std::string const& cmdLine,
                                 std::string outFile = "") override;
+    ProcessExitEvent runOnHelper(std::string const& helperCmdLine,
+                                 std::string const& cmdLine) override;
     size_t getNumRunningProcesses() override;
 
     bool isShutdown() const override;
@@ -13,8 +13,12 @@
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
+#include <fstream>
 #include <future>
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 using namespace stellar;
 
 TEST_CASE("subprocess", "[process]")
@@ -155,3 +159,59 @@ TEST_CASE("subprocess storm", "[process]")
         REQUIRE(fs::exists(dst));
     }
 }
+
+#ifndef _WIN32
+TEST_CASE("subprocess helpers", "[process]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 2;
+    Application::pointer appPtr = Application::create(clock, cfg);
+    Application& app = *appPtr;
+
+    std::string dir(cfg.BUCKET_DIR_PATH + "/tmp/process-helpers");
+    fs::mkpath(dir);
+    std::string script(dir + "/helper.sh");
+    {
+        std::ofstream out(script);
+        out << "while read cmd; do $cmd >/dev/null 2>&1; echo $?; done\n";
+    }
+    std::string helper("sh " + script);
+
+    size_t n = 10;
+    size_t completed = 0;
+    size_t failed = 0;
+    auto handler = [&](asio::error_code ec) {
+        ++completed;
+        if (ec)
+        {
+            ++failed;
+        }
+    };
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto evt = app.getProcessManager().runOnHelper(
+            helper, fmt::format("mkdir {:s}/{:d}", dir, i));
+        evt.async_wait(handler);
+    }
+    app.getProcessManager().runOnHelper(helper, "false").async_wait(handler);
+    // a helper that exits right away fails its command
+    app.getProcessManager().runOnHelper("true", "true").async_wait(handler);
+
+    while (completed < n + 2 && !clock.getIOService().stopped())
+    {
+        clock.crank(true);
+    }
+
+    REQUIRE(failed == 2);
+    for (size_t i = 0; i < n; ++i)
+    {
+        REQUIRE(fs::exists(fmt::format("{:s}/{:d}", dir, i)));
+    }
+    // commands were spread over at most MAX_CONCURRENT_SUBPROCESSES helpers
+    // per helper command line
+    auto& starts =
+        app.getMetrics().NewMeter({"process", "helper", "start"}, "process");
+    REQUIRE(starts.count() == cfg.MAX_CONCURRENT_SUBPROCESSES + 1);
+}
+#endif
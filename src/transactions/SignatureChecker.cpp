@@ -2,15 +2,22 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "SignatureChecker.h"
 
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
+#include "main/Application.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Algoritm.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace stellar
 {
 
@@ -119,4 +126,66 @@ SignatureChecker::usedOneTimeSignerKeys() const
 {
     return mUsedOneTimeSignerKeys;
 }
+
+namespace
+{
+struct VerifyBatchState
+{
+    std::vector<SignatureToVerify> mSigs;
+    std::atomic<size_t> mNext{0};
+
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    size_t mActive{0};
+
+    void
+    run()
+    {
+        size_t i;
+        while ((i = mNext++) < mSigs.size())
+        {
+            auto const& s = mSigs[i];
+            SignatureUtils::verify(s.mSignature, s.mSignerKey, s.mContentsHash);
+        }
+    }
+};
+}
+
+void
+SignatureChecker::verifyBatch(Application& app,
+                              std::vector<SignatureToVerify> sigs)
+{
+    if (sigs.empty())
+    {
+        return;
+    }
+
+    auto state = std::make_shared<VerifyBatchState>();
+    state->mSigs = std::move(sigs);
+
+    // helpers that only get to run once the batch is done find nothing left
+    // to do; the calling thread only waits for the ones that started
+    size_t helpers = std::min<size_t>(std::thread::hardware_concurrency(),
+                                      state->mSigs.size() - 1);
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        app.getWorkerIOService().post([state]() {
+            {
+                std::lock_guard<std::mutex> guard(state->mMutex);
+                ++state->mActive;
+            }
+            state->run();
+            {
+                std::lock_guard<std::mutex> guard(state->mMutex);
+                --state->mActive;
+            }
+            state->mDone.notify_all();
+        });
+    }
+
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mMutex);
+    state->mDone.wait(lock, [&state]() { return state->mActive == 0; });
+}
 };
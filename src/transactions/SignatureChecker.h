@@ -16,6 +16,16 @@
 namespace stellar
 {
 
+class Application;
+
+// a signature that may satisfy an ed25519 signer of a transaction
+struct SignatureToVerify
+{
+    DecoratedSignature mSignature;
+    SignerKey mSignerKey;
+    Hash mContentsHash;
+};
+
 using UsedOneTimeSignerKeys = std::map<AccountID, std::set<SignerKey>>;
 
 class SignatureChecker
@@ -32,6 +42,13 @@ class SignatureChecker
 
     const UsedOneTimeSignerKeys& usedOneTimeSignerKeys() const;
 
+    // Verifies all the given signatures, spreading the work over the worker
+    // threads (the calling thread takes part as well). Results are kept in
+    // the process-wide verify cache, so that checkSignature does not verify
+    // them again when the transactions get applied.
+    static void verifyBatch(Application& app,
+                            std::vector<SignatureToVerify> sigs);
+
   private:
     Hash const& mContentsHash;
     xdr::xvector<DecoratedSignature, 20> const& mSignatures;
@@ -8,6 +8,10 @@
 #include "crypto/SignerKey.h"
 #include "crypto/SignerKeyUtils.h"
 #include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/test.h"
+#include "transactions/SignatureChecker.h"
+#include "util/Timer.h"
 #include "xdr/Stellar-transaction.h"
 
 using namespace stellar;
@@ -46,3 +50,45 @@ TEST_CASE("Hash(x) signature", "[signature]")
         REQUIRE_THROWS_AS(SignatureUtils::signHashX(s), xdr::xdr_overflow);
     }
 }
+
+TEST_CASE("SignatureChecker batch verification", "[signature]")
+{
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, getTestConfig());
+
+    auto hash = sha256(std::string{"BATCH_HASH"});
+    std::vector<SignatureToVerify> sigs;
+    for (auto i = 0; i < 50; i++)
+    {
+        auto secretKey = SecretKey::fromSeed(
+            sha256(std::string{"BATCH_SEED_"} + std::to_string(i)));
+        auto signerKey =
+            KeyUtils::convertKey<SignerKey>(secretKey.getPublicKey());
+        auto signature = SignatureUtils::sign(secretKey, hash);
+        if (i % 10 == 0)
+        {
+            // corrupted signatures are cached as invalid
+            signature.signature[0] ^= 1;
+        }
+        sigs.emplace_back(SignatureToVerify{signature, signerKey, hash});
+    }
+
+    uint64_t hits, misses;
+    PubKeyUtils::clearVerifySigCache();
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    SignatureChecker::verifyBatch(*app, sigs);
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == sigs.size());
+
+    for (size_t i = 0; i < sigs.size(); i++)
+    {
+        auto const& s = sigs[i];
+        REQUIRE(SignatureUtils::verify(s.mSignature, s.mSignerKey,
+                                       s.mContentsHash) == (i % 10 != 0));
+    }
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == sigs.size());
+    REQUIRE(misses == 0);
+}
@@ -9,6 +9,7 @@
 #include "crypto/SHA.h"
 #include "crypto/SignerKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "herder/TxSetFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "main/Application.h"
@@ -26,11 +27,13 @@
 
 #include <algorithm>
 #include <numeric>
+#include <set>
 
 namespace stellar
 {
 
 using namespace std;
+using xdr::operator<;
 using xdr::operator==;
 
 TransactionFramePtr
@@ -152,6 +155,51 @@ TransactionFrame::checkSignature(SignatureChecker& signatureChecker,
                                            neededWeight);
 }
 
+void
+TransactionFrame::collectSignaturesToVerify(
+    Database& db, std::vector<SignatureToVerify>& sigs) const
+{
+    std::set<AccountID> accountIDs;
+    accountIDs.insert(getSourceID());
+    for (auto const& op : mEnvelope.tx.operations)
+    {
+        if (op.sourceAccount)
+        {
+            accountIDs.insert(*op.sourceAccount);
+        }
+    }
+
+    std::set<SignerKey> signerKeys;
+    for (auto const& accountID : accountIDs)
+    {
+        auto account = AccountFrame::loadAccount(accountID, db);
+        if (!account)
+        {
+            continue;
+        }
+        signerKeys.insert(KeyUtils::convertKey<SignerKey>(accountID));
+        for (auto const& signer : account->getAccount().signers)
+        {
+            if (signer.key.type() == SIGNER_KEY_TYPE_ED25519)
+            {
+                signerKeys.insert(signer.key);
+            }
+        }
+    }
+
+    for (auto const& sig : mEnvelope.signatures)
+    {
+        for (auto const& signerKey : signerKeys)
+        {
+            if (SignatureUtils::doesHintMatch(signerKey.ed25519(), sig.hint))
+            {
+                sigs.emplace_back(
+                    SignatureToVerify{sig, signerKey, getContentsHash()});
+            }
+        }
+    }
+}
+
 AccountFrame::pointer
 TransactionFrame::loadAccount(int ledgerProtocolVersion,
                               LedgerDelta* delta, Database& db,
@@ -819,11 +867,13 @@ TransactionFrame::dropAll(Database& db)
     db.getSession() << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq);";
 }
 
-void
-TransactionFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq)
+size_t
+TransactionFrame::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                   uint32_t count)
 {
-    db.getSession() << "DELETE FROM txhistory WHERE ledgerseq <= " << ledgerSeq;
-    db.getSession() << "DELETE FROM txfeehistory WHERE ledgerseq <= "
-                    << ledgerSeq;
+    return deleteOldEntriesHelper(sess, ledgerSeq, count, "txhistory",
+                                  "ledgerseq") +
+           deleteOldEntriesHelper(sess, ledgerSeq, count, "txfeehistory",
+                                  "ledgerseq");
 }
 }
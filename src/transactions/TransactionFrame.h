@@ -28,6 +28,7 @@ class OperationFrame;
 class LedgerDelta;
 class SecretKey;
 class SignatureChecker;
+struct SignatureToVerify;
 class XDROutputFileStream;
 class SHA256;
 
@@ -140,6 +141,12 @@ class TransactionFrame
     bool checkSignature(SignatureChecker& signatureChecker,
                         AccountFrame& account, int32_t neededWeight);
 
+    // adds the (signature, ed25519 signer) pairs with matching hints for the
+    // current signers of the source accounts of this transaction and of its
+    // operations
+    void collectSignaturesToVerify(Database& db,
+                                   std::vector<SignatureToVerify>& sigs) const;
+
     bool checkValid(Application& app, SequenceNumber current);
 
     // collect fee, consume sequence number
@@ -185,6 +192,9 @@ class TransactionFrame
                                            XDROutputFileStream& txResultOut);
     static void dropAll(Database& db);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq);
+    // deletes the history of the `count` oldest ledgers <= ledgerSeq,
+    // returns the number of rows deleted
+    static size_t deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                   uint32_t count);
 };
 }
@@ -11,6 +11,10 @@
 
 #ifdef _WIN32
 #include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
 #else
 #include <sys/stat.h>
 #endif
@@ -87,6 +91,20 @@ exists(std::string const& name)
     return true;
 }
 
+bool
+truncateFile(std::string const& path, uint64_t size)
+{
+    int fd;
+    if (_sopen_s(&fd, path.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO,
+                 _S_IREAD | _S_IWRITE) != 0)
+    {
+        return false;
+    }
+    bool ok = _chsize_s(fd, static_cast<__int64>(size)) == 0;
+    _close(fd);
+    return ok;
+}
+
 bool
 mkdir(std::string const& name)
 {
@@ -211,6 +229,12 @@ exists(std::string const& name)
     return true;
 }
 
+bool
+truncateFile(std::string const& path, uint64_t size)
+{
+    return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+}
+
 bool
 mkdir(std::string const& name)
 {
@@ -31,6 +31,9 @@ void unlockFile(std::string const& path);
 // Whether a path exists
 bool exists(std::string const& path);
 
+// Cuts the file at `path` down to `size` bytes; returns false on failure.
+bool truncateFile(std::string const& path, uint64_t size);
+
 // Delete a path and everything inside it (if a dir)
 void deltree(std::string const& path);
 
@@ -24,6 +24,7 @@ class XDRInputFileStream
     std::ifstream mIn;
     std::vector<char> mBuf;
     int mSizeLimit;
+    uint64_t mPos{0};
 
   public:
     XDRInputFileStream(int sizeLimit = 0) : mSizeLimit{sizeLimit}
@@ -49,6 +50,24 @@ class XDRInputFileStream
             CLOG(ERROR, "Fs") << msg;
             throw std::runtime_error(msg);
         }
+        mPos = 0;
+    }
+
+    // Offset of the next object to read.
+    uint64_t
+    pos() const
+    {
+        return mPos;
+    }
+
+    // Continues reading from `pos`, which must be the offset of an object (or
+    // the end of the file).
+    void
+    seek(uint64_t pos)
+    {
+        mIn.clear();
+        mIn.seekg(pos);
+        mPos = pos;
     }
 
     operator bool() const
@@ -91,6 +110,7 @@ class XDRInputFileStream
         }
         xdr::xdr_get g(mBuf.data(), mBuf.data() + sz);
         xdr::xdr_argpack_archive(g, out);
+        mPos += sz + 4;
         return true;
     }
 };
@@ -108,9 +128,18 @@ class XDROutputFileStream
     }
 
     void
-    open(std::string const& filename)
+    flush()
     {
-        mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
+        mOut.flush();
+    }
+
+    // Opens `filename`, truncating it unless `append`.
+    void
+    open(std::string const& filename, bool append = false)
+    {
+        mOut.open(filename, std::ofstream::binary | (append
+                                                         ? std::ofstream::app
+                                                         : std::ofstream::trunc));
         if (!mOut)
         {
             std::string msg("failed to open XDR file: ");
@@ -129,7 +158,8 @@ class XDROutputFileStream
 
     template <typename T>
     bool
-    writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
+    writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr,
+             SHA256* extraHasher = nullptr)
     {
         uint32_t sz = (uint32_t)xdr::xdr_size(t);
         assert(sz < 0x80000000);
@@ -157,6 +187,10 @@ class XDROutputFileStream
         {
             hasher->add(ByteSlice(mBuf.data(), sz + 4));
         }
+        if (extraHasher)
+        {
+            extraHasher->add(ByteSlice(mBuf.data(), sz + 4));
+        }
         if (bytesPut)
         {
             *bytesPut += (sz + 4);
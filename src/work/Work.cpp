@@ -98,6 +98,13 @@ Work::getMaxRetries() const
     return mMaxRetries;
 }
 
+Work::Priority
+Work::getPriority() const
+{
+    auto parent = std::dynamic_pointer_cast<Work>(mParent.lock());
+    return parent ? parent->getPriority() : WORK_PRIORITY_BACKGROUND;
+}
+
 std::string
 Work::stateName(State st)
 {
@@ -120,6 +127,20 @@ Work::stateName(State st)
     }
 }
 
+std::string
+Work::priorityName(Priority p)
+{
+    switch (p)
+    {
+    case WORK_PRIORITY_CRITICAL:
+        return "critical";
+    case WORK_PRIORITY_BACKGROUND:
+        return "background";
+    default:
+        throw std::runtime_error("Unknown Work::Priority");
+    }
+}
+
 std::function<void(asio::error_code const& ec)>
 Work::callComplete()
 {
@@ -147,7 +168,7 @@ Work::scheduleRun()
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling run of " << getUniqueName();
     mScheduled = true;
-    mApp.getClock().getIOService().post([weak]() {
+    mApp.getWorkManager().post(getPriority(), [weak]() {
         auto self = weak.lock();
         if (!self)
         {
@@ -170,7 +191,7 @@ Work::scheduleComplete(CompleteResult result)
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling completion of " << getUniqueName();
     mScheduled = true;
-    mApp.getClock().getIOService().post([weak, result]() {
+    mApp.getWorkManager().post(getPriority(), [weak, result]() {
         auto self = weak.lock();
         if (!self)
         {
@@ -181,6 +202,35 @@ Work::scheduleComplete(CompleteResult result)
     });
 }
 
+void
+Work::scheduleOnExecutor(std::function<CompleteResult()> body)
+{
+    std::weak_ptr<Work> weak(
+        std::static_pointer_cast<Work>(shared_from_this()));
+    auto generation = mGeneration;
+    auto priority = getPriority();
+    auto& app = mApp;
+    CLOG(DEBUG, "Work") << "scheduling " << getUniqueName()
+                        << " on the I/O executor";
+    mApp.getWorkManager().postToExecutor(
+        priority, [weak, generation, priority, &app, body]() {
+            auto result = body();
+            app.getClock().getIOService().post(
+                [weak, generation, priority, &app, result]() {
+                    app.getWorkManager().post(
+                        priority, [weak, generation, result]() {
+                            auto self = weak.lock();
+                            if (!self || self->mGeneration != generation ||
+                                self->getState() != WORK_RUNNING)
+                            {
+                                return;
+                            }
+                            self->complete(result);
+                        });
+                });
+        });
+}
+
 void
 Work::scheduleRetry()
 {
@@ -230,6 +280,7 @@ void
 Work::reset()
 {
     CLOG(DEBUG, "Work") << "resetting " << getUniqueName();
+    ++mGeneration;
     setState(WORK_PENDING);
     onReset();
 }
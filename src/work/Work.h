@@ -57,6 +57,14 @@ class Work : public WorkParent
         WORK_COMPLETE_FATAL
     };
 
+    // Scheduling classes of the WorkManager, in decreasing priority.
+    enum Priority
+    {
+        WORK_PRIORITY_CRITICAL,
+        WORK_PRIORITY_BACKGROUND,
+        WORK_PRIORITY_COUNT
+    };
+
     Work(Application& app, WorkParent& parent, std::string uniqueName,
          size_t maxRetries = RETRY_A_FEW);
 
@@ -68,6 +76,11 @@ class Work : public WorkParent
     virtual size_t getMaxRetries() const;
     uint64_t getRetryETA() const;
 
+    // Scheduling class of this work. Defaults to that of the parent work,
+    // WORK_PRIORITY_BACKGROUND for work added directly to the WorkManager;
+    // override it for work that the node needs to rejoin consensus.
+    virtual Priority getPriority() const;
+
     // Customize work behavior via these callbacks. onReset is called
     // before any work starts (on addition, or retry). onStart is called
     // when transitioning from WORK_PENDING -> WORK_RUNNING; onRun is
@@ -93,6 +106,7 @@ class Work : public WorkParent
     virtual State onSuccess();
 
     static std::string stateName(State st);
+    static std::string priorityName(Priority p);
     State getState() const;
     bool isDone() const;
     void advance();
@@ -105,6 +119,9 @@ class Work : public WorkParent
     size_t mRetries{0};
     State mState{WORK_PENDING};
     bool mScheduled {false};
+    // bumped on every reset, to drop completions of executor jobs started
+    // before it
+    uint64_t mGeneration{0};
 
     std::unique_ptr<VirtualTimer> mRetryTimer;
 
@@ -114,6 +131,10 @@ class Work : public WorkParent
     void scheduleComplete(CompleteResult result = WORK_COMPLETE_OK);
     void scheduleRetry();
     void scheduleRun();
+    // Runs `body` on the WorkManager I/O executor, off the main thread, and
+    // completes this work with its result unless the work was reset in the
+    // meantime. `body` must not touch anything the main thread may use.
+    void scheduleOnExecutor(std::function<CompleteResult()> body);
     void
     scheduleSuccess()
     {
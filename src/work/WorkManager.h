@@ -8,6 +8,7 @@
 #include "util/Timer.h"
 #include "work/Work.h"
 #include "work/WorkParent.h"
+#include <functional>
 #include <string>
 
 namespace stellar
@@ -18,6 +19,18 @@ namespace stellar
  * dependencies between asynchronous or long-running activities that each
  * might soft-fail and require retrying, or require breaking up into pieces
  * to avoid monopolizing the main thread for too long.
+ *
+ * It also schedules the state transitions of all that Work on the main
+ * thread. Each transition is queued in the priority class of its Work
+ * (consensus-critical or background) and at most a bounded number of
+ * transitions of each class are posted to the main io_service at a time,
+ * critical ones first; so a large catchup or publish interleaves with SCP
+ * and overlay handlers instead of flooding the io_service ahead of them.
+ *
+ * Finally it owns a small executor dedicated to blocking I/O (file hashing,
+ * reading and writing archive files) that Work can run its bodies on, see
+ * Work::scheduleOnExecutor, so that those do not compete with the CPU-bound
+ * jobs on the application worker threads.
  */
 class WorkManager : public WorkParent
 {
@@ -26,5 +39,23 @@ class WorkManager : public WorkParent
     virtual ~WorkManager();
     static std::shared_ptr<WorkManager> create(Application& app);
     virtual void notify(std::string const& changed) = 0;
+
+    // Runs `fn` on the main thread, after the transitions queued before it
+    // in class `priority`.
+    virtual void post(Work::Priority priority, std::function<void()> fn) = 0;
+
+    // Runs `fn` on the I/O executor. Must be called from the main thread.
+    virtual void postToExecutor(Work::Priority priority,
+                                std::function<void()> fn) = 0;
+
+    // Maximum number of transitions of class `priority` posted to the main
+    // io_service at any time.
+    virtual void setMaxConcurrency(Work::Priority priority, size_t n) = 0;
+
+    // Queued (not yet posted) transitions of class `priority`.
+    virtual size_t getQueueLength(Work::Priority priority) const = 0;
+
+    // Waits for the jobs already on the I/O executor and stops it.
+    virtual void shutdown() = 0;
 };
 }
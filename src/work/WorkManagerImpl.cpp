@@ -2,17 +2,23 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "work/Work.h"
 #include "work/WorkManager.h"
 #include "work/WorkManagerImpl.h"
 #include "work/WorkParent.h"
 
 #include "lib/util/format.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 #include "util/make_unique.h"
 
+#include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
 
 namespace stellar
 {
@@ -25,12 +31,123 @@ WorkManager::~WorkManager()
 {
 }
 
-WorkManagerImpl::WorkManagerImpl(Application& app) : WorkManager(app)
+WorkManagerImpl::WorkManagerImpl(Application& app)
+    : WorkManager(app), mClasses(Work::WORK_PRIORITY_COUNT)
 {
+    for (size_t i = 0; i < mClasses.size(); ++i)
+    {
+        auto name = Work::priorityName(static_cast<Work::Priority>(i));
+        auto& c = mClasses[i];
+        c.mQueueLength = &app.getMetrics().NewCounter({"work", "queue", name});
+        c.mRunTime = &app.getMetrics().NewTimer({"work", "run", name});
+        mExecutorRunTime.push_back(
+            &app.getMetrics().NewTimer({"work", "executor", name}));
+    }
+    // Critical work is still bounded so that a burst of it cannot starve
+    // the other main thread handlers either; background work only ever has
+    // a few steps in the io_service queue at a time.
+    mClasses[Work::WORK_PRIORITY_CRITICAL].mMaxInFlight = 32;
+    mClasses[Work::WORK_PRIORITY_BACKGROUND].mMaxInFlight = 4;
 }
 
 WorkManagerImpl::~WorkManagerImpl()
 {
+    shutdown();
+}
+
+void
+WorkManagerImpl::post(Work::Priority priority, std::function<void()> fn)
+{
+    auto& c = mClasses.at(priority);
+    c.mQueue.push_back(fn);
+    c.mQueueLength->inc();
+    dispatch();
+}
+
+void
+WorkManagerImpl::dispatch()
+{
+    std::weak_ptr<WorkManagerImpl> weak(
+        std::static_pointer_cast<WorkManagerImpl>(shared_from_this()));
+    for (auto& c : mClasses)
+    {
+        while (!c.mQueue.empty() && c.mInFlight < c.mMaxInFlight)
+        {
+            auto fn = c.mQueue.front();
+            c.mQueue.pop_front();
+            c.mQueueLength->dec();
+            ++c.mInFlight;
+            auto pc = &c;
+            mApp.getClock().getIOService().post([weak, pc, fn]() {
+                auto self = weak.lock();
+                if (!self)
+                {
+                    return;
+                }
+                --pc->mInFlight;
+                {
+                    auto time = pc->mRunTime->TimeScope();
+                    fn();
+                }
+                self->dispatch();
+            });
+        }
+    }
+}
+
+void
+WorkManagerImpl::setMaxConcurrency(Work::Priority priority, size_t n)
+{
+    mClasses.at(priority).mMaxInFlight = std::max<size_t>(1, n);
+    dispatch();
+}
+
+size_t
+WorkManagerImpl::getQueueLength(Work::Priority priority) const
+{
+    return mClasses.at(priority).mQueue.size();
+}
+
+void
+WorkManagerImpl::startExecutor()
+{
+    // blocking I/O is bounded by the same knob as the subprocesses doing it
+    auto n = std::max<size_t>(1, mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES);
+    mExecutor.reset();
+    mExecutorWork = make_unique<asio::io_service::work>(mExecutor);
+    for (size_t i = 0; i < n; ++i)
+    {
+        mExecutorThreads.emplace_back([this]() { mExecutor.run(); });
+    }
+    CLOG(DEBUG, "Work") << "Started I/O executor with " << n << " threads";
+}
+
+void
+WorkManagerImpl::postToExecutor(Work::Priority priority,
+                                std::function<void()> fn)
+{
+    if (mExecutorThreads.empty())
+    {
+        startExecutor();
+    }
+    auto timer = mExecutorRunTime.at(priority);
+    mExecutor.post([timer, fn]() {
+        auto time = timer->TimeScope();
+        fn();
+    });
+}
+
+void
+WorkManagerImpl::shutdown()
+{
+    // let the threads finish the jobs already queued, as for the
+    // application worker threads
+    mExecutorWork.reset();
+    for (auto& t : mExecutorThreads)
+    {
+        t.join();
+    }
+    mExecutorThreads.clear();
 }
 
 void
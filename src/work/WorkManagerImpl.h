@@ -2,16 +2,54 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "work/WorkManager.h"
 
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Timer;
+}
+
 namespace stellar
 {
 
 class WorkManagerImpl : public WorkManager
 {
+    struct PriorityClass
+    {
+        std::deque<std::function<void()>> mQueue;
+        size_t mInFlight{0};
+        size_t mMaxInFlight{0};
+        medida::Counter* mQueueLength{nullptr};
+        medida::Timer* mRunTime{nullptr};
+    };
+
+    std::vector<PriorityClass> mClasses;
+
+    asio::io_service mExecutor;
+    std::unique_ptr<asio::io_service::work> mExecutorWork;
+    std::vector<std::thread> mExecutorThreads;
+    std::vector<medida::Timer*> mExecutorRunTime;
+
+    void dispatch();
+    void startExecutor();
+
   public:
     WorkManagerImpl(Application& app);
     virtual ~WorkManagerImpl();
     virtual void notify(std::string const&) override;
+
+    void post(Work::Priority priority, std::function<void()> fn) override;
+    void postToExecutor(Work::Priority priority,
+                        std::function<void()> fn) override;
+    void setMaxConcurrency(Work::Priority priority, size_t n) override;
+    size_t getQueueLength(Work::Priority priority) const override;
+    void shutdown() override;
 };
 }
@@ -10,6 +10,7 @@
 #include "util/Fs.h"
 #include "work/WorkManager.h"
 
+#include <atomic>
 #include <cstdio>
 #include <fstream>
 #include <random>
@@ -97,6 +98,112 @@ TEST_CASE("work steps", "[work]")
     }
 }
 
+class CriticalCountDownWork : public CountDownWork
+{
+  public:
+    CriticalCountDownWork(Application& app, WorkParent& parent, size_t count)
+        : CountDownWork(app, parent, count)
+    {
+    }
+
+    virtual Priority
+    getPriority() const override
+    {
+        return WORK_PRIORITY_CRITICAL;
+    }
+};
+
+TEST_CASE("work priorities", "[work]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer appPtr = Application::create(clock, cfg);
+    auto& wm = appPtr->getWorkManager();
+    wm.setMaxConcurrency(Work::WORK_PRIORITY_BACKGROUND, 1);
+
+    std::vector<std::shared_ptr<Work>> background;
+    for (size_t i = 1; i <= 3; ++i)
+    {
+        auto w = wm.addWork<Work>("background-" + std::to_string(i));
+        w->addWork<CountDownWork>(10);
+        background.push_back(w);
+    }
+    auto critical = wm.addWork<CriticalCountDownWork>(10);
+    wm.advanceChildren();
+    REQUIRE(wm.getQueueLength(Work::WORK_PRIORITY_BACKGROUND) == 2);
+    REQUIRE(wm.getQueueLength(Work::WORK_PRIORITY_CRITICAL) == 0);
+
+    while (critical->getState() != Work::WORK_SUCCESS)
+    {
+        clock.crank();
+    }
+    for (auto const& w : background)
+    {
+        REQUIRE(!w->isDone());
+    }
+    while (!wm.allChildrenSuccessful())
+    {
+        clock.crank();
+    }
+}
+
+class ExecutorWork : public Work
+{
+    std::atomic<int>& mRuns;
+    CompleteResult mResult;
+
+  public:
+    ExecutorWork(Application& app, WorkParent& parent,
+                 std::string const& uniqueName, std::atomic<int>& runs,
+                 CompleteResult result)
+        : Work(app, parent, uniqueName, RETRY_NEVER)
+        , mRuns(runs)
+        , mResult(result)
+    {
+    }
+
+    virtual void
+    onRun() override
+    {
+        auto& runs = mRuns;
+        auto result = mResult;
+        scheduleOnExecutor([&runs, result]() -> CompleteResult {
+            ++runs;
+            return result;
+        });
+    }
+};
+
+TEST_CASE("work on the I/O executor", "[work]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer appPtr = Application::create(clock, cfg);
+    auto& wm = appPtr->getWorkManager();
+
+    std::atomic<int> runs{0};
+    std::vector<std::shared_ptr<Work>> succeeding;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        succeeding.push_back(wm.addWork<ExecutorWork>(
+            "ok-" + std::to_string(i), runs, Work::WORK_COMPLETE_OK));
+    }
+    auto failing = wm.addWork<ExecutorWork>("failing", runs,
+                                            Work::WORK_COMPLETE_FAILURE);
+    wm.advanceChildren();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank();
+    }
+
+    REQUIRE(runs == 9);
+    for (auto const& w : succeeding)
+    {
+        REQUIRE(w->getState() == Work::WORK_SUCCESS);
+    }
+    REQUIRE(failing->getState() == Work::WORK_FAILURE_RAISE);
+}
+
 class FailingWork : public Work
 {
   public: